@@ -0,0 +1,77 @@
+// accesslog.hpp – fixed‑size binary access log records (server --access-log, ./logtool)
+//
+// a segment is a 128‑byte header record followed by 128‑byte access records,
+// all in host byte order; the header carries an endian marker so a reader
+// on a different machine refuses the file instead of misreading it.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+static const char     ACCESS_MAGIC[8] = { 'H', 'S', 'A', 'C', 'C', '0', '0', '1' };
+static const uint32_t ACCESS_ENDIAN   = 0x01020304u;
+
+enum : uint8_t {
+    ACC_OK             = 0,     // termination pair sent
+    ACC_DROP_HANDSHAKE = 1,     // client went away before the body
+    ACC_DROP_BODY      = 2,     // client went away mid‑body
+    ACC_REFUSED        = 3,     // query refused: "error: why" in place of the metadata
+};
+
+enum : uint8_t {
+    ACC_V2 = 1,                 // body used v2 framing
+};
+
+struct access_rec {
+    uint64_t ts_ns;             // wall clock at accept, ns since epoch
+    uint64_t bytes;             // file bytes sent
+    uint64_t duration_ns;       // accept → close
+    uint32_t peer_ip;           // ipv4, network order
+    uint16_t peer_port;         // host order
+    uint8_t  result;
+    uint8_t  flags;
+    char     client[32];        // truncated, nul‑padded
+    char     query[64];
+};
+
+struct access_seg_header {
+    char     magic[8];
+    uint32_t endian;
+    uint32_t rec_size;
+    uint64_t created_ns;
+    char     pad[104];
+};
+
+static_assert(sizeof(access_rec) == 128, "access_rec must stay 128 bytes");
+static_assert(sizeof(access_seg_header) == sizeof(access_rec), "header is one record wide");
+
+/* nul‑padded copy into a fixed field ------------------------------------- */
+template <size_t N>
+static inline void access_set(char (&dst)[N], const std::string& s) {
+    std::memset(dst, 0, N);
+    std::memcpy(dst, s.data(), s.size() < N ? s.size() : N);
+}
+
+template <size_t N>
+static inline std::string access_get(const char (&src)[N]) {
+    size_t n = 0;
+    while (n < N && src[n]) ++n;
+    return std::string(src, n);
+}
+
+static inline access_seg_header access_make_header(uint64_t created_ns) {
+    access_seg_header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, ACCESS_MAGIC, sizeof(h.magic));
+    h.endian     = ACCESS_ENDIAN;
+    h.rec_size   = sizeof(access_rec);
+    h.created_ns = created_ns;
+    return h;
+}
+
+static inline bool access_check_header(const access_seg_header& h) {
+    return std::memcmp(h.magic, ACCESS_MAGIC, sizeof(h.magic)) == 0 &&
+           h.endian == ACCESS_ENDIAN && h.rec_size == sizeof(access_rec);
+}
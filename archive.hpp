@@ -0,0 +1,289 @@
+// archive.hpp – random‑access member index for tar and zip (server --archive)
+//
+// archive_index::build reads only headers: tar's 512‑byte member headers
+// (ustar, gnu long names, pax path/size records) or zip's central directory
+// (zip64 included) plus one local header per member, and records where each
+// member's bytes start. stored members can then be sent straight from the
+// archive with sendfile at that offset; compressed zip members are listed
+// with their method so the server can say why it won't serve them.
+//
+// the index is cached next to the archive as <archive>.idx:
+//   8‑byte magic, varints archive size, archive mtime (ns), kind (1 zip,
+//   0 tar), member count, then per member varints offset, stored size, size, method, name length,
+//   name bytes. a size or mtime mismatch means rebuild.
+
+#pragma once
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "capture.hpp"                  // leb128 varints
+
+static const char ARCHIVE_IDX_MAGIC[8] = { 'H', 'S', 'A', 'I', 'D', 'X', '0', '1' };
+
+enum : uint16_t { ARC_STORED = 0, ARC_DEFLATE = 8 };   // zip method numbers; tar is stored
+
+struct archive_member {
+    std::string name;
+    uint64_t    off    = 0;         // first data byte in the archive
+    uint64_t    csize  = 0;         // bytes in the archive
+    uint64_t    size   = 0;         // bytes once extracted
+    uint16_t    method = ARC_STORED;
+};
+
+class archive_index {
+public:
+    const char* kind = "";          // "tar" or "zip"
+
+    size_t size() const { return members_.size(); }
+
+    const archive_member* find(const std::string& name) const {
+        auto it = by_name_.find(name);
+        return it == by_name_.end() ? nullptr : &members_[it->second];
+    }
+
+    /* scan the archive's headers; false with err set if it is neither ---- */
+    bool build(int fd, uint64_t file_size, std::string& err) {
+        members_.clear();
+        by_name_.clear();
+        char magic[4] = { 0 };
+        if (file_size >= 4 && !read_at(fd, magic, 4, 0)) { err = "read failed"; return false; }
+        bool ok;
+        if (std::memcmp(magic, "PK\3\4", 4) == 0 || std::memcmp(magic, "PK\5\6", 4) == 0) {
+            kind = "zip";
+            ok   = build_zip(fd, file_size, err);
+        } else {
+            kind = "tar";
+            ok   = build_tar(fd, file_size, err);
+        }
+        for (size_t i = 0; ok && i < members_.size(); ++i) by_name_[members_[i].name] = i;
+        return ok;
+    }
+
+    /* <archive>.idx, if it was made for this size and mtime -------------- */
+    bool load(const std::string& path, uint64_t file_size, uint64_t mtime_ns) {
+        FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) return false;
+        char     magic[sizeof(ARCHIVE_IDX_MAGIC)];
+        uint64_t sz = 0, mt = 0, n = 0, kind_zip = 0;
+        bool ok = std::fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+                  std::memcmp(magic, ARCHIVE_IDX_MAGIC, sizeof(magic)) == 0 &&
+                  get_varint(f, sz) && get_varint(f, mt) && get_varint(f, kind_zip) &&
+                  get_varint(f, n) && sz == file_size && mt == mtime_ns;
+        std::vector<archive_member> ms;
+        for (uint64_t i = 0; ok && i < n; ++i) {
+            archive_member m;
+            uint64_t method = 0;
+            ok = get_varint(f, m.off) && get_varint(f, m.csize) && get_varint(f, m.size) &&
+                 get_varint(f, method) && get_string(f, m.name) && m.off + m.csize <= file_size;
+            m.method = static_cast<uint16_t>(method);
+            ms.push_back(m);
+        }
+        std::fclose(f);
+        if (!ok) return false;
+        kind = kind_zip ? "zip" : "tar";
+        members_.swap(ms);
+        by_name_.clear();
+        for (size_t i = 0; i < members_.size(); ++i) by_name_[members_[i].name] = i;
+        return true;
+    }
+
+    bool save(const std::string& path, uint64_t file_size, uint64_t mtime_ns) const {
+        std::string out(ARCHIVE_IDX_MAGIC, sizeof(ARCHIVE_IDX_MAGIC));
+        put_varint(out, file_size);
+        put_varint(out, mtime_ns);
+        put_varint(out, std::strcmp(kind, "zip") == 0);
+        put_varint(out, members_.size());
+        for (auto& m : members_) {
+            put_varint(out, m.off);
+            put_varint(out, m.csize);
+            put_varint(out, m.size);
+            put_varint(out, m.method);
+            put_varint(out, m.name.size());
+            out += m.name;
+        }
+        std::string tmp = path + ".tmp";
+        FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+        bool ok = std::fwrite(out.data(), 1, out.size(), f) == out.size();
+        ok = std::fclose(f) == 0 && ok;
+        return ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    static bool read_at(int fd, void* buf, size_t n, uint64_t off) {
+        char* p = static_cast<char*>(buf);
+        while (n) {
+            ssize_t r = ::pread(fd, p, n, static_cast<off_t>(off));
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return false;
+            p += r; n -= r; off += r;
+        }
+        return true;
+    }
+
+    static uint16_t le16(const unsigned char* p) { return static_cast<uint16_t>(p[0] | p[1] << 8); }
+    static uint32_t le32(const unsigned char* p) { return le16(p) | static_cast<uint32_t>(le16(p + 2)) << 16; }
+    static uint64_t le64(const unsigned char* p) { return le32(p) | static_cast<uint64_t>(le32(p + 4)) << 32; }
+
+    /* tar numbers: octal text, or gnu base‑256 when the top bit is set -- */
+    static uint64_t tar_num(const char* p, size_t n) {
+        const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+        uint64_t v = 0;
+        if (u[0] & 0x80) {
+            for (size_t i = 1; i < n; ++i) v = v << 8 | u[i];
+            return v;
+        }
+        for (size_t i = 0; i < n && p[i]; ++i)
+            if (p[i] >= '0' && p[i] <= '7') v = v * 8 + (p[i] - '0');
+        return v;
+    }
+
+    static std::string tar_str(const char* p, size_t n) { return std::string(p, strnlen(p, n)); }
+
+    bool build_tar(int fd, uint64_t file_size, std::string& err) {
+        char        h[512];
+        std::string long_name, pax_path;
+        uint64_t    pax_size = 0;
+        bool        have_pax_size = false;
+        for (uint64_t at = 0; at + 512 <= file_size;) {
+            if (!read_at(fd, h, 512, at)) { err = "read failed"; return false; }
+            if (h[0] == '\0') break;                            // end‑of‑archive blocks
+            unsigned sum = 0;
+            for (int i = 0; i < 512; ++i) sum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(h[i]);
+            if (sum != tar_num(h + 148, 8)) {
+                err = "not a tar or zip archive (bad header at " + std::to_string(at) + ")";
+                return false;
+            }
+            uint64_t size = tar_num(h + 124, 12);
+            uint64_t data = at + 512;
+            char     type = h[156];
+            if (type == 'L' || type == 'x') {                   // metadata for the next member
+                if (data + size > file_size) { err = "truncated archive"; return false; }
+                std::string body(size, '\0');
+                if (size && !read_at(fd, &body[0], size, data)) { err = "read failed"; return false; }
+                if (type == 'L') {
+                    long_name = body.c_str();
+                } else {
+                    /* pax records: "LEN key=value\n" ----------------------- */
+                    for (size_t p = 0; p < body.size();) {
+                        size_t len = std::strtoul(body.c_str() + p, nullptr, 10);
+                        if (!len || p + len > body.size()) break;
+                        std::string rec = body.substr(p, len);
+                        size_t sp = rec.find(' '), eq = rec.find('=');
+                        if (sp != std::string::npos && eq != std::string::npos && eq > sp) {
+                            std::string key = rec.substr(sp + 1, eq - sp - 1);
+                            std::string val = rec.substr(eq + 1, rec.size() - eq - 2);
+                            if (key == "path") pax_path = val;
+                            if (key == "size") { pax_size = std::strtoull(val.c_str(), nullptr, 10); have_pax_size = true; }
+                        }
+                        p += len;
+                    }
+                }
+            } else {
+                if (have_pax_size) size = pax_size;
+                if (type == '0' || type == '\0' || type == '7') {
+                    archive_member m;
+                    if (!pax_path.empty())       m.name = pax_path;
+                    else if (!long_name.empty()) m.name = long_name;
+                    else {
+                        std::string prefix = std::memcmp(h + 257, "ustar", 5) == 0 ? tar_str(h + 345, 155) : "";
+                        m.name = (prefix.empty() ? "" : prefix + '/') + tar_str(h, 100);
+                    }
+                    if (m.name.compare(0, 2, "./") == 0) m.name.erase(0, 2);
+                    m.off   = data;
+                    m.csize = m.size = size;
+                    if (data + size > file_size) { err = "truncated archive"; return false; }
+                    members_.push_back(m);
+                }
+                long_name.clear();
+                pax_path.clear();
+                have_pax_size = false;
+            }
+            at = data + (size + 511) / 512 * 512;
+        }
+        return true;
+    }
+
+    bool build_zip(int fd, uint64_t file_size, std::string& err) {
+        /* end of central directory: last 22..65557 bytes ---------------- */
+        uint64_t tail = std::min<uint64_t>(file_size, 65557);
+        std::vector<unsigned char> t(tail);
+        if (!read_at(fd, t.data(), tail, file_size - tail)) { err = "read failed"; return false; }
+        size_t eocd = tail;
+        for (size_t i = tail >= 22 ? tail - 22 + 1 : 0; i-- > 0;)
+            if (le32(&t[i]) == 0x06054b50) { eocd = i; break; }
+        if (eocd == tail) { err = "zip without end of central directory"; return false; }
+        uint64_t count  = le16(&t[eocd + 10]);
+        uint64_t cd_off = le32(&t[eocd + 16]);
+        uint64_t cd_len = le32(&t[eocd + 12]);
+        if ((count == 0xffff || cd_off == 0xffffffffu) && eocd >= 20 &&
+            le32(&t[eocd - 20]) == 0x07064b50) {                // zip64 locator
+            unsigned char z[56];
+            if (!read_at(fd, z, sizeof(z), le64(&t[eocd - 20 + 8])) || le32(z) != 0x06064b50) {
+                err = "bad zip64 end of central directory";
+                return false;
+            }
+            count  = le64(z + 32);
+            cd_len = le64(z + 40);
+            cd_off = le64(z + 48);
+        }
+        if (cd_off + cd_len > file_size) { err = "truncated zip"; return false; }
+        std::vector<unsigned char> cd(cd_len);
+        if (cd_len && !read_at(fd, cd.data(), cd_len, cd_off)) { err = "read failed"; return false; }
+
+        for (size_t p = 0; count--;) {
+            if (p + 46 > cd.size() || le32(&cd[p]) != 0x02014b50) { err = "bad central directory"; return false; }
+            uint16_t flags  = le16(&cd[p + 8]);
+            uint16_t method = le16(&cd[p + 10]);
+            uint64_t csize  = le32(&cd[p + 20]);
+            uint64_t size   = le32(&cd[p + 24]);
+            size_t   nlen = le16(&cd[p + 28]), xlen = le16(&cd[p + 30]), clen = le16(&cd[p + 32]);
+            uint64_t lho    = le32(&cd[p + 42]);
+            if (p + 46 + nlen + xlen > cd.size()) { err = "bad central directory"; return false; }
+            std::string name(reinterpret_cast<const char*>(&cd[p + 46]), nlen);
+            /* zip64 extra: only the fields that overflowed, in this order - */
+            size_t xend = p + 46 + nlen + xlen;
+            for (size_t x = p + 46 + nlen; x + 4 <= xend;) {
+                uint16_t id = le16(&cd[x]), len = le16(&cd[x + 2]);
+                if (id == 0x0001) {
+                    size_t v = x + 4, end = std::min(x + 4 + len, xend);   // a lying len stays in the record
+                    if (size == 0xffffffffu && v + 8 <= end)  { size  = le64(&cd[v]); v += 8; }
+                    if (csize == 0xffffffffu && v + 8 <= end) { csize = le64(&cd[v]); v += 8; }
+                    if (lho == 0xffffffffu && v + 8 <= end)   { lho   = le64(&cd[v]); }
+                }
+                x += 4 + len;
+            }
+            p += 46 + nlen + xlen + clen;
+            if (name.empty() || name.back() == '/' || (flags & 1)) continue;   // dirs, encrypted
+
+            unsigned char lh[30];
+            if (!read_at(fd, lh, sizeof(lh), lho) || le32(lh) != 0x04034b50) {
+                err = "bad local header for " + name;
+                return false;
+            }
+            archive_member m;
+            m.name   = name;
+            m.off    = lho + 30 + le16(lh + 26) + le16(lh + 28);
+            m.csize  = csize;
+            m.size   = size;
+            m.method = method;
+            if (m.off + m.csize > file_size) { err = "truncated zip"; return false; }
+            members_.push_back(m);
+        }
+        return true;
+    }
+
+    std::vector<archive_member>             members_;
+    std::unordered_map<std::string, size_t> by_name_;
+};
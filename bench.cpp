@@ -0,0 +1,813 @@
+// bench.cpp – load generator and benchmark driver for server
+// usage: ./bench scale [options]
+//        ./bench soak  [options]
+//        ./bench sol   [options]
+//
+// scale options:
+//   --server PATH         server binary (default ./server)
+//   --file PATH           file to serve (default: a generated file of --size bytes)
+//   --size BYTES          size of the generated file (default 262144)
+//   --max-workers N       sweep 1, 2, 4 … N workers (default: online cpus)
+//   --clients-per-worker K  client threads per server worker (default 4)
+//   --seconds S           measured time per step (default 5)
+//   --port P              first port; each step uses the next one (default 6100)
+//   --csv PATH            also write the table as csv
+//   --steer MODE          pass --steer to the server (shared, reuseport, cpu)
+//
+// each step starts a fresh server pinned to the first N cpus, drives it with
+// N*K looping clients and reports aggregate throughput, connections/sec and
+// handshake latency (connect → metadata received) against worker count,
+// plus rx-cpu: the share of connections a worker served on the cpu their
+// packets arrived on (compare --steer shared vs cpu).
+//
+// soak options (plus --server/--file/--size/--port as above):
+//   --seconds S           total run time (default 3600)
+//   --sample-every S      sampling period (default 10)
+//   --warmup S            time before the baseline sample (default 30)
+//   --clients N           concurrent client threads (default 8)
+//   --workers N           server workers (default 4)
+//   --abort-pct P         share of clients that disconnect abruptly (default 20)
+//   --max-rss-growth KB   allowed server rss growth over baseline (default 16384)
+//   --max-fd-growth N     allowed growth in open server fds (default 16)
+//   --max-heap-growth KB  allowed growth in server heap in use (default 16384)
+//   --max-p99-ratio R     allowed p99 latency vs baseline window (default 3.0)
+//
+// soak drives mixed traffic (full downloads plus clients that reset the
+// connection before, during or right after the handshake), samples the
+// server's rss, open fds, heap (via SIGUSR1 stats) and latency percentiles
+// every period, and exits non‑zero as soon as one drifts out of bounds.
+//
+// sol options (plus --server/--file/--port as above):
+//   --client PATH         client binary (default ./client)
+//   --size BYTES          size of the generated file (default 33554432)
+//   --reps N              transfers per mode, best one counts (default 3)
+//
+// sol (“speed of light”) first measures a bare sendfile → socket sender and
+// a splice → /dev/null receiver on loopback, then the real server and client
+// for every framing × server i/o mode, and reports each as a percentage of
+// that ceiling, both in throughput and in cpu seconds per GB moved.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "wire.hpp"
+
+static void die(const char* msg) { perror(msg); std::exit(1); }
+
+/* --key value options after the subcommand ------------------------------ */
+struct opts {
+    std::map<std::string, std::string> kv;
+
+    std::string str(const std::string& k, const std::string& def) const {
+        auto it = kv.find(k);
+        return it == kv.end() ? def : it->second;
+    }
+    long long num(const std::string& k, long long def) const {
+        auto it = kv.find(k);
+        return it == kv.end() ? def : std::atoll(it->second.c_str());
+    }
+    bool has(const std::string& k) const { return kv.count(k) != 0; }
+};
+
+static opts parse_opts(int argc, char* argv[], int first) {
+    opts o;
+    for (int i = first; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a.compare(0, 2, "--") != 0) {
+            std::cerr << "error: unexpected argument " << a << '\n';
+            std::exit(1);
+        }
+        a = a.substr(2);
+        if (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0) o.kv[a] = argv[++i];
+        else o.kv[a] = "1";
+    }
+    return o;
+}
+
+/* scratch file of pseudo‑random printable bytes -------------------------- */
+static std::string make_payload_file(uint64_t size) {
+    char path[] = "/tmp/bench-payload-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) die("mkstemp");
+    std::vector<char> buf(1 << 16);
+    uint32_t x = 2463534242u;
+    for (uint64_t done = 0; done < size;) {
+        size_t n = std::min<uint64_t>(buf.size(), size - done);
+        for (size_t i = 0; i < n; ++i) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            buf[i] = (i % 64 == 63) ? '\n' : char('a' + x % 26);
+        }
+        if (write(fd, buf.data(), n) != static_cast<ssize_t>(n)) die("write");
+        done += n;
+    }
+    ::close(fd);
+    return path;
+}
+
+/* server child process ---------------------------------------------------
+   stdout goes through a pipe so we can wait for the “listening” line; a
+   drain thread keeps reading so a chatty server never blocks on it        */
+struct server_proc {
+    pid_t       pid = -1;
+    std::thread drain;
+
+    /* latest “[server] stats …” line, for the soak sampler */
+    std::mutex              mu;
+    std::condition_variable cv;
+    std::string             stats;
+    uint64_t                stats_seq = 0;
+};
+
+static bool spawn_server(server_proc& sp, const std::vector<std::string>& args, int pin_cpus) {
+    int pfd[2];
+    if (pipe(pfd) < 0) die("pipe");
+    pid_t pid = fork();
+    if (pid < 0) die("fork");
+    if (pid == 0) {
+#if defined(__linux__)
+        if (pin_cpus > 0) {
+            cpu_set_t set; CPU_ZERO(&set);
+            for (int c = 0; c < pin_cpus && c < CPU_SETSIZE; ++c) CPU_SET(c, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+#else
+        (void)pin_cpus;
+#endif
+        dup2(pfd[1], STDOUT_FILENO);
+        ::close(pfd[0]); ::close(pfd[1]);
+        std::vector<char*> av;
+        for (auto& a : args) av.push_back(const_cast<char*>(a.c_str()));
+        av.push_back(nullptr);
+        execv(av[0], av.data());
+        perror("execv");
+        _exit(127);
+    }
+    ::close(pfd[1]);
+    sp.pid = pid;
+
+    /* wait for the banner, then hand the pipe to the drain thread ----- */
+    std::string line;
+    char c;
+    bool up = false;
+    while (read(pfd[0], &c, 1) == 1) {
+        if (c != '\n') { line += c; continue; }
+        if (line.find("listening") != std::string::npos) { up = true; break; }
+        line.clear();
+    }
+    int rfd = pfd[0];
+    server_proc* spp = &sp;
+    sp.drain = std::thread([rfd, spp] {
+        char buf[4096];
+        std::string cur;
+        ssize_t n;
+        while ((n = read(rfd, buf, sizeof(buf))) > 0) {
+            for (ssize_t i = 0; i < n; ++i) {
+                if (buf[i] != '\n') { cur += buf[i]; continue; }
+                if (cur.compare(0, 14, "[server] stats") == 0) {
+                    std::lock_guard<std::mutex> lk(spp->mu);
+                    spp->stats = cur;
+                    ++spp->stats_seq;
+                    spp->cv.notify_all();
+                }
+                cur.clear();
+            }
+        }
+        ::close(rfd);
+    });
+    return up;
+}
+
+static void stop_server(server_proc& sp) {
+    if (sp.pid > 0) {
+        kill(sp.pid, SIGTERM);
+        int st = 0;
+        waitpid(sp.pid, &st, 0);
+        sp.pid = -1;
+    }
+    if (sp.drain.joinable()) sp.drain.join();
+}
+
+/* one download over the legacy protocol ----------------------------------
+   `ab` makes the client vanish with a RST at the given point instead       */
+enum class abort_at { never, before_hello, after_handshake, mid_transfer };
+
+struct fetch_result {
+    bool     ok           = false;
+    uint64_t bytes        = 0;
+    uint64_t handshake_ns = 0;    // connect() start → metadata received
+    uint64_t total_ns     = 0;
+};
+
+static int connect_to(const sockaddr_in& srv) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&srv), sizeof(srv)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void hard_close(int fd) {
+    linger lg{};
+    lg.l_onoff  = 1;
+    lg.l_linger = 0;
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    ::close(fd);
+}
+
+static fetch_result fetch_once(const sockaddr_in& srv, const std::string& name,
+                               const std::string& query, abort_at ab = abort_at::never) {
+    fetch_result r;
+    uint64_t t0 = now_ns();
+    int fd = connect_to(srv);
+    if (fd < 0) return r;
+    if (ab == abort_at::before_hello) { hard_close(fd); r.ok = true; return r; }
+
+    std::string server_name, file_name;
+    uint64_t netsize = 0;
+    if (!send_str(fd, name) || !send_str(fd, query) ||
+        !recv_str(fd, server_name) || !recv_str(fd, file_name) ||
+        !recv_all(fd, &netsize, 8)) {
+        ::close(fd);
+        return r;
+    }
+    r.handshake_ns = now_ns() - t0;
+    uint64_t file_size = be64_to_host(netsize);
+    if (ab == abort_at::after_handshake) { hard_close(fd); r.ok = true; return r; }
+    if (!send_str(fd, "Start")) { ::close(fd); return r; }
+
+    char buf[LEGACY_CHUNK];
+    while (true) {
+        char flag = 0;
+        if (!recv_all(fd, &flag, 1)) break;
+        if (flag == '0') {
+            char second = 0;
+            r.ok = recv_all(fd, &second, 1) && r.bytes == file_size;
+            break;
+        }
+        if (flag != '1') break;
+        size_t want = std::min<uint64_t>(LEGACY_CHUNK, file_size - r.bytes);
+        if (!recv_all(fd, buf, want)) break;
+        r.bytes += want;
+        if (ab == abort_at::mid_transfer && r.bytes * 2 >= file_size) {
+            hard_close(fd);
+            r.ok = true;
+            return r;
+        }
+    }
+    r.total_ns = now_ns() - t0;
+    ::close(fd);
+    return r;
+}
+
+/* latency samples ------------------------------------------------------- */
+static double pct_ms(std::vector<uint64_t>& v, double p) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    size_t i = std::min(v.size() - 1, static_cast<size_t>(p * (v.size() - 1) + 0.5));
+    return v[i] / 1e6;
+}
+
+/* horizontal ascii bar, scaled to the column maximum --------------------- */
+static std::string bar(double v, double max, int width = 40) {
+    int n = max > 0 ? static_cast<int>(v / max * width + 0.5) : 0;
+    return std::string(std::max(0, n), '#');
+}
+
+/* ======================================================================= */
+/*  scale: throughput / conn rate / p99 handshake vs worker count           */
+/* ======================================================================= */
+/* ask the server for a stats line and pull one field out of it ----------- */
+static std::string server_stat(server_proc& sp, const std::string& key) {
+    std::unique_lock<std::mutex> lk(sp.mu);
+    uint64_t seq = sp.stats_seq;
+    kill(sp.pid, SIGUSR1);
+    sp.cv.wait_for(lk, std::chrono::seconds(2), [&] { return sp.stats_seq != seq; });
+    size_t at = sp.stats.find(' ' + key + '=');
+    if (at == std::string::npos) return std::string();
+    at += key.size() + 2;
+    return sp.stats.substr(at, sp.stats.find(' ', at) - at);
+}
+
+struct scale_row {
+    int    workers  = 0;
+    int    clients  = 0;
+    double mbps     = 0;       // MB/s of file data, all clients
+    double cps      = 0;       // completed connections per second
+    double p50_ms   = 0;
+    double p99_ms   = 0;
+    double local    = -1;      // share of connections served on their rx cpu, -1 = unknown
+    uint64_t errors = 0;
+};
+
+static int cmd_scale(const opts& o) {
+    std::string exe  = o.str("server", "./server");
+    std::string file = o.str("file", "");
+    bool generated   = file.empty();
+    if (generated) file = make_payload_file(o.num("size", 262144));
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_w = static_cast<int>(o.num("max-workers", ncpu > 0 ? ncpu : 1));
+    int per_w = static_cast<int>(o.num("clients-per-worker", 4));
+    int secs  = static_cast<int>(o.num("seconds", 5));
+    int port  = static_cast<int>(o.num("port", 6100));
+
+    std::vector<int> steps;
+    for (int w = 1; w < max_w; w *= 2) steps.push_back(w);
+    steps.push_back(max_w);
+
+    std::vector<scale_row> rows;
+    for (int w : steps) {
+        server_proc sp;
+        std::vector<std::string> args = { exe, "bench", file, std::to_string(port),
+                                          "--workers", std::to_string(w),
+                                          "--backlog", "1024", "--quiet" };
+        if (o.has("steer")) { args.push_back("--steer"); args.push_back(o.str("steer", "")); }
+        if (!spawn_server(sp, args, w)) {
+            std::cerr << "error: server did not come up on port " << port << '\n';
+            stop_server(sp);
+            return 1;
+        }
+        sockaddr_in srv{};
+        srv.sin_family      = AF_INET;
+        srv.sin_port        = htons(static_cast<uint16_t>(port));
+        srv.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        scale_row row;
+        row.workers = w;
+        row.clients = w * per_w;
+
+        std::atomic<uint64_t> bytes(0), conns(0), errors(0);
+        std::mutex lat_mu;
+        std::vector<uint64_t> lat;
+        uint64_t t_end = now_ns() + static_cast<uint64_t>(secs) * 1000000000ull;
+
+        std::vector<std::thread> cl;
+        for (int c = 0; c < row.clients; ++c) {
+            cl.emplace_back([&, c] {
+                std::vector<uint64_t> mine;
+                std::string name = "bench-" + std::to_string(c);
+                while (now_ns() < t_end) {
+                    fetch_result r = fetch_once(srv, name, "Query file name");
+                    if (!r.ok) { ++errors; continue; }
+                    bytes += r.bytes;
+                    ++conns;
+                    mine.push_back(r.handshake_ns);
+                }
+                std::lock_guard<std::mutex> lk(lat_mu);
+                lat.insert(lat.end(), mine.begin(), mine.end());
+            });
+        }
+        uint64_t t0 = now_ns();
+        for (auto& t : cl) t.join();
+        double elapsed = (now_ns() - t0) / 1e9;
+        std::string loc = server_stat(sp, "cpu_local");        // "local/total"
+        stop_server(sp);
+        size_t slash = loc.find('/');
+        if (slash != std::string::npos) {
+            double l = std::atof(loc.c_str()), t = std::atof(loc.c_str() + slash + 1);
+            if (t > 0) row.local = l / t;
+        }
+
+        row.mbps   = bytes / elapsed / 1e6;
+        row.cps    = conns / elapsed;
+        row.p50_ms = pct_ms(lat, 0.50);
+        row.p99_ms = pct_ms(lat, 0.99);
+        row.errors = errors;
+        rows.push_back(row);
+        std::cout << "[bench] workers=" << w << " clients=" << row.clients
+                  << "  " << std::fixed << std::setprecision(2) << row.mbps << " MB/s  "
+                  << row.cps << " conn/s  p99=" << row.p99_ms << " ms\n";
+        ++port;
+    }
+    if (generated) unlink(file.c_str());
+
+    /* table + plots ------------------------------------------------------ */
+    double max_mbps = 0, max_cps = 0, max_p99 = 0;
+    for (auto& r : rows) {
+        max_mbps = std::max(max_mbps, r.mbps);
+        max_cps  = std::max(max_cps, r.cps);
+        max_p99  = std::max(max_p99, r.p99_ms);
+    }
+    std::cout << "\nworkers clients      MB/s    conn/s   p50 ms   p99 ms  scaling  errors  rx-cpu\n";
+    for (auto& r : rows) {
+        double eff = rows[0].mbps > 0 ? r.mbps / (rows[0].mbps * r.workers) : 0;
+        std::cout << std::setw(7) << r.workers << std::setw(8) << r.clients
+                  << std::setw(10) << std::setprecision(2) << r.mbps
+                  << std::setw(10) << std::setprecision(1) << r.cps
+                  << std::setw(9) << std::setprecision(3) << r.p50_ms
+                  << std::setw(9) << r.p99_ms
+                  << std::setw(8) << std::setprecision(0) << eff * 100 << '%'
+                  << std::setw(8) << r.errors;
+        if (r.local >= 0) std::cout << std::setw(7) << r.local * 100 << "%\n";
+        else              std::cout << "       -\n";
+    }
+    struct { const char* title; double scale_row::*field; double max; } plots[] = {
+        { "throughput (MB/s)",    &scale_row::mbps,   max_mbps },
+        { "connections/sec",      &scale_row::cps,    max_cps  },
+        { "p99 handshake (ms)",   &scale_row::p99_ms, max_p99  },
+    };
+    for (auto& p : plots) {
+        std::cout << '\n' << p.title << '\n';
+        for (auto& r : rows)
+            std::cout << std::setw(4) << r.workers << " | " << bar(r.*p.field, p.max)
+                      << ' ' << std::setprecision(2) << r.*p.field << '\n';
+    }
+
+    if (o.has("csv")) {
+        std::ofstream csv(o.str("csv", ""));
+        csv << "workers,clients,mb_per_s,conn_per_s,p50_ms,p99_ms,errors,rx_cpu_local\n";
+        for (auto& r : rows)
+            csv << r.workers << ',' << r.clients << ',' << r.mbps << ',' << r.cps << ','
+                << r.p50_ms << ',' << r.p99_ms << ',' << r.errors << ',' << r.local << '\n';
+    }
+    return 0;
+}
+
+/* ======================================================================= */
+/*  soak: long mixed run with drift checks on rss, fds, heap and latency    */
+/* ======================================================================= */
+struct soak_sample {
+    double   t_s       = 0;
+    uint64_t rss_kb    = 0;
+    uint64_t fds       = 0;
+    uint64_t heap_used = 0;
+    double   p50_ms    = 0;
+    double   p99_ms    = 0;
+    uint64_t conns     = 0;
+};
+
+static uint64_t proc_rss_kb(pid_t pid) {
+    std::ifstream st("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(st, line))
+        if (line.compare(0, 6, "VmRSS:") == 0) return std::strtoull(line.c_str() + 6, nullptr, 10);
+    return 0;
+}
+
+static uint64_t proc_fd_count(pid_t pid) {
+    DIR* d = opendir(("/proc/" + std::to_string(pid) + "/fd").c_str());
+    if (!d) return 0;
+    uint64_t n = 0;
+    while (dirent* e = readdir(d))
+        if (e->d_name[0] != '.') ++n;
+    closedir(d);
+    return n;
+}
+
+
+static int cmd_soak(const opts& o) {
+    std::string exe  = o.str("server", "./server");
+    std::string file = o.str("file", "");
+    bool generated   = file.empty();
+    if (generated) file = make_payload_file(o.num("size", 262144));
+
+    int secs      = static_cast<int>(o.num("seconds", 3600));
+    int every     = static_cast<int>(std::max(1LL, o.num("sample-every", 10)));
+    int warmup    = static_cast<int>(o.num("warmup", 30));
+    int nclients  = static_cast<int>(o.num("clients", 8));
+    int abort_pct = static_cast<int>(o.num("abort-pct", 20));
+    int port      = static_cast<int>(o.num("port", 6100));
+    uint64_t max_rss_kb  = o.num("max-rss-growth", 16384);
+    uint64_t max_fds     = o.num("max-fd-growth", 16);
+    uint64_t max_heap_kb = o.num("max-heap-growth", 16384);
+    double   max_p99     = std::atof(o.str("max-p99-ratio", "3.0").c_str());
+
+    server_proc sp;
+    std::vector<std::string> args = { exe, "soak", file, std::to_string(port),
+                                      "--workers", o.str("workers", "4"),
+                                      "--backlog", "1024", "--quiet" };
+    if (!spawn_server(sp, args, 0)) {
+        std::cerr << "error: server did not come up on port " << port << '\n';
+        stop_server(sp);
+        return 1;
+    }
+    sockaddr_in srv{};
+    srv.sin_family      = AF_INET;
+    srv.sin_port        = htons(static_cast<uint16_t>(port));
+    srv.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    /* client threads; latencies of completed downloads go to `window` -- */
+    std::atomic<bool>     stop(false);
+    std::atomic<uint64_t> conns(0), errors(0);
+    std::mutex            win_mu;
+    std::vector<uint64_t> window;
+    std::vector<std::thread> cl;
+    for (int c = 0; c < nclients; ++c) {
+        cl.emplace_back([&, c] {
+            std::string name = "soak-" + std::to_string(c);
+            uint32_t x = 0x9e3779b9u * (c + 1);
+            while (!stop) {
+                x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+                abort_at ab = abort_at::never;
+                if (static_cast<int>(x % 100) < abort_pct)
+                    ab = static_cast<abort_at>(1 + (x >> 8) % 3);
+                fetch_result r = fetch_once(srv, name, "Query file name", ab);
+                if (!r.ok) { ++errors; continue; }
+                ++conns;
+                if (ab == abort_at::never) {
+                    std::lock_guard<std::mutex> lk(win_mu);
+                    window.push_back(r.total_ns);
+                }
+            }
+        });
+    }
+
+    /* sampler ----------------------------------------------------------- */
+    std::cout << "    t(s)    rss KB   fds   heap KB   p50 ms   p99 ms    conns\n";
+    uint64_t t_start = now_ns();
+    bool have_base = false, failed = false;
+    soak_sample base;
+    std::string why;
+    for (int t = every; t <= secs && !failed; t += every) {
+        while (now_ns() < t_start + static_cast<uint64_t>(t) * 1000000000ull)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::vector<uint64_t> lat;
+        {
+            std::lock_guard<std::mutex> lk(win_mu);
+            lat.swap(window);
+        }
+        soak_sample s;
+        s.t_s       = t;
+        s.rss_kb    = proc_rss_kb(sp.pid);
+        s.fds       = proc_fd_count(sp.pid);
+        s.heap_used = std::strtoull(server_stat(sp, "heap_used").c_str(), nullptr, 10);
+        s.p50_ms    = pct_ms(lat, 0.50);
+        s.p99_ms    = pct_ms(lat, 0.99);
+        s.conns     = conns;
+        std::cout << std::setw(8) << t << std::setw(10) << s.rss_kb << std::setw(6) << s.fds
+                  << std::setw(10) << s.heap_used / 1024 << std::fixed << std::setprecision(3)
+                  << std::setw(9) << s.p50_ms << std::setw(9) << s.p99_ms
+                  << std::setw(9) << s.conns << '\n';
+        if (kill(sp.pid, 0) != 0) { failed = true; why = "server exited"; break; }
+        if (t < warmup) continue;
+        if (!have_base) { base = s; have_base = true; continue; }
+
+        std::ostringstream msg;
+        if (s.rss_kb > base.rss_kb + max_rss_kb)
+            msg << "rss grew " << base.rss_kb << " -> " << s.rss_kb << " KB; ";
+        if (s.fds > base.fds + max_fds)
+            msg << "open fds grew " << base.fds << " -> " << s.fds << "; ";
+        if (s.heap_used > base.heap_used + max_heap_kb * 1024)
+            msg << "heap in use grew " << base.heap_used / 1024 << " -> "
+                << s.heap_used / 1024 << " KB; ";
+        if (base.p99_ms > 0 && s.p99_ms > base.p99_ms * max_p99)
+            msg << "p99 drifted " << base.p99_ms << " -> " << s.p99_ms << " ms; ";
+        if (!msg.str().empty()) { failed = true; why = msg.str(); }
+    }
+
+    stop = true;
+    for (auto& th : cl) th.join();
+    stop_server(sp);
+    if (generated) unlink(file.c_str());
+
+    std::cout << "[bench] soak " << (failed ? "FAILED: " + why : std::string("passed"))
+              << "  conns=" << conns << " client errors=" << errors << '\n';
+    return failed ? 1 : 0;
+}
+
+/* ======================================================================= */
+/*  sol: our stack vs. a bare sendfile/splice transfer on the same box      */
+/* ======================================================================= */
+struct sol_row {
+    std::string mode;
+    double      mbps       = 0;
+    double      cpu_per_gb = 0;   // server + client cpu seconds per GB
+    double      srv_per_gb = 0;
+    double      cli_per_gb = 0;
+};
+
+static double tv_s(const timeval& tv) { return tv.tv_sec + tv.tv_usec / 1e6; }
+
+/* wait for a child and return its user+system cpu seconds ---------------- */
+static double wait_cpu(pid_t pid, bool& ok) {
+    rusage ru{};
+    int st = 0;
+    while (wait4(pid, &st, 0, &ru) < 0 && errno == EINTR) {}
+    ok = WIFEXITED(st) && WEXITSTATUS(st) == 0;
+    return tv_s(ru.ru_utime) + tv_s(ru.ru_stime);
+}
+
+/* cpu seconds a live process has used so far (/proc/<pid>/stat) ---------- */
+static double proc_cpu_s(pid_t pid) {
+    std::ifstream st("/proc/" + std::to_string(pid) + "/stat");
+    std::string all((std::istreambuf_iterator<char>(st)), std::istreambuf_iterator<char>());
+    size_t p = all.rfind(')');
+    if (p == std::string::npos) return 0;
+    std::istringstream in(all.substr(p + 2));
+    std::string f;
+    unsigned long long ut = 0, stime = 0;
+    for (int i = 3; i <= 15 && in >> f; ++i) {     // fields 14/15: utime/stime
+        if (i == 14) ut = std::strtoull(f.c_str(), nullptr, 10);
+        if (i == 15) stime = std::strtoull(f.c_str(), nullptr, 10);
+    }
+    return static_cast<double>(ut + stime) / sysconf(_SC_CLK_TCK);
+}
+
+/* reference sender: accept one connection, sendfile the whole file ------- */
+static int sol_sender(int lfd, const std::string& file) {
+    int cfd = accept(lfd, nullptr, nullptr);
+    int fd  = ::open(file.c_str(), O_RDONLY);
+    struct stat st{};
+    if (cfd < 0 || fd < 0 || fstat(fd, &st) < 0) return 1;
+    bool ok = sendfile_all(cfd, fd, 0, st.st_size);
+    ::close(fd);
+    ::close(cfd);
+    return ok ? 0 : 1;
+}
+
+/* reference receiver: socket → pipe → /dev/null, no user‑space copies ---- */
+static int sol_receiver(const sockaddr_in& srv, uint64_t size) {
+    int fd   = connect_to(srv);
+    int null = ::open("/dev/null", O_WRONLY);
+    if (fd < 0 || null < 0) return 1;
+    uint64_t got = 0;
+#if defined(__linux__)
+    int p[2];
+    if (pipe(p) < 0) return 1;
+    while (got < size) {
+        ssize_t n = splice(fd, nullptr, p[1], nullptr, 1 << 20, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += n;
+        while (n > 0) {
+            ssize_t m = splice(p[0], nullptr, null, nullptr, n, SPLICE_F_MOVE);
+            if (m < 0 && errno == EINTR) continue;
+            if (m <= 0) return 1;
+            n -= m;
+        }
+    }
+#else
+    std::vector<char> buf(1 << 20);
+    ssize_t n;
+    while (got < size && (n = ::recv(fd, buf.data(), buf.size(), 0)) > 0) got += n;
+#endif
+    ::close(fd);
+    return got == size ? 0 : 1;
+}
+
+static int cmd_sol(const opts& o) {
+    std::string exe  = o.str("server", "./server");
+    std::string cexe = o.str("client", "./client");
+    std::string file = o.str("file", "");
+    bool generated   = file.empty();
+    if (generated) file = make_payload_file(o.num("size", 33554432));
+    int reps = static_cast<int>(std::max(1LL, o.num("reps", 3)));
+    int port = static_cast<int>(o.num("port", 6100));
+
+    struct stat fst{};
+    if (stat(file.c_str(), &fst) < 0) die("stat");
+    double gb = fst.st_size / 1e9;
+
+    sockaddr_in srv{};
+    srv.sin_family      = AF_INET;
+    srv.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    std::vector<sol_row> rows;
+
+    /* the ceiling -------------------------------------------------------- */
+    {
+        int lfd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        srv.sin_port = htons(static_cast<uint16_t>(port));
+        if (bind(lfd, reinterpret_cast<sockaddr*>(&srv), sizeof(srv)) < 0) die("bind");
+        if (listen(lfd, 8) < 0) die("listen");
+
+        sol_row ref;
+        ref.mode = "sendfile->splice (ceiling)";
+        for (int r = 0; r < reps; ++r) {
+            pid_t s = fork();
+            if (s == 0) _exit(sol_sender(lfd, file));
+            uint64_t t0 = now_ns();
+            pid_t c = fork();
+            if (c == 0) _exit(sol_receiver(srv, fst.st_size));
+            bool ok_c = false, ok_s = false;
+            double cc = wait_cpu(c, ok_c), sc = wait_cpu(s, ok_s);
+            double secs = (now_ns() - t0) / 1e9;
+            if (!ok_c || !ok_s) { std::cerr << "error: reference transfer failed\n"; return 1; }
+            double mbps = fst.st_size / secs / 1e6;
+            if (mbps > ref.mbps) {
+                ref.mbps       = mbps;
+                ref.srv_per_gb = sc / gb;
+                ref.cli_per_gb = cc / gb;
+                ref.cpu_per_gb = (sc + cc) / gb;
+            }
+        }
+        ::close(lfd);
+        rows.push_back(ref);
+        ++port;
+    }
+
+    /* our server/client, every framing × io mode --------------------------- */
+    const char* ios[]      = { "copy", "sendfile" };
+    const char* framings[] = { "legacy", "v2" };
+    for (const char* io : ios) {
+        server_proc sp;
+        std::vector<std::string> args = { exe, "sol", file, std::to_string(port),
+                                          "--io", io, "--quiet" };
+        if (!spawn_server(sp, args, 0)) {
+            std::cerr << "error: server did not come up on port " << port << '\n';
+            stop_server(sp);
+            return 1;
+        }
+        for (const char* fr : framings) {
+            sol_row row;
+            row.mode = std::string(fr) + " / " + io;
+            for (int r = 0; r < reps; ++r) {
+                double s0 = proc_cpu_s(sp.pid);
+                uint64_t t0 = now_ns();
+                pid_t c = fork();
+                if (c == 0) {
+                    int null = ::open("/dev/null", O_WRONLY);
+                    dup2(null, STDOUT_FILENO);
+                    execl(cexe.c_str(), cexe.c_str(), "127.0.0.1", std::to_string(port).c_str(),
+                          "sol", "--framing", fr, "--out", "/dev/null", (char*)nullptr);
+                    _exit(127);
+                }
+                bool ok = false;
+                double cc   = wait_cpu(c, ok);
+                double secs = (now_ns() - t0) / 1e9;
+                double sc   = proc_cpu_s(sp.pid) - s0;
+                if (!ok) { std::cerr << "error: client failed in mode " << row.mode << '\n'; break; }
+                double mbps = fst.st_size / secs / 1e6;
+                if (mbps > row.mbps) {
+                    row.mbps       = mbps;
+                    row.srv_per_gb = sc / gb;
+                    row.cli_per_gb = cc / gb;
+                    row.cpu_per_gb = (sc + cc) / gb;
+                }
+            }
+            std::cout << "[bench] " << row.mode << ": " << std::fixed << std::setprecision(1)
+                      << row.mbps << " MB/s\n";
+            rows.push_back(row);
+        }
+        stop_server(sp);
+        ++port;
+    }
+    if (generated) unlink(file.c_str());
+
+    const sol_row& ref = rows[0];
+    std::cout << '\n' << std::left << std::setw(28) << "mode" << std::right
+              << "     MB/s  % ceiling  cpu s/GB (srv+cli)  % ceiling cpu\n";
+    for (auto& r : rows) {
+        std::cout << std::left << std::setw(28) << r.mode << std::right << std::fixed
+                  << std::setw(9) << std::setprecision(1) << r.mbps
+                  << std::setw(10) << (ref.mbps > 0 ? r.mbps / ref.mbps * 100 : 0) << '%'
+                  << std::setw(10) << std::setprecision(3) << r.cpu_per_gb
+                  << " (" << r.srv_per_gb << '+' << r.cli_per_gb << ')'
+                  << std::setw(9) << std::setprecision(0)
+                  << (ref.cpu_per_gb > 0 ? r.cpu_per_gb / ref.cpu_per_gb * 100 : 0) << "%\n";
+    }
+    return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+    std::cout.setf(std::ios::unitbuf);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " scale|soak|sol [options]\n";
+        return 1;
+    }
+    std::string cmd = argv[1];
+    opts o = parse_opts(argc, argv, 2);
+    if (cmd == "scale") return cmd_scale(o);
+    if (cmd == "soak")  return cmd_soak(o);
+    if (cmd == "sol")   return cmd_sol(o);
+    std::cerr << "error: unknown bench mode " << cmd << '\n';
+    return 1;
+}
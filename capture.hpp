@@ -0,0 +1,90 @@
+// capture.hpp – compact binary traffic capture (server --capture, ./replay)
+//
+// file  = 8‑byte magic, varint wall‑clock start (ns since epoch), records…
+// record = u8 flags, then varints: arrival (ns after capture start), size
+//          offered, bytes sent, observed read rate (bytes/s), and two
+//          varint‑length strings: client name, query
+//
+// records are appended when a connection ends, so they are not in arrival
+// order; readers sort them.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+static const char CAPTURE_MAGIC[8] = { 'H', 'S', 'C', 'A', 'P', '0', '0', '1' };
+
+enum : uint8_t {
+    CAP_V2      = 1,        // client asked for v2 framing
+    CAP_DROPPED = 2,        // connection ended before the termination pair
+};
+
+struct capture_rec {
+    uint8_t     flags      = 0;
+    uint64_t    arrival_ns = 0;
+    uint64_t    size       = 0;
+    uint64_t    sent       = 0;
+    uint64_t    read_bps   = 0;      // 0: unknown (never reached the body)
+    std::string client;
+    std::string query;
+};
+
+/* leb128 varints ---------------------------------------------------------- */
+static inline void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) { out += static_cast<char>((v & 0x7f) | 0x80); v >>= 7; }
+    out += static_cast<char>(v);
+}
+
+static inline bool get_varint(FILE* f, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = std::fgetc(f);
+        if (c == EOF) return false;
+        v |= static_cast<uint64_t>(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+static inline bool get_string(FILE* f, std::string& s) {
+    uint64_t n = 0;
+    if (!get_varint(f, n) || n > (1u << 20)) return false;
+    s.assign(n, '\0');
+    return n == 0 || std::fread(&s[0], 1, n, f) == n;
+}
+
+static inline void capture_header(std::string& out, uint64_t start_epoch_ns) {
+    out.append(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    put_varint(out, start_epoch_ns);
+}
+
+static inline void capture_encode(std::string& out, const capture_rec& r) {
+    out += static_cast<char>(r.flags);
+    put_varint(out, r.arrival_ns);
+    put_varint(out, r.size);
+    put_varint(out, r.sent);
+    put_varint(out, r.read_bps);
+    put_varint(out, r.client.size());
+    out += r.client;
+    put_varint(out, r.query.size());
+    out += r.query;
+}
+
+static inline bool capture_read_header(FILE* f, uint64_t& start_epoch_ns) {
+    char magic[sizeof(CAPTURE_MAGIC)];
+    return std::fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+           std::memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) == 0 &&
+           get_varint(f, start_epoch_ns);
+}
+
+static inline bool capture_read(FILE* f, capture_rec& r) {
+    int c = std::fgetc(f);
+    if (c == EOF) return false;
+    r.flags = static_cast<uint8_t>(c);
+    return get_varint(f, r.arrival_ns) && get_varint(f, r.size) &&
+           get_varint(f, r.sent) && get_varint(f, r.read_bps) &&
+           get_string(f, r.client) && get_string(f, r.query);
+}
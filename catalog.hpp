@@ -0,0 +1,711 @@
+// catalog.hpp – in‑memory index of a directory tree (server --root --index)
+//
+// catalog_walk() walks the tree on N threads. each thread owns a deque of
+// directories: it pops its own newest, and when that runs dry it steals the
+// oldest from another thread – so one deep subtree still spreads across
+// every thread. a directory is read with raw getdents64 into a 64 KiB
+// buffer (one syscall per ~1500 names, no readdir locking or per‑entry
+// malloc) and each file is stat'ed with statx relative to the open
+// directory fd, asking only for type, size, mtime and inode with
+// AT_STATX_DONT_SYNC – no path walk from the root and no attributes we do
+// not keep. d_type lets directories through without a statx at all.
+// threads collect entries locally and merge once at the end.
+//
+// live_catalog keeps the index current without rescans. a catalog is 256
+// hash shards behind shared_ptrs and is never changed once published:
+// a batch of changes copies only the shards it touches into a new catalog
+// and swaps the pointer (std::atomic_store), so lookups never wait for an
+// update and a reader keeps its snapshot for as long as it holds it.
+// changes come from fanotify (one filesystem mark covers the whole tree)
+// or, where fanotify is not permitted, an inotify watch per directory.
+// either way an event only names a path; the path is stat'ed again when
+// the batch is applied, which makes repeats and reorderings harmless. a
+// lost event queue (overflow) falls back to a full walk.
+//
+// next to the shards each version holds a compressed radix trie of the
+// same paths (labels on the edges, children sorted by first byte), shared
+// between versions the same way: an update copies the nodes on the way to
+// the changed leaf and nothing else. list(prefix) descends the prefix and
+// walks that subtree in sorted order, so a listing costs the size of its
+// answer, not the size of the catalog.
+
+#pragma once
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(__linux__)
+    #include <sys/fanotify.h>
+    #include <sys/inotify.h>
+    #include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+struct catalog_entry {
+    uint64_t size     = 0;
+    uint64_t mtime_ns = 0;
+    uint64_t ino      = 0;
+};
+
+struct catalog_stats {
+    uint64_t files = 0, dirs = 0, errors = 0;
+    uint64_t ns    = 0;
+};
+
+typedef std::vector<std::pair<std::string, catalog_entry>> catalog_files;
+
+namespace catalog_detail {
+
+struct work_queue {
+    std::mutex              mu;
+    std::deque<std::string> dirs;           // relative paths, "" = root
+};
+
+static inline bool stat_at(int dfd, const char* name, bool& is_dir, bool& is_reg, catalog_entry& e) {
+#if defined(__linux__) && defined(STATX_INO)
+    struct statx sx;
+    if (::statx(dfd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+                STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO, &sx) < 0)
+        return false;
+    is_dir     = S_ISDIR(sx.stx_mode);
+    is_reg     = S_ISREG(sx.stx_mode);
+    e.size     = sx.stx_size;
+    e.mtime_ns = uint64_t(sx.stx_mtime.tv_sec) * 1000000000ull + sx.stx_mtime.tv_nsec;
+    e.ino      = sx.stx_ino;
+#else
+    struct stat st;
+    if (::fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) return false;
+    is_dir     = S_ISDIR(st.st_mode);
+    is_reg     = S_ISREG(st.st_mode);
+    e.size     = static_cast<uint64_t>(st.st_size);
+    e.mtime_ns = uint64_t(st.st_mtime) * 1000000000ull;
+    e.ino      = st.st_ino;
+#endif
+    return true;
+}
+
+struct walker {
+    std::string                              root;
+    std::function<void(const std::string&)>  on_dir;    // before a directory is read
+    std::vector<std::unique_ptr<work_queue>> queues;
+    std::atomic<uint64_t>                    pending{0}; // queued + being read
+    std::atomic<uint64_t>                    files{0}, dirs{0}, errors{0};
+    std::string                              start;
+    std::atomic<bool>                        start_ok{false};
+
+    void push(size_t self, std::string rel) {
+        ++pending;
+        std::lock_guard<std::mutex> lk(queues[self]->mu);
+        queues[self]->dirs.push_back(std::move(rel));
+    }
+
+    /* own newest first, then steal someone else's oldest ---------------- */
+    bool pop(size_t self, std::string& out) {
+        {
+            std::lock_guard<std::mutex> lk(queues[self]->mu);
+            if (!queues[self]->dirs.empty()) {
+                out = std::move(queues[self]->dirs.back());
+                queues[self]->dirs.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); ++k) {
+            work_queue& q = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lk(q.mu);
+            if (!q.dirs.empty()) {
+                out = std::move(q.dirs.front());
+                q.dirs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* one name in directory `rel` (open as dfd) ------------------------- */
+    void entry(size_t self, int dfd, const std::string& rel, const char* name, unsigned char type,
+               catalog_files& out) {
+        if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) return;
+        std::string path = rel.empty() ? std::string(name) : rel + '/' + name;
+        if (type == DT_DIR) { push(self, path); return; }
+        if (type != DT_REG && type != DT_UNKNOWN) return;      // links, fifos, …
+        bool          is_dir = false, is_reg = false;
+        catalog_entry e;
+        if (!stat_at(dfd, name, is_dir, is_reg, e)) { ++errors; return; }
+        if (is_dir)      push(self, path);
+        else if (is_reg) { out.emplace_back(std::move(path), e); ++files; }
+    }
+
+    void read_dir(size_t self, const std::string& rel, catalog_files& out, std::vector<std::string>& dirs_out) {
+        if (on_dir) on_dir(rel);
+        std::string abs = rel.empty() ? root : root + '/' + rel;
+        int dfd = ::open(abs.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | (rel.empty() ? 0 : O_NOFOLLOW));
+        if (dfd < 0) { ++errors; return; }
+        ++dirs;
+        dirs_out.push_back(rel);
+        if (rel == start) start_ok = true;
+#if defined(__linux__) && defined(SYS_getdents64)
+        struct linux_dirent64 {
+            uint64_t       d_ino;
+            int64_t        d_off;
+            unsigned short d_reclen;
+            unsigned char  d_type;
+            char           d_name[1];
+        };
+        alignas(8) char buf[65536];
+        while (true) {
+            long n = ::syscall(SYS_getdents64, dfd, buf, sizeof(buf));
+            if (n < 0) { ++errors; break; }
+            if (n == 0) break;
+            for (long at = 0; at < n;) {
+                const linux_dirent64* d = reinterpret_cast<const linux_dirent64*>(buf + at);
+                entry(self, dfd, rel, d->d_name, d->d_type, out);
+                at += d->d_reclen;
+            }
+        }
+        ::close(dfd);
+#else
+        DIR* dp = ::fdopendir(dfd);
+        if (!dp) { ::close(dfd); ++errors; return; }
+        while (dirent* d = ::readdir(dp)) entry(self, dfd, rel, d->d_name, d->d_type, out);
+        ::closedir(dp);
+#endif
+    }
+
+    void run(size_t self, catalog_files& out, std::vector<std::string>& dirs_out) {
+        std::string rel;
+        while (pending.load()) {
+            if (!pop(self, rel)) { std::this_thread::yield(); continue; }
+            read_dir(self, rel, out, dirs_out);
+            --pending;                  // children were counted before we got here
+        }
+    }
+};
+
+} // namespace catalog_detail
+
+/* every file under root/start ("" = all of root) on `threads` threads;
+   false if start itself cannot be read                                  */
+static inline bool catalog_walk(const std::string& root, const std::string& start, unsigned threads,
+                                const std::function<void(const std::string&)>& on_dir, catalog_stats& st,
+                                catalog_files& files, std::vector<std::string>& dirs) {
+    catalog_detail::walker w;
+    w.root   = root;
+    w.on_dir = on_dir;
+    w.start  = start;
+    threads  = threads ? threads : 1;
+    for (unsigned i = 0; i < threads; ++i) w.queues.emplace_back(new catalog_detail::work_queue);
+    w.push(0, start);
+
+    std::vector<catalog_files>            found(threads);
+    std::vector<std::vector<std::string>> found_dirs(threads);
+    std::vector<std::thread>              pool;
+    for (unsigned i = 1; i < threads; ++i)
+        pool.emplace_back([&w, &found, &found_dirs, i] { w.run(i, found[i], found_dirs[i]); });
+    w.run(0, found[0], found_dirs[0]);
+    for (auto& t : pool) t.join();
+
+    for (unsigned i = 0; i < threads; ++i) {
+        files.insert(files.end(), std::make_move_iterator(found[i].begin()), std::make_move_iterator(found[i].end()));
+        dirs.insert(dirs.end(), std::make_move_iterator(found_dirs[i].begin()),
+                    std::make_move_iterator(found_dirs[i].end()));
+    }
+    st.files += w.files;
+    st.dirs += w.dirs;
+    st.errors += w.errors;
+    return w.start_ok;
+}
+
+/* radix trie node; a writer may change only nodes carrying its gen ------ */
+struct catalog_trie_node {
+    typedef std::pair<std::string, std::shared_ptr<const catalog_trie_node>> edge;
+
+    bool              leaf = false;
+    catalog_entry     e;
+    std::vector<edge> kids;         // sorted, first bytes distinct
+    uint64_t          gen  = 0;
+
+    /* the edge starting with byte c, or where it would go */
+    template <class V>
+    static auto slot(V& kids, char c) -> decltype(kids.begin()) {
+        return std::lower_bound(kids.begin(), kids.end(), c, [](const edge& k, char b) {
+            return static_cast<unsigned char>(k.first[0]) < static_cast<unsigned char>(b);
+        });
+    }
+};
+
+static inline uint64_t catalog_next_gen() {
+    static std::atomic<uint64_t> gen{0};
+    return ++gen;
+}
+
+/* one published version: read‑only, shared by every reader holding it ---- */
+class catalog {
+public:
+    typedef std::unordered_map<std::string, catalog_entry> shard;
+    typedef catalog_trie_node                              node;
+    static const size_t SHARDS = 256;
+
+    catalog() : shards_(SHARDS, std::make_shared<const shard>()), trie_(std::make_shared<const node>()) {}
+
+    /* a whole walk at once: the trie is built bottom‑up from sorted paths */
+    explicit catalog(catalog_files files) : shards_(SHARDS) {
+        std::sort(files.begin(), files.end(),
+                  [](const catalog_files::value_type& a, const catalog_files::value_type& b) { return a.first < b.first; });
+        files.erase(std::unique(files.begin(), files.end(),
+                                [](const catalog_files::value_type& a, const catalog_files::value_type& b) {
+                                    return a.first == b.first;
+                                }),
+                    files.end());
+        trie_ = build(files, 0, files.size(), 0);
+        std::vector<shard> parts(SHARDS);
+        for (auto& kv : files) parts[shard_of(kv.first)].emplace(std::move(kv.first), kv.second);
+        for (size_t i = 0; i < SHARDS; ++i) {
+            size_ += parts[i].size();
+            shards_[i] = std::make_shared<const shard>(std::move(parts[i]));
+        }
+    }
+
+    const catalog_entry* find(const std::string& path) const {
+        const shard& s  = *shards_[shard_of(path)];
+        auto         it = s.find(path);
+        return it == s.end() ? nullptr : &it->second;
+    }
+    size_t size() const { return size_; }
+
+    /* each(path, entry) for every path starting with prefix, sorted ---- */
+    template <class F>
+    void list(const std::string& prefix, F each) const {
+        const node* n = trie_.get();
+        std::string path;
+        for (size_t at = 0; at < prefix.size();) {
+            auto k = node::slot(n->kids, prefix[at]);
+            if (k == n->kids.end() || k->first[0] != prefix[at]) return;
+            size_t m = std::min(k->first.size(), prefix.size() - at);
+            if (k->first.compare(0, m, prefix, at, m) != 0) return;
+            path += k->first;
+            n = k->second.get();
+            at += m;
+        }
+        walk(n, path, each);
+    }
+
+    static size_t shard_of(const std::string& path) { return std::hash<std::string>()(path) & (SHARDS - 1); }
+
+private:
+    friend class catalog_writer;
+
+    template <class F>
+    static void walk(const node* n, std::string& path, F& each) {
+        if (n->leaf) each(path, n->e);
+        for (auto& k : n->kids) {
+            size_t len = path.size();
+            path += k.first;
+            walk(k.second.get(), path, each);
+            path.resize(len);
+        }
+    }
+
+    /* [lo, hi) share their first `depth` bytes --------------------------- */
+    static std::shared_ptr<const node> build(const catalog_files& f, size_t lo, size_t hi, size_t depth) {
+        std::shared_ptr<node> n = std::make_shared<node>();
+        if (lo < hi && f[lo].first.size() == depth) { n->leaf = true; n->e = f[lo].second; ++lo; }
+        while (lo < hi) {
+            char   c  = f[lo].first[depth];
+            size_t hj = lo + 1;
+            while (hj < hi && f[hj].first[depth] == c) ++hj;
+            const std::string& a = f[lo].first;
+            const std::string& b = f[hj - 1].first;
+            size_t             l = depth + 1;
+            while (l < a.size() && l < b.size() && a[l] == b[l]) ++l;
+            n->kids.emplace_back(a.substr(depth, l - depth), build(f, lo, hj, l));
+            lo = hj;
+        }
+        return n;
+    }
+
+    std::vector<std::shared_ptr<const shard>> shards_;
+    std::shared_ptr<const node>               trie_;
+    size_t                                    size_ = 0;
+};
+
+/* the next version: shares every shard and trie node it has not had to
+   change                                                                  */
+class catalog_writer {
+public:
+    typedef catalog_trie_node node;
+
+    explicit catalog_writer(const catalog& base)
+        : next_(std::make_shared<catalog>(base)), own_(catalog::SHARDS, nullptr), gen_(catalog_next_gen()) {}
+
+    void put(const std::string& path, const catalog_entry& e) {
+        size_t i  = catalog::shard_of(path);
+        auto   it = next_->shards_[i]->find(path);
+        if (it != next_->shards_[i]->end() && it->second.size == e.size && it->second.mtime_ns == e.mtime_ns &&
+            it->second.ino == e.ino)
+            return;
+        auto r = mut(i).emplace(path, e);
+        if (r.second) ++next_->size_;
+        else          r.first->second = e;
+        trie_put(path, e);
+        changed_ = true;
+    }
+    void erase(const std::string& path) {
+        size_t i = catalog::shard_of(path);
+        if (!next_->shards_[i]->count(path)) return;
+        mut(i).erase(path);
+        --next_->size_;
+        trie_erase(next_->trie_, path, 0);
+        changed_ = true;
+    }
+    /* everything under dir/ – a directory went away ------------------- */
+    void erase_under(const std::string& dir) {
+        std::vector<std::string> gone;
+        next_->list(dir + '/', [&gone](const std::string& p, const catalog_entry&) { gone.push_back(p); });
+        for (const std::string& p : gone) erase(p);
+    }
+
+    bool                           changed() const { return changed_; }
+    std::shared_ptr<const catalog> done() { return next_; }
+
+private:
+    /* a node this writer may change: the one in slot, or a copy of it */
+    node* own(std::shared_ptr<const node>& slot) {
+        if (slot->gen != gen_) {
+            std::shared_ptr<node> copy = std::make_shared<node>(*slot);
+            copy->gen = gen_;
+            slot      = copy;
+        }
+        return const_cast<node*>(slot.get());       // created non‑const, by us
+    }
+
+    void trie_put(const std::string& key, const catalog_entry& e) {
+        node* n = own(next_->trie_);
+        for (size_t at = 0;;) {
+            if (at == key.size()) { n->leaf = true; n->e = e; return; }
+            auto k = node::slot(n->kids, key[at]);
+            if (k == n->kids.end() || k->first[0] != key[at]) {
+                std::shared_ptr<node> leaf = std::make_shared<node>();
+                leaf->leaf = true;
+                leaf->e    = e;
+                leaf->gen  = gen_;
+                n->kids.emplace(k, key.substr(at), leaf);
+                return;
+            }
+            size_t m = 1;
+            while (m < k->first.size() && at + m < key.size() && k->first[m] == key[at + m]) ++m;
+            if (m < k->first.size()) {              // split the edge after m bytes
+                std::shared_ptr<node> mid = std::make_shared<node>();
+                mid->gen = gen_;
+                mid->kids.emplace_back(k->first.substr(m), k->second);
+                k->first.resize(m);
+                k->second = mid;
+            }
+            n = own(k->second);
+            at += m;
+        }
+    }
+
+    /* key is known to be present; empty nodes go, single‑child ones merge */
+    void trie_erase(std::shared_ptr<const node>& slot, const std::string& key, size_t at) {
+        node* n = own(slot);
+        if (at == key.size()) { n->leaf = false; return; }
+        auto k = node::slot(n->kids, key[at]);
+        trie_erase(k->second, key, at + k->first.size());
+        const node* kid = k->second.get();
+        if (kid->leaf) return;
+        if (kid->kids.empty()) {
+            n->kids.erase(k);
+        } else if (kid->kids.size() == 1) {
+            node::edge only = kid->kids[0];
+            k->first += only.first;
+            k->second = only.second;                // kid goes with this
+        }
+    }
+
+    catalog::shard& mut(size_t i) {
+        if (!own_[i]) {
+            std::shared_ptr<catalog::shard> copy = std::make_shared<catalog::shard>(*next_->shards_[i]);
+            own_[i]             = copy.get();
+            next_->shards_[i]   = copy;
+        }
+        return *own_[i];
+    }
+
+    std::shared_ptr<catalog>     next_;
+    std::vector<catalog::shard*> own_;       // shards already copied
+    uint64_t                     gen_;
+    bool                         changed_ = false;
+};
+
+class live_catalog {
+public:
+    std::atomic<uint64_t> updates{0}, rescans{0}, unwatched{0};
+
+    live_catalog(const std::string& root, unsigned threads) : root_(root), threads_(threads ? threads : 1) {}
+    live_catalog(const live_catalog&) = delete;
+    live_catalog& operator=(const live_catalog&) = delete;
+
+    std::shared_ptr<const catalog> snapshot() const { return std::atomic_load(&cur_); }
+    unsigned                       threads() const { return threads_; }
+    const char*                    mode() const { return mode_; }
+
+    /* follow changes from now on: fanotify if allowed, else inotify. call
+       before the first rebuild() so nothing slips between walk and watch */
+    const char* watch(bool fanotify_ok) {
+#if defined(__linux__)
+        if (fanotify_ok && watch_fanotify()) mode_ = "fanotify";
+        else if ((ifd_ = ::inotify_init1(IN_CLOEXEC)) >= 0) mode_ = "inotify";
+        else return mode_;
+        std::thread(&live_catalog::follow, this).detach();
+#else
+        (void)fanotify_ok;
+#endif
+        return mode_;
+    }
+
+    /* full walk, published as one new version -------------------------- */
+    bool rebuild(catalog_stats& st) {
+        std::lock_guard<std::mutex> lk(wmu_);
+        return rebuild_locked(st);
+    }
+
+    /* a path this process just changed: publish it now instead of when the
+       watch reports it (or never, with no watch) ------------------------ */
+    void refresh(const std::string& rel) {
+        std::unordered_set<std::string> one;
+        one.insert(rel);
+        apply(one, false);
+    }
+
+private:
+    std::string abs_of(const std::string& rel) const { return rel.empty() ? root_ : root_ + '/' + rel; }
+
+    std::function<void(const std::string&)> dir_hook() {
+        if (ifd_ < 0) return std::function<void(const std::string&)>();
+        return [this](const std::string& rel) { add_watch(rel); };
+    }
+
+    bool rebuild_locked(catalog_stats& st) {
+        auto                     t0 = std::chrono::steady_clock::now();
+        catalog_files            files;
+        std::vector<std::string> dirs;
+        if (!catalog_walk(root_, "", threads_, dir_hook(), st, files, dirs)) return false;
+        dirs_ = std::unordered_set<std::string>(dirs.begin(), dirs.end());
+        std::atomic_store(&cur_, std::shared_ptr<const catalog>(std::make_shared<catalog>(std::move(files))));
+        st.ns = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+        return true;
+    }
+
+    /* one batch of changed paths → one new version ---------------------- */
+    void apply(const std::unordered_set<std::string>& dirty, bool rescan) {
+        std::lock_guard<std::mutex> lk(wmu_);
+        std::shared_ptr<const catalog> cur = std::atomic_load(&cur_);
+        if (!cur) return;                           // the first walk sees it all
+        if (rescan) {
+            catalog_stats st;
+            rebuild_locked(st);
+            ++rescans;
+            return;
+        }
+        catalog_writer w(*cur);
+        for (const std::string& rel : dirty) {
+            bool          is_dir = false, is_reg = false;
+            catalog_entry e;
+            bool          ok = catalog_detail::stat_at(AT_FDCWD, abs_of(rel).c_str(), is_dir, is_reg, e);
+            if (ok && is_reg) { w.put(rel, e); continue; }
+            w.erase(rel);
+            if (ok && is_dir) {
+                if (!dirs_.count(rel)) add_tree(w, rel);
+            } else if (dirs_.count(rel)) {
+                drop_tree(w, rel);
+            }
+        }
+        updates += dirty.size();
+        if (w.changed()) std::atomic_store(&cur_, w.done());
+    }
+
+    void add_tree(catalog_writer& w, const std::string& rel) {
+        catalog_stats            st;
+        catalog_files            files;
+        std::vector<std::string> dirs;
+        catalog_walk(root_, rel, threads_, dir_hook(), st, files, dirs);
+        for (auto& kv : files) w.put(kv.first, kv.second);
+        dirs_.insert(dirs.begin(), dirs.end());
+    }
+
+    void drop_tree(catalog_writer& w, const std::string& rel) {
+        std::string pre = rel + '/';
+        for (auto it = dirs_.begin(); it != dirs_.end();) {
+            if (*it == rel || it->compare(0, pre.size(), pre) == 0) it = dirs_.erase(it);
+            else ++it;
+        }
+        w.erase_under(rel);
+#if defined(__linux__)
+        if (ifd_ < 0) return;
+        std::lock_guard<std::mutex> lk(imu_);
+        for (auto it = wd_dir_.begin(); it != wd_dir_.end();) {
+            if (it->second == rel || it->second.compare(0, pre.size(), pre) == 0) {
+                ::inotify_rm_watch(ifd_, it->first);
+                it = wd_dir_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+#endif
+    }
+
+#if defined(__linux__)
+    /* inotify: a watch per directory, added just before it is read ------ */
+    void add_watch(const std::string& rel) {
+        int wd = ::inotify_add_watch(ifd_, abs_of(rel).c_str(),
+                                     IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |
+                                     IN_MODIFY | IN_ATTRIB | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK);
+        if (wd < 0) { ++unwatched; return; }    // e.g. max_user_watches: that subtree goes stale
+        std::lock_guard<std::mutex> lk(imu_);
+        wd_dir_[wd] = rel;                      // a moved directory keeps its wd
+    }
+
+    void decode_inotify(const char* buf, ssize_t n, std::unordered_set<std::string>& dirty, bool& rescan) {
+        std::lock_guard<std::mutex> lk(imu_);
+        for (const char* p = buf; p < buf + n;) {
+            const inotify_event* ev = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) { rescan = true; continue; }
+            auto w = wd_dir_.find(ev->wd);
+            if (w == wd_dir_.end()) continue;
+            if (ev->mask & IN_IGNORED) { wd_dir_.erase(w); continue; }
+            if (!ev->len) continue;
+            dirty.insert(w->second.empty() ? std::string(ev->name) : w->second + '/' + ev->name);
+        }
+    }
+
+    /* fanotify: one mark on the filesystem; events carry the parent
+       directory's file handle and the name, resolved to a path below
+       root (or ignored) once per directory and cached                   */
+    bool watch_fanotify() {
+        char real[PATH_MAX];
+        if (!::realpath(root_.c_str(), real)) return false;
+        root_abs_ = real;
+        ffd_ = ::fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC, O_RDONLY | O_LARGEFILE);
+        if (ffd_ < 0) return false;
+        root_fd_ = ::open(root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);   // O_PATH is no mount_fd
+        if (root_fd_ < 0 ||
+            ::fanotify_mark(ffd_, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                            FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_CLOSE_WRITE |
+                            FAN_MODIFY | FAN_ATTRIB | FAN_ONDIR,
+                            AT_FDCWD, root_.c_str()) < 0) {
+            ::close(ffd_);
+            if (root_fd_ >= 0) ::close(root_fd_);
+            ffd_ = root_fd_ = -1;
+            return false;
+        }
+        return true;
+    }
+
+    bool resolve(const file_handle* fh, std::string& rel) {
+        std::string key(reinterpret_cast<const char*>(fh), sizeof(file_handle) + fh->handle_bytes);
+        auto it = handle_dir_.find(key);
+        if (it == handle_dir_.end()) {
+            std::vector<char> copy(key.begin(), key.end());     // open_by_handle_at wants it writable
+            int fd = ::open_by_handle_at(root_fd_, reinterpret_cast<file_handle*>(copy.data()), O_PATH);
+            if (fd < 0) return false;                           // gone already
+            char    link[PATH_MAX];
+            ssize_t n = ::readlink(("/proc/self/fd/" + std::to_string(fd)).c_str(), link, sizeof(link));
+            ::close(fd);
+            if (n <= 0) return false;
+            std::string abs(link, static_cast<size_t>(n));
+            std::string pre = root_abs_ == "/" ? root_abs_ : root_abs_ + '/';
+            std::pair<bool, std::string> where(false, std::string());
+            if (abs == root_abs_)                            where.first = true;
+            else if (abs.compare(0, pre.size(), pre) == 0) { where.first = true; where.second = abs.substr(pre.size()); }
+            if (handle_dir_.size() >= 65536) handle_dir_.clear();
+            it = handle_dir_.emplace(key, where).first;
+        }
+        rel = it->second.second;
+        return it->second.first;
+    }
+
+    void decode_fanotify(const char* buf, ssize_t n, std::unordered_set<std::string>& dirty, bool& rescan) {
+        const fanotify_event_metadata* m = reinterpret_cast<const fanotify_event_metadata*>(buf);
+        for (; FAN_EVENT_OK(m, n); m = FAN_EVENT_NEXT(m, n)) {
+            if (m->vers != FANOTIFY_METADATA_VERSION) { rescan = true; break; }
+            if (m->mask & FAN_Q_OVERFLOW) { rescan = true; continue; }
+            const fanotify_event_info_fid* info = reinterpret_cast<const fanotify_event_info_fid*>(m + 1);
+            if (m->event_len < sizeof(*m) + sizeof(*info) || info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+                continue;
+            const file_handle* fh   = reinterpret_cast<const file_handle*>(info->handle);
+            const char*        name = reinterpret_cast<const char*>(fh->f_handle + fh->handle_bytes);
+            std::string        dir;
+            if (resolve(fh, dir) && std::strcmp(name, ".") != 0)
+                dirty.insert(dir.empty() ? std::string(name) : dir + '/' + name);
+            if ((m->mask & FAN_ONDIR) && (m->mask & (FAN_MOVED_FROM | FAN_MOVED_TO | FAN_DELETE)))
+                handle_dir_.clear();                            // paths below it moved
+        }
+    }
+
+    /* read events; apply once the tree has been quiet for 20 ms or the
+       oldest pending change is 200 ms old                               */
+    void follow() {
+        const int                       fd = ffd_ >= 0 ? ffd_ : ifd_;
+        std::unordered_set<std::string> dirty;
+        bool                            rescan = false;
+        auto                            first  = std::chrono::steady_clock::now();
+        alignas(8) char                 buf[65536];
+        while (true) {
+            bool    waiting = !dirty.empty() || rescan;
+            pollfd  p       = { fd, POLLIN, 0 };
+            int     r       = ::poll(&p, 1, waiting ? 20 : -1);
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0) return;
+            if (r > 0) {
+                ssize_t n = ::read(fd, buf, sizeof(buf));
+                if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+                if (n <= 0) return;
+                if (!waiting) first = std::chrono::steady_clock::now();
+                if (fd == ffd_) decode_fanotify(buf, n, dirty, rescan);
+                else            decode_inotify(buf, n, dirty, rescan);
+                if (std::chrono::steady_clock::now() - first < std::chrono::milliseconds(200)) continue;
+            }
+            if (dirty.empty() && !rescan) continue;
+            apply(dirty, rescan);
+            if (rescan) handle_dir_.clear();
+            dirty.clear();
+            rescan = false;
+        }
+    }
+#endif
+
+    std::string                     root_;
+    unsigned                        threads_;
+    const char*                     mode_ = "off";
+    std::shared_ptr<const catalog>  cur_;           // atomic_load / atomic_store only
+    std::mutex                      wmu_;           // writers: rebuild() and apply()
+    std::unordered_set<std::string> dirs_;          // every directory in cur_, "" = root
+    int                             ifd_ = -1, ffd_ = -1, root_fd_ = -1;
+    std::mutex                      imu_;           // wd_dir_: walker threads add, follow() reads
+    std::unordered_map<int, std::string> wd_dir_;
+    std::string                     root_abs_;      // realpath of root, for fanotify
+    std::unordered_map<std::string, std::pair<bool, std::string>> handle_dir_;  // → (under root, rel)
+};
@@ -1,10 +1,30 @@
 // client.cpp – tcp file receiver
-// usage: ./client <server host/ip> <port> "<client name>"
+// usage: ./client <server host/ip> <port> "<client name>" [options]
+//   --framing F    legacy (100‑byte chunks, default) or v2 (length‑prefixed frames)
+//   --out PATH     write the file to PATH instead of stdout
+//   --udp          use the reliable udp transport (rudp.hpp; server --udp)
+//   --mptcp        connect with multipath tcp, falling back to tcp
+//   --query Q      what to ask for (default "Query file name", the server's
+//                  file); e.g. "get KEY" for an object behind an s3 server
+//   --upload FILE  send FILE to the server instead (server --uploads): it
+//                  goes out with sendfile as v2 frames and replaces NAME
+//                  under the server's --root once all of it is there
+//   --as NAME      where the upload goes (default FILE's base name)
+//   --probe SPEC   link test: the server streams synthetic bytes, SPEC
+//                  of them (k/m/g suffix) or for SPEC seconds ("10s",
+//                  "500ms"), as v2 frames; prints goodput each second,
+//                  rtt samples and both ends' TCP_INFO
+//   --subscribe    stay connected after the transfer; each new version the
+//                  server pushes replaces the file (or, if it was only
+//                  appended to, is appended to it) until the server hangs up
 
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -14,93 +34,280 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <iomanip>
 #include <iostream>
 #include <string>
+#include <vector>
 
-<<<<<<< HEAD
-/* ---------------------------------------------------------------------------
-   portable 64‑bit byte‑order helpers
-   ---------------------------------------------------------------------------
-   – macos uses the OSSwap… routines in <libkern/OSByteOrder.h>
-   – most linux distros expose htobe64 / be64toh in <endian.h>
-   – as a last‑ditch fall‑back we build them by hand with htonl / ntohl
-   ------------------------------------------------------------------------- */
-=======
-
->>>>>>> 64302c1 (final)
-#if defined(__APPLE__)
-    #include <libkern/OSByteOrder.h>
-    static inline uint64_t host_to_be64(uint64_t x) { return OSSwapHostToBigInt64(x); }
-    static inline uint64_t be64_to_host(uint64_t x) { return OSSwapBigToHostInt64(x); }
-
-#elif defined(__linux__)
-    #include <endian.h>                 // glibc ≥2.9
-    static inline uint64_t host_to_be64(uint64_t x) { return htobe64(x); }
-    static inline uint64_t be64_to_host(uint64_t x) { return be64toh(x); }
-
-#else   // generic / unknown – fall back to the "manual" method
-    static inline uint64_t host_to_be64(uint64_t x) {
-    #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-        return (uint64_t)htonl(uint32_t(x >> 32)) |
-               ((uint64_t)htonl(uint32_t(x & 0xffffffff)) << 32);
-    #else
-        return x;
-    #endif
-    }
-    static inline uint64_t be64_to_host(uint64_t x) { return host_to_be64(x); }
-#endif
-<<<<<<< HEAD
-/* ------------------------------------------------------------------------ */
-=======
->>>>>>> 64302c1 (final)
+#include "rudp.hpp"
+#include "wire.hpp"
 
 static void die(const char* msg) { perror(msg); std::exit(1); }
 
-/* send_exact / recv_exact: keep pushing until the whole buffer moves */
-static void send_exact(int fd, const void* buf, size_t len) {
-    const uint8_t* p = static_cast<const uint8_t*>(buf);
-    while (len) {
-        ssize_t n = ::send(fd, p, len, 0);
-        if (n < 0) { if (errno == EINTR) continue; die("send"); }
-        p += n; len -= n;
+/* recv_exact: keep pulling until the whole buffer moves */
+static void recv_exact(int fd, void* buf, size_t len) {
+    if (recv_all(fd, buf, len)) return;
+    if (errno == 0) { std::cerr << "[client] server closed early\n"; std::exit(1); }
+    die("recv");
+}
+
+/* helpers for length‑prefixed strings ------------------------------------------------ */
+static std::string recv_string(int fd) {
+    std::string s;
+    if (!recv_str(fd, s)) {
+        if (errno == 0) { std::cerr << "[client] server closed early\n"; std::exit(1); }
+        die("recv");
     }
+    return s;
 }
 
-static void recv_exact(int fd, void* buf, size_t len) {
-    uint8_t* p = static_cast<uint8_t*>(buf);
-    while (len) {
-        ssize_t n = ::recv(fd, p, len, 0);
-        if (n == 0) { std::cerr << "[client] server closed early\n"; std::exit(1); }
-        if (n < 0) { if (errno == EINTR) continue; die("recv"); }
-        p += n; len -= n;
+static void send_string(int fd, const std::string& s) {
+    if (!send_str(fd, s)) die("send");
+}
+
+/* file bytes go to stdout by default, or to --out -------------------------- */
+static void write_out(int out_fd, const char* p, size_t n) {
+    if (out_fd < 0) { std::cout.write(p, n); return; }
+    while (n) {
+        ssize_t w = ::write(out_fd, p, n);
+        if (w < 0) { if (errno == EINTR) continue; die("write"); }
+        p += w; n -= w;
     }
 }
 
-/* helpers for length‑prefixed strings ------------------------------------------------ */
-static void send_str(int fd, const std::string& s) {
-    uint32_t n = htonl(static_cast<uint32_t>(s.size()));
-    send_exact(fd, &n, 4);
-    if (!s.empty()) send_exact(fd, s.data(), s.size());
+/* one body in the framing we asked for, up to the termination pair; each
+   piece goes to got(p, n) ------------------------------------------------ */
+template <class F>
+static void recv_frames(int fd, bool v2, uint64_t file_size, uint64_t recvd, F got) {
+    std::vector<char> buf(LEGACY_CHUNK);
+    while (true) {
+        char flag = 0; recv_exact(fd, &flag, 1);
+        if (flag == FLAG_END) {
+            char second = 0; recv_exact(fd, &second, 1);
+            return;
+        }
+        size_t want = 0;
+        if (flag == FLAG_LEGACY && !v2) {
+            want = std::min<uint64_t>(LEGACY_CHUNK, file_size - recvd);
+        } else if (flag == FLAG_V2 && v2) {
+            uint32_t len = 0; recv_exact(fd, &len, 4);
+            want = ntohl(len);
+            if (want > V2_MAX_FRAME || want > file_size - recvd) {
+                std::cerr << "[client] protocol error: bad frame length\n";
+                std::exit(1);
+            }
+            if (buf.size() < want) buf.resize(want);
+        } else {
+            std::cerr << "[client] protocol error\n";
+            std::exit(1);
+        }
+        recv_exact(fd, buf.data(), want);
+        got(buf.data(), want);
+        recvd += want;
+    }
 }
 
-static std::string recv_str(int fd) {
-    uint32_t n = 0; recv_exact(fd, &n, 4); n = ntohl(n);
-    std::string s(n, '\0');
-    if (n) recv_exact(fd, &s[0], n);
-    return s;
+static void recv_body(int fd, bool v2, int out_fd, uint64_t file_size, uint64_t recvd) {
+    recv_frames(fd, v2, file_size, recvd, [out_fd](const char* p, size_t n) { write_out(out_fd, p, n); });
+}
+
+/* --probe: count the bytes instead of keeping them, one line a second, then
+   the rtt samples and both ends' view of the connection ------------------ */
+static int probe(int fd, bool v2, uint64_t size, uint64_t connect_ns, uint64_t request_ns) {
+    uint64_t              t0 = now_ns(), tick = t0, at_tick = 0, got = 0;
+    std::vector<uint32_t> rtts;                 // receiver's rtt estimate (us), once a second
+    std::cout << std::fixed << std::setprecision(2);
+    recv_frames(fd, v2, size, 0, [&](const char*, size_t n) {
+        got += n;
+        uint64_t now = now_ns();
+        if (now - tick < 1000000000ull) return;
+        uint32_t rtt = tcp_rtt_us(fd, false);
+        if (rtt) rtts.push_back(rtt);
+        std::cout << "[client] probe  " << std::setw(6) << (now - t0) / 1e9 << " s  " << std::setw(9)
+                  << (got - at_tick) * 8 / ((now - tick) / 1e3) << " Mbit/s  rcv_rtt " << rtt / 1e3 << " ms\n";
+        tick    = now;
+        at_tick = got;
+    });
+    double      secs   = (now_ns() - t0) / 1e9;
+    std::string sender = recv_string(fd);
+    std::cout << "[client] probe done – " << got << " bytes in " << secs << " s: "
+              << (secs > 0 ? got * 8 / secs / 1e6 : 0.0) << " Mbit/s goodput\n"
+              << "[client] rtt    : connect " << connect_ns / 1e6 << " ms, request " << request_ns / 1e6 << " ms";
+    if (!rtts.empty()) {
+        uint64_t sum = 0;
+        for (uint32_t r : rtts) sum += r;
+        std::cout << ", rcv_rtt min/avg/max " << *std::min_element(rtts.begin(), rtts.end()) / 1e3 << '/'
+                  << sum / rtts.size() / 1e3 << '/' << *std::max_element(rtts.begin(), rtts.end()) / 1e3 << " ms ("
+                  << rtts.size() << " samples)";
+    }
+    std::cout << "\n[client] tcp (server): " << sender << "\n[client] tcp (client): " << tcp_info_line(fd, false) << '\n';
+    return 0;
+}
+
+/* --upload: FILE as v2 frames, then the server's verdict ------------------ */
+static int upload(int fd, int file_fd, uint64_t size) {
+    const uint64_t frame = 4u << 20;
+    uint64_t       t0    = now_ns();
+    for (uint64_t off = 0; off < size;) {
+        uint32_t n = static_cast<uint32_t>(std::min(frame, size - off));
+        char     hdr[5];
+        hdr[0] = FLAG_V2;
+        uint32_t len = htonl(n);
+        std::memcpy(hdr + 1, &len, 4);
+        if (!send_all(fd, hdr, 5, MSG_MORE) || !sendfile_all(fd, file_fd, off, n)) die("send");
+        off += n;
+    }
+    const char zeros[2] = { FLAG_END, FLAG_END };
+    if (!send_all(fd, zeros, 2)) die("send");
+    std::string verdict = recv_string(fd);
+    double      secs    = (now_ns() - t0) / 1e9;
+    if (verdict.compare(0, 7, "error: ") == 0) {
+        std::cerr << "[client] upload failed: " << verdict.substr(7) << '\n';
+        return 1;
+    }
+    std::cout << "[client] uploaded " << size << " bytes in " << std::fixed << std::setprecision(3) << secs
+              << " s (" << (secs > 0 ? size / secs / 1e6 : 0.0) << " MB/s): " << verdict << '\n';
+    return 0;
+}
+
+/* --subscribe: updates until the server hangs up (wire.hpp) -------------- */
+static void recv_updates(int fd, bool v2, int out_fd, uint64_t file_size) {
+    while (true) {
+        char flag = 0;
+        if (!recv_all(fd, &flag, 1)) {
+            if (errno) die("recv");
+            std::cout << "[client] server ended the subscription\n";
+            return;
+        }
+        char     kind = 0;
+        uint64_t from = 0, size = 0;
+        recv_exact(fd, &kind, 1);
+        recv_exact(fd, &from, 8);
+        recv_exact(fd, &size, 8);
+        from = be64_to_host(from);
+        size = be64_to_host(size);
+        if (flag != FLAG_UPDATE || (kind == UPDATE_FULL ? from != 0 : kind != UPDATE_APPEND || from != file_size) ||
+            size < from) {
+            std::cerr << "[client] protocol error: bad update\n";
+            std::exit(1);
+        }
+        if (kind == UPDATE_FULL && out_fd >= 0 && ::ftruncate(out_fd, 0) == 0)     // not for a pipe or device
+            ::lseek(out_fd, 0, SEEK_SET);
+        uint64_t t0 = now_ns();
+        recv_body(fd, v2, out_fd, size, from);
+        file_size = size;
+        if (out_fd < 0) std::cout << "\n";
+        std::cout << "[client] update : " << (kind == UPDATE_FULL ? "new version, " : "appended ")
+                  << size - from << " bytes (now " << size << ") in " << std::fixed << std::setprecision(3)
+                  << (now_ns() - t0) / 1e6 << " ms\n";
+    }
+}
+
+/* ---------------------------------------------------------------------------
+   --udp: same handshake over datagrams, then reassemble numbered DATA
+   packets and ack them (rudp.hpp). handshake packets are resent every
+   250 ms until the server answers; the body is acked after every batch.
+   ------------------------------------------------------------------------- */
+static void udp_send(int fd, const pkt_out& o) {
+    if (::send(fd, o.b.data(), o.b.size(), 0) < 0 && errno != ECONNREFUSED) die("send");
 }
 
-/* pretty‑print a peer (ip:port) ------------------------------------------------------ */
-static std::string peer_to_string(int fd) {
-    sockaddr_storage ss{};
-    socklen_t slen = sizeof(ss);
-    if (getpeername(fd, reinterpret_cast<sockaddr*>(&ss), &slen) < 0) return "?";
-    char host[NI_MAXHOST], serv[NI_MAXSERV];
-    if (getnameinfo(reinterpret_cast<sockaddr*>(&ss), slen,
-                    host, sizeof(host), serv, sizeof(serv),
-                    NI_NUMERICHOST | NI_NUMERICSERV) != 0)
-        return "?";
-    return std::string(host) + ":" + serv;
+static int udp_fetch(const sockaddr_in& srv, const std::string& name, const std::string& query,
+                     int out_fd) {
+    int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) die("socket");
+    int buf = 4 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&srv), sizeof(srv)) < 0) die("connect");
+    udp_enable_gro(fd);
+    std::cout << "[client] udp to " << peer_to_string(fd) << '\n';
+
+    uint32_t cid = static_cast<uint32_t>(now_ns() ^ (uint64_t(::getpid()) << 16));
+    pkt_out hello;
+    hello.u8(RUDP_HELLO);
+    hello.u32(cid);
+    hello.u16(RUDP_VERSION);
+    hello.str(name);
+    hello.str(query);
+    pkt_out start;
+    start.u8(RUDP_START);
+    start.u32(cid);
+    start.u64(RUDP_WINDOW);
+
+    std::unique_ptr<rudp_receiver> rcv;
+    udp_rx_batch rx(64, 65536);
+    uint64_t t0 = now_ns(), last_heard = t0, resend = 0, t_body = 0;
+    bool     fin_seen = false, fin = false;
+    while (!fin) {
+        uint64_t now = now_ns();
+        if (now - last_heard > RUDP_IDLE_NS) { std::cerr << "[client] udp: server went quiet\n"; std::exit(1); }
+        if (now >= resend && !t_body) {                         // handshake still in progress
+            udp_send(fd, rcv ? start : hello);
+            resend = now + 250000000ull;
+        }
+        pollfd pfd = { fd, POLLIN, 0 };
+        ::poll(&pfd, 1, 50);
+
+        int got;
+        while ((got = udp_recv_batch(fd, rx)) > 0) {
+            now = now_ns();
+            last_heard = now;
+            for (int i = 0; i < got; ++i)
+                for (size_t off = 0; off < rx.len[i]; off += rx.seg[i]) {
+                    pkt_in in(rx.at(i) + off, std::min(rx.seg[i], rx.len[i] - off));
+                    uint8_t type = in.u8();
+                    if (in.u32() != cid || !in.ok) continue;
+                    if (type == RUDP_META && !rcv) {
+                        std::string server_name = in.str();
+                        std::string file_name   = in.str();
+                        uint64_t    file_size   = in.u64();
+                        if (!in.ok) continue;
+                        if (file_name.compare(0, 7, "error: ") == 0) {
+                            std::cerr << "[client] server refused: " << file_name.substr(7) << '\n';
+                            std::exit(1);
+                        }
+                        std::cout << "[client] client : " << name        << '\n'
+                                  << "[client] server : " << server_name << '\n'
+                                  << "[client] file   : " << file_name
+                                  << " (" << file_size << " bytes)\n";
+                        rcv.reset(new rudp_receiver(file_size));
+                        udp_send(fd, start);
+                        resend = now + 250000000ull;
+                    } else if (type == RUDP_DATA && rcv) {
+                        uint64_t pn = in.u64(), at = in.u64();
+                        uint16_t len = in.u16();
+                        if (!in.ok || in.n < len) continue;
+                        if (!t_body) t_body = now;
+                        rcv->on_data(now, pn, at, in.p, len);
+                    } else if (type == RUDP_FIN && rcv) {
+                        fin_seen = true;
+                    }
+                }
+            if (static_cast<size_t>(got) < rx.size()) break;
+        }
+        if (rcv) {
+            rcv->drain([&](const char* p, size_t n) { write_out(out_fd, p, n); });
+            fin = fin_seen && rcv->complete();
+            if (rcv->ack_pending()) {
+                pkt_out ack;
+                rcv->build_ack(ack, cid, now_ns());
+                udp_send(fd, ack);
+            }
+        }
+    }
+    pkt_out done;
+    done.u8(RUDP_FIN_ACK);
+    done.u32(cid);
+    udp_send(fd, done);
+    ::close(fd);
+
+    double secs = (now_ns() - (t_body ? t_body : t0)) / 1e9;
+    if (out_fd < 0) std::cout << "\n";
+    std::cout << "[client] done – " << rcv->delivered() << " bytes in " << std::fixed
+              << std::setprecision(3) << secs << " s ("
+              << (secs > 0 ? rcv->delivered() / secs / 1e6 : 0.0) << " MB/s, "
+              << rcv->duplicates() << " duplicate packets)\n";
+    return 0;
 }
 
 /* ------------------------------------------------------------------------------------ */
@@ -109,15 +316,70 @@ int main(int argc, char* argv[]) {
     std::cout.setf(std::ios::unitbuf);
     std::cin.tie(nullptr);
 
-    if (argc != 4) {
-        std::cerr << "usage: " << argv[0] << " <host> <port> \"<client name>\"\n";
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0] << " <host> <port> \"<client name>\""
+                  << " [--framing legacy|v2] [--out PATH] [--udp] [--mptcp] [--query Q] [--subscribe]"
+                  << " [--upload FILE [--as NAME]] [--probe BYTES|SECONDSs]\n";
         return 1;
     }
     std::string host = argv[1];
     int         port = std::atoi(argv[2]);
     std::string name = argv[3];
+    bool        v2   = false;
+    bool        udp  = false;
+    bool        mptcp = false;
+    bool        subscribe = false;
+    std::string out_path, upload_path, upload_as, probe_spec;
+    std::string query = "Query file name";
+    for (int i = 4; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--framing" && i + 1 < argc) {
+            std::string f = argv[++i];
+            if (f == "v2")          v2 = true;
+            else if (f != "legacy") { std::cerr << "error: unknown framing " << f << '\n'; return 1; }
+        }
+        else if (a == "--out" && i + 1 < argc) out_path = argv[++i];
+        else if (a == "--udp")                 udp = true;
+        else if (a == "--mptcp")               mptcp = true;
+        else if (a == "--query" && i + 1 < argc) query = argv[++i];
+        else if (a == "--subscribe")           subscribe = true;
+        else if (a == "--upload" && i + 1 < argc) upload_path = argv[++i];
+        else if (a == "--as" && i + 1 < argc)  upload_as = argv[++i];
+        else if (a == "--probe" && i + 1 < argc) probe_spec = argv[++i];
+        else { std::cerr << "error: unknown option " << a << '\n'; return 1; }
+    }
 
     if (port <= 5000) { std::cerr << "error: port must be > 5000\n"; return 1; }
+    if (subscribe && udp) { std::cerr << "error: --subscribe needs tcp\n"; return 1; }
+    int      file_fd   = -1;
+    uint64_t file_size = 0;
+    if (!upload_path.empty()) {
+        if (udp || subscribe || !out_path.empty()) {
+            std::cerr << "error: --upload goes over tcp and takes no --subscribe or --out\n";
+            return 1;
+        }
+        struct stat st;
+        file_fd = ::open(upload_path.c_str(), O_RDONLY);
+        if (file_fd < 0 || ::fstat(file_fd, &st) < 0) die(upload_path.c_str());
+        file_size = static_cast<uint64_t>(st.st_size);
+        if (upload_as.empty()) upload_as = upload_path.substr(upload_path.rfind('/') + 1);
+        query = "put " + std::to_string(file_size) + ' ' + upload_as;
+        v2    = true;                   // uploads always use v2 frames
+    }
+    if (!probe_spec.empty()) {
+        if (udp || subscribe || !upload_path.empty()) {
+            std::cerr << "error: --probe goes over tcp and takes no --subscribe or --upload\n";
+            return 1;
+        }
+        query = "probe " + probe_spec;
+        v2    = true;                   // 100‑byte chunks would measure the framing, not the link
+    }
+
+    int out_fd = -1;
+    if (!out_path.empty()) {
+        out_fd = ::open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0) die("open");
+    }
 
     std::signal(SIGPIPE, SIG_IGN);      // ignore broken‑pipe
 
@@ -132,58 +394,83 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
-    if (fd < 0) die("socket");
-
     sockaddr_in srv{};
     srv.sin_family = AF_INET;
     srv.sin_port   = htons(static_cast<uint16_t>(port));
     srv.sin_addr   = reinterpret_cast<sockaddr_in*>(res->ai_addr)->sin_addr;
     freeaddrinfo(res);
 
+    if (udp) {
+        int rc = udp_fetch(srv, name, query, out_fd);
+        if (out_fd >= 0) ::close(out_fd);
+        return rc;
+    }
+
+    bool want_mptcp = mptcp;
+    int  fd = stream_socket(mptcp);
+    if (fd < 0) die("socket");
+    if (want_mptcp && !mptcp) std::cout << "[client] mptcp not available in this kernel; using tcp\n";
+
+    uint64_t t_connect = now_ns();
     if (connect(fd, reinterpret_cast<sockaddr*>(&srv), sizeof(srv)) < 0)
         die("connect");
+    t_connect = now_ns() - t_connect;
 
     std::cout << "[client] connected to " << peer_to_string(fd) << '\n';
 
     /* handshake 1 – identify ourselves ------------------------------------------- */
-    send_str(fd, name);
-    send_str(fd, "Query file name");
+    uint64_t t_request = now_ns();
+    send_string(fd, name);
+    send_string(fd, query);
 
     /* handshake 2 – receive server’s response ------------------------------------ */
-    std::string server_name = recv_str(fd);
-    std::string file_name   = recv_str(fd);
+    std::string server_name = recv_string(fd);
+    std::string file_name   = recv_string(fd);
     uint64_t netsize = 0; recv_exact(fd, &netsize, 8);
-    uint64_t file_size = be64_to_host(netsize);
+    file_size = be64_to_host(netsize);
+    t_request = now_ns() - t_request;
+    if (file_name.compare(0, 7, "error: ") == 0) {
+        std::cerr << "[client] server refused: " << file_name.substr(7) << '\n';
+        return 1;
+    }
 
     std::cout << "[client] client : " << name        << '\n'
               << "[client] server : " << server_name << '\n'
-              << "[client] file   : " << file_name
-              << " (" << file_size << " bytes)\n";
+              << "[client] file   : " << file_name;
+    if (file_size == UINT64_MAX) std::cout << " (until the server stops)\n";
+    else                         std::cout << " (" << file_size << " bytes)\n";
+    if (file_size == UINT64_MAX) v2 = true;     // legacy chunks can't end an open‑ended body
+
+    /* tell server we’re ready (and which framing we want) ------------------------- */
+    if (file_fd >= 0) {
+        send_string(fd, START_V2);
+        int rc = upload(fd, file_fd, file_size);
+        ::close(file_fd);
+        ::close(fd);
+        return rc;
+    }
+    if (!probe_spec.empty()) {
+        send_string(fd, START_V2);
+        int rc = probe(fd, v2, file_size, t_connect, t_request);
+        ::close(fd);
+        return rc;
+    }
+    if (subscribe) send_string(fd, v2 ? START_V2_SUB : START_LEGACY_SUB);
+    else           send_string(fd, v2 ? START_V2 : START_LEGACY);
 
-    /* tell server we’re ready ----------------------------------------------------- */
-    send_str(fd, "Start");
+    /* receive the file: legacy CHUNK‑sized pieces or v2 length‑prefixed frames ----- */
+    recv_body(fd, v2, out_fd, file_size, 0);
+    if (out_fd < 0) std::cout << "\n";
+    std::cout << "[client] done – got termination pair\n";
+    if (subscribe) recv_updates(fd, v2, out_fd, file_size);
 
-    /* receive the file in CHUNK‑sized pieces -------------------------------------- */
-    constexpr size_t CHUNK = 100;
-    uint64_t recvd = 0;
-    while (true) {
-        char flag = 0; recv_exact(fd, &flag, 1);
-        if (flag == '0') {
-            char second = 0; recv_exact(fd, &second, 1);
-            std::cout << "\n[client] done – got termination pair\n";
-            break;
-        }
-        if (flag != '1') {
-            std::cerr << "[client] protocol error\n";
-            std::exit(1);
-        }
-        size_t want = std::min<uint64_t>(CHUNK, file_size - recvd);
-        std::string buf(want, '\0'); recv_exact(fd, &buf[0], want);
-        std::cout << buf;
-        recvd += want;
+    if (mptcp) {
+        int sf = mptcp_subflows(fd);
+        if (sf > 0)       std::cout << "[client] mptcp: " << sf << " subflows\n";
+        else if (sf == 0) std::cout << "[client] mptcp: server fell back to tcp\n";
     }
 
+    if (out_fd >= 0) ::close(out_fd);
     ::close(fd);
     return 0;
 }
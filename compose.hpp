@@ -0,0 +1,110 @@
+// compose.hpp – virtual files stitched from slices of real ones
+// (server --compose MANIFEST)
+//
+// each manifest line appends one segment to a virtual file:
+//   NAME  SOURCE  OFFSET  LENGTH
+// segments go out in manifest order as if they were one file; LENGTH "-"
+// runs to the end of SOURCE. a relative SOURCE is taken from the
+// manifest's directory; '#' starts a comment. e.g.
+//   bundle.bin  header.bin        0     512
+//   bundle.bin  payload.bin       4096  -
+//   shards.dat  /data/shard-0     0     1048576
+//   shards.dat  /data/shard-1     0     1048576
+// every source is opened once at load and checked against its segments;
+// the server sends each segment's bytes straight from its source (one
+// sendfile per segment piece), so nothing is assembled on disk or in memory.
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fdcache.hpp"
+
+struct compose_segment {
+    std::shared_ptr<open_file> src;
+    uint64_t                   off = 0, len = 0;
+    uint64_t                   at  = 0;        // where it starts in the virtual file
+};
+
+struct composed_file {
+    std::vector<compose_segment> segs;
+    uint64_t                     size = 0;
+
+    /* f(fd, source offset, length) for each piece of [off, off + n) ----- */
+    template <class F>
+    bool each(uint64_t off, uint64_t n, F f) const {
+        auto s = std::upper_bound(segs.begin(), segs.end(), off,
+                                  [](uint64_t o, const compose_segment& g) { return o < g.at; });
+        if (s == segs.begin()) return n == 0;
+        for (--s; n && s != segs.end(); ++s) {
+            if (!s->len) continue;
+            uint64_t in   = off - s->at;
+            uint64_t take = std::min(n, s->len - in);
+            if (!f(s->src->fd, s->off + in, take)) return false;
+            off += take;
+            n -= take;
+        }
+        return n == 0;
+    }
+};
+
+typedef std::map<std::string, std::shared_ptr<const composed_file>> compose_table;
+
+static inline bool compose_load(const std::string& manifest, compose_table& out, std::string& err) {
+    std::ifstream in(manifest);
+    if (!in) { err = "cannot read " + manifest; return false; }
+    size_t      slash = manifest.rfind('/');
+    std::string base  = slash == std::string::npos ? std::string() : manifest.substr(0, slash + 1);
+
+    std::map<std::string, std::shared_ptr<open_file>> sources;
+    std::map<std::string, std::shared_ptr<composed_file>> files;
+    std::string line;
+    for (int lineno = 1; std::getline(in, line); ++lineno) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream ls(line);
+        std::string name, src, off_s, len_s, extra;
+        if (!(ls >> name)) continue;
+        std::string where = manifest + ':' + std::to_string(lineno) + ": ";
+        if (!(ls >> src >> off_s >> len_s) || (ls >> extra)) { err = where + "want NAME SOURCE OFFSET LENGTH"; return false; }
+        if (src[0] != '/') src = base + src;
+
+        std::shared_ptr<open_file>& f = sources[src];
+        if (!f) {
+            f     = std::make_shared<open_file>();
+            f->fd = ::open(src.c_str(), O_RDONLY | O_CLOEXEC);
+            if (f->fd < 0 || !file_identity("", f->fd, *f)) { err = where + "cannot open " + src; return false; }
+        }
+        char*    end = nullptr;
+        uint64_t off = std::strtoull(off_s.c_str(), &end, 10);
+        if (*end || off > f->size) { err = where + "offset " + off_s + " is not within " + src; return false; }
+        uint64_t len = f->size - off;
+        if (len_s != "-") {
+            len = std::strtoull(len_s.c_str(), &end, 10);
+            if (*end || len > f->size - off) { err = where + "length " + len_s + " runs past the end of " + src; return false; }
+        }
+        std::shared_ptr<composed_file>& v = files[name];
+        if (!v) v = std::make_shared<composed_file>();
+        compose_segment g;
+        g.src = f;
+        g.off = off;
+        g.len = len;
+        g.at  = v->size;
+        v->segs.push_back(g);
+        v->size += len;
+    }
+    for (auto& kv : files) out[kv.first] = kv.second;
+    return true;
+}
@@ -0,0 +1,56 @@
+// ctl.cpp – talks to a server --control socket
+// usage: ./ctl <socket path> <command…>
+//   e.g. ./ctl /tmp/hs.sock set rate 10m
+//        ./ctl /tmp/hs.sock stats
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "wire.hpp"
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <socket> stats | get | reindex | set <key> <value>\n";
+        return 1;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::string path = argv[1];
+    std::string line;
+    for (int i = 2; i < argc; ++i) {
+        if (i > 2) line += ' ';
+        line += argv[i];
+    }
+    line += '\n';
+
+    sockaddr_un sun{};
+    if (path.size() >= sizeof(sun.sun_path)) { std::cerr << "error: socket path too long\n"; return 1; }
+    sun.sun_family = AF_UNIX;
+    std::memcpy(sun.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&sun), sizeof(sun)) < 0) {
+        perror("connect");
+        return 1;
+    }
+    if (!send_all(fd, line.data(), line.size())) { perror("send"); return 1; }
+    shutdown(fd, SHUT_WR);                  // one command; the server closes after replying
+
+    std::string reply;
+    char buf[1024];
+    ssize_t n;
+    while ((n = ::recv(fd, buf, sizeof(buf), 0)) > 0) reply.append(buf, n);
+    ::close(fd);
+    std::cout << reply;
+    return reply.compare(0, 6, "error:") == 0 ? 1 : 0;
+}
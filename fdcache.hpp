@@ -0,0 +1,267 @@
+// fdcache.hpp – shared open descriptors for the multi‑file server (--root)
+//
+// acquire(path) hands out a shared_ptr<open_file>; every transfer of the
+// same file shares one descriptor for sendfile/pread, and the fd closes
+// when the cache has let go of it and the last transfer holding it ends.
+// the cache keeps at most `capacity` paths, evicting least recently used
+// ones (idle ones first).
+//
+// staleness: with an inotify watch on each directory that holds cached
+// files, a write, attribute change, rename, create or delete of a name
+// drops its entry, so a hit costs no syscall at all. where inotify is
+// unavailable (or a watch cannot be added) hits are revalidated with
+// statx – ino, size and mtime must still match. a per‑directory event
+// generation keeps an event that races an open from leaving a stale entry.
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(__linux__)
+    #include <sys/inotify.h>
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+/* an fd that closes when the last holder is done ------------------------- */
+struct open_file {
+    int      fd   = -1;
+    uint64_t size = 0;
+    uint64_t dev = 0, ino = 0, mtime_ns = 0;
+
+    open_file() = default;
+    open_file(const open_file&) = delete;
+    open_file& operator=(const open_file&) = delete;
+    ~open_file() { if (fd >= 0) ::close(fd); }
+};
+
+/* identity of a path right now; false if it is gone or not a file ------- */
+static inline bool file_identity(const char* path, int fd, open_file& id) {
+#if defined(__linux__) && defined(STATX_INO)
+    struct statx sx;
+    int rc = fd >= 0 ? ::statx(fd, "", AT_EMPTY_PATH, STATX_TYPE | STATX_INO | STATX_SIZE | STATX_MTIME, &sx)
+                     : ::statx(AT_FDCWD, path, 0, STATX_TYPE | STATX_INO | STATX_SIZE | STATX_MTIME, &sx);
+    if (rc < 0 || !S_ISREG(sx.stx_mode)) return false;
+    id.dev      = (uint64_t(sx.stx_dev_major) << 32) | sx.stx_dev_minor;
+    id.ino      = sx.stx_ino;
+    id.size     = sx.stx_size;
+    id.mtime_ns = uint64_t(sx.stx_mtime.tv_sec) * 1000000000ull + sx.stx_mtime.tv_nsec;
+#else
+    struct stat st;
+    if ((fd >= 0 ? ::fstat(fd, &st) : ::stat(path, &st)) < 0 || !S_ISREG(st.st_mode)) return false;
+    id.dev      = st.st_dev;
+    id.ino      = st.st_ino;
+    id.size     = static_cast<uint64_t>(st.st_size);
+    id.mtime_ns = uint64_t(st.st_mtime) * 1000000000ull;
+#endif
+    return true;
+}
+
+class fd_cache {
+public:
+    std::atomic<uint64_t> hits{0}, misses{0}, evictions{0}, invalidations{0};
+
+    explicit fd_cache(size_t capacity) : cap_(capacity) {}
+    fd_cache(const fd_cache&) = delete;
+    fd_cache& operator=(const fd_cache&) = delete;
+
+    /* inotify thread; false means hits fall back to statx checks -------- */
+    bool watch() {
+#if defined(__linux__)
+        ifd_ = ::inotify_init1(IN_CLOEXEC);
+        if (ifd_ < 0) return false;
+        std::thread(&fd_cache::watch_loop, this).detach();
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool watching() const { return ifd_ >= 0; }
+    size_t size() {
+        std::lock_guard<std::mutex> lk(mu_);
+        return map_.size();
+    }
+
+    /* shared descriptor for path, or nullptr with errno set ------------- */
+    std::shared_ptr<open_file> acquire(const std::string& path) {
+        std::string dir  = dir_of(path);
+        uint64_t    gen  = 0;
+        bool        live = false;                   // an inotify watch covers dir
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            auto it = map_.find(path);
+            if (it != map_.end()) {
+                std::shared_ptr<open_file> f = it->second.f;
+                open_file now;
+                if (it->second.watched ||           // unwatched hits are revalidated
+                    (file_identity(path.c_str(), -1, now) && now.ino == f->ino && now.dev == f->dev &&
+                     now.size == f->size && now.mtime_ns == f->mtime_ns)) {
+                    lru_.splice(lru_.begin(), lru_, it->second.lru);
+                    ++hits;
+                    return f;
+                }
+                drop(it);
+                ++invalidations;
+            }
+            if (cap_) live = add_watch(dir, gen);
+        }
+        ++misses;
+
+        std::shared_ptr<open_file> f = std::make_shared<open_file>();
+        f->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (f->fd < 0) { unwatch_if_unused(dir); return nullptr; }
+        if (!file_identity("", f->fd, *f)) { unwatch_if_unused(dir); errno = EISDIR; return nullptr; }
+        if (!cap_) return f;
+
+        std::lock_guard<std::mutex> lk(mu_);
+        auto d = dirs_.find(dir);
+        if (live && (d == dirs_.end() || d->second.gen != gen)) {  // changed while we opened it
+            if (d != dirs_.end() && d->second.users == 0) forget_dir(d);
+            return f;
+        }
+        if (map_.count(path)) return f;             // another worker got there first
+        while (map_.size() >= cap_) evict_one();
+        lru_.push_front(path);
+        entry& e  = map_[path];
+        e.f       = f;
+        e.lru     = lru_.begin();
+        e.watched = live;
+        e.dir     = dir;
+        if (live) ++dirs_[dir].users;
+        return f;
+    }
+
+private:
+    struct entry {
+        std::shared_ptr<open_file>       f;
+        std::list<std::string>::iterator lru;
+        bool                             watched = false;
+        std::string                      dir;
+    };
+    struct dir_watch {
+        int      wd    = -1;
+        uint64_t gen   = 0;                         // bumped on every event
+        size_t   users = 0;                         // watched entries under it
+    };
+
+    static std::string dir_of(const std::string& path) {
+        size_t slash = path.rfind('/');
+        return slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    }
+
+    void drop(std::unordered_map<std::string, entry>::iterator it) {
+        if (it->second.watched) {
+            auto d = dirs_.find(it->second.dir);
+            if (d != dirs_.end() && --d->second.users == 0) forget_dir(d);
+        }
+        lru_.erase(it->second.lru);
+        map_.erase(it);
+    }
+
+    /* oldest idle entry, or the oldest of all if every one is in use ---- */
+    void evict_one() {
+        auto victim = std::prev(lru_.end());
+        for (auto i = lru_.rbegin(); i != lru_.rend(); ++i)
+            if (map_[*i].f.use_count() == 1) { victim = std::prev(i.base()); break; }
+        drop(map_.find(*victim));
+        ++evictions;
+    }
+
+    bool add_watch(const std::string& dir, uint64_t& gen) {
+#if defined(__linux__)
+        if (ifd_ < 0) return false;
+        auto d = dirs_.find(dir);
+        if (d == dirs_.end()) {
+            int wd = ::inotify_add_watch(ifd_, dir.c_str(),
+                                         IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM |
+                                         IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_DELETE_SELF |
+                                         IN_MOVE_SELF | IN_ONLYDIR);
+            if (wd < 0) return false;               // e.g. out of watches: statx instead
+            d = dirs_.emplace(dir, dir_watch()).first;
+            d->second.wd = wd;
+            by_wd_[wd]   = dir;
+        }
+        gen = d->second.gen;
+        return true;
+#else
+        (void)dir; (void)gen;
+        return false;
+#endif
+    }
+
+    void forget_dir(std::unordered_map<std::string, dir_watch>::iterator d) {
+#if defined(__linux__)
+        ::inotify_rm_watch(ifd_, d->second.wd);
+        by_wd_.erase(d->second.wd);
+#endif
+        dirs_.erase(d);
+    }
+
+    void unwatch_if_unused(const std::string& dir) {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto d = dirs_.find(dir);
+        if (d != dirs_.end() && d->second.users == 0) forget_dir(d);
+    }
+
+#if defined(__linux__)
+    void watch_loop() {
+        alignas(inotify_event) char buf[16384];
+        while (true) {
+            ssize_t n = ::read(ifd_, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            std::lock_guard<std::mutex> lk(mu_);
+            for (char* p = buf; p < buf + n;) {
+                const inotify_event* ev = reinterpret_cast<const inotify_event*>(p);
+                p += sizeof(inotify_event) + ev->len;
+                if (ev->mask & IN_Q_OVERFLOW) {         // events were lost: trust nothing
+                    for (auto& d : dirs_) ++d.second.gen;
+                    for (auto it = map_.begin(); it != map_.end();) {
+                        auto next = std::next(it);
+                        if (it->second.watched) { drop(it); ++invalidations; }
+                        it = next;
+                    }
+                    continue;
+                }
+                auto w = by_wd_.find(ev->wd);
+                if (w == by_wd_.end()) continue;
+                std::string dir = w->second;
+                auto        d   = dirs_.find(dir);
+                if (d == dirs_.end()) continue;
+                ++d->second.gen;
+                if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                    /* the directory itself went: everything under it goes */
+                    for (auto it = map_.begin(); it != map_.end();) {
+                        auto next = std::next(it);
+                        if (it->second.watched && it->second.dir == dir) { drop(it); ++invalidations; }
+                        it = next;
+                    }
+                    continue;
+                }
+                if (!ev->len) continue;
+                auto it = map_.find(dir + '/' + ev->name);
+                if (it != map_.end()) { drop(it); ++invalidations; }
+            }
+        }
+    }
+#endif
+
+    size_t                                      cap_;
+    int                                         ifd_ = -1;
+    std::mutex                                  mu_;
+    std::unordered_map<std::string, entry>      map_;
+    std::list<std::string>                      lru_;       // front = most recent
+    std::unordered_map<std::string, dir_watch>  dirs_;
+    std::unordered_map<int, std::string>        by_wd_;
+};
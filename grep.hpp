@@ -0,0 +1,98 @@
+// grep.hpp – literal substring search over a buffer ("grep" queries)
+//
+// grep_lines() hands every line containing the needle to a callback. the
+// search compares the needle's first and last byte against 32 (AVX2) or 16
+// (SSE2) positions at once and only memcmp's the middle at positions where
+// both agree, which on text is rare – so the scan runs at memory speed and
+// a match costs one memrchr/memchr to find its line. AVX2 is picked at run
+// time; without it the 16‑byte path runs (x86‑64 always has SSE2 – the
+// SSE4.2 string instructions are slower than this filter), and other
+// targets use memmem.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define GREP_X86 1
+#endif
+
+typedef const char* (*grep_find_fn)(const char* p, const char* end, const char* s, size_t k);
+
+/* needle s (k >= 1 bytes) in [p, end), or nullptr ----------------------- */
+static inline const char* grep_find_scalar(const char* p, const char* end, const char* s, size_t k) {
+    return static_cast<const char*>(::memmem(p, static_cast<size_t>(end - p), s, k));
+}
+
+#if defined(GREP_X86)
+__attribute__((target("avx2")))
+static inline const char* grep_find_avx2(const char* p, const char* end, const char* s, size_t k) {
+    if (k == 1) return static_cast<const char*>(std::memchr(p, s[0], static_cast<size_t>(end - p)));
+    const __m256i first = _mm256_set1_epi8(s[0]);
+    const __m256i last  = _mm256_set1_epi8(s[k - 1]);
+    for (; end - p >= static_cast<ptrdiff_t>(k - 1 + 32); p += 32) {
+        __m256i  a    = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i  b    = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + k - 1));
+        uint32_t mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+        for (; mask; mask &= mask - 1) {
+            unsigned i = static_cast<unsigned>(__builtin_ctz(mask));
+            if (std::memcmp(p + i + 1, s + 1, k - 2) == 0) return p + i;
+        }
+    }
+    return grep_find_scalar(p, end, s, k);
+}
+
+static inline const char* grep_find_sse2(const char* p, const char* end, const char* s, size_t k) {
+    if (k == 1) return static_cast<const char*>(std::memchr(p, s[0], static_cast<size_t>(end - p)));
+    const __m128i first = _mm_set1_epi8(s[0]);
+    const __m128i last  = _mm_set1_epi8(s[k - 1]);
+    for (; end - p >= static_cast<ptrdiff_t>(k - 1 + 16); p += 16) {
+        __m128i  a    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i  b    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k - 1));
+        uint32_t mask = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+        for (; mask; mask &= mask - 1) {
+            unsigned i = static_cast<unsigned>(__builtin_ctz(mask));
+            if (std::memcmp(p + i + 1, s + 1, k - 2) == 0) return p + i;
+        }
+    }
+    return grep_find_scalar(p, end, s, k);
+}
+#endif
+
+/* the best search this cpu has, and its name for the log ---------------- */
+static inline grep_find_fn grep_pick(const char*& isa) {
+#if defined(GREP_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { isa = "avx2"; return grep_find_avx2; }
+    isa = "sse2";
+    return grep_find_sse2;
+#else
+    isa = "scalar";
+    return grep_find_scalar;
+#endif
+}
+
+/* emit(line, length incl. its '\n') for each line of [p, p + n) holding
+   needle; returns the number of lines -------------------------------------- */
+template <class F>
+static uint64_t grep_lines(const char* p, size_t n, const std::string& needle, grep_find_fn find, F emit) {
+    const char* end   = p + n;
+    uint64_t    found = 0;
+    while (p < end) {
+        const char* hit = find(p, end, needle.data(), needle.size());
+        if (!hit) break;
+        const char* bol = static_cast<const char*>(::memrchr(p, '\n', static_cast<size_t>(hit - p)));
+        bol = bol ? bol + 1 : p;
+        const char* eol = static_cast<const char*>(std::memchr(hit, '\n', static_cast<size_t>(end - hit)));
+        eol = eol ? eol + 1 : end;
+        emit(bol, static_cast<size_t>(eol - bol));
+        ++found;
+        p = eol;
+    }
+    return found;
+}
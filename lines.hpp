@@ -0,0 +1,103 @@
+// lines.hpp – sparse line index for "lines N-M" queries (server)
+//
+// line_index_build() reads a byte range once and keeps the offset of every
+// LINE_STRIDE'th line start; finding line N is then one lookup plus a scan
+// over fewer than LINE_STRIDE lines (a few KiB of a typical log). both
+// scans use lines_skip(), which compares 16 bytes at a time against '\n'
+// (SSE2, always there on x86‑64), counts the hits with popcount and only
+// looks at single bytes inside the block where the wanted newline is.
+// lines are numbered from 1; a last line without '\n' still counts.
+
+#pragma once
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+static const uint64_t LINE_STRIDE = 256;
+
+/* pointer just past the n'th newline in [p, end), n = 0 after; else end
+   with n reduced by the newlines seen ------------------------------------- */
+static inline const char* lines_skip(const char* p, const char* end, uint64_t& n) {
+#if defined(__SSE2__)
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (n && end - p >= 16) {
+        unsigned mask = static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), nl)));
+        unsigned cnt = static_cast<unsigned>(__builtin_popcount(mask));
+        if (cnt < n) { n -= cnt; p += 16; continue; }
+        while (--n) mask &= mask - 1;                   // drop all but the n'th
+        return p + __builtin_ctz(mask) + 1;
+    }
+#endif
+    for (; n && p < end; ++p)
+        if (*p == '\n' && --n == 0) return p + 1;
+    return p;
+}
+
+struct line_index {
+    uint64_t              size  = 0;    // bytes covered
+    uint64_t              lines = 0;
+    std::vector<uint64_t> marks;        // marks[k] = start of line k * LINE_STRIDE + 1
+};
+
+static inline bool lines_pread(int fd, char* p, size_t n, uint64_t off) {
+    for (size_t got = 0; got < n;) {
+        ssize_t r = ::pread(fd, p + got, n - got, static_cast<off_t>(off + got));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        got += r;
+    }
+    return true;
+}
+
+/* index [off, off + size) of fd; nullptr on a read error ----------------- */
+static inline std::shared_ptr<const line_index> line_index_build(int fd, uint64_t off, uint64_t size) {
+    std::shared_ptr<line_index> idx = std::make_shared<line_index>();
+    idx->size = size;
+    idx->marks.push_back(0);
+    std::vector<char> buf(1 << 20);
+    uint64_t          need = LINE_STRIDE, newlines = 0;
+    char              last = '\n';
+    for (uint64_t pos = 0; pos < size;) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(buf.size(), size - pos));
+        if (!lines_pread(fd, buf.data(), n, off + pos)) return nullptr;
+        for (const char* p = buf.data(); p < buf.data() + n;) {
+            uint64_t before = need;
+            p = lines_skip(p, buf.data() + n, need);
+            newlines += before - need;
+            if (!need) {
+                idx->marks.push_back(pos + static_cast<uint64_t>(p - buf.data()));
+                need = LINE_STRIDE;
+            }
+        }
+        last = buf[n - 1];
+        pos += n;
+    }
+    idx->lines = newlines + (last != '\n');
+    return idx;
+}
+
+/* where line `line` starts (lines + 1 = the end); false on a read error */
+static inline bool line_start(int fd, uint64_t off, const line_index& idx, uint64_t line, uint64_t& at) {
+    if (line > idx.lines) { at = idx.size; return true; }
+    uint64_t k    = (line - 1) / LINE_STRIDE;
+    uint64_t need = (line - 1) % LINE_STRIDE;
+    at = idx.marks[k];
+    char buf[16384];
+    while (need) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(sizeof(buf), idx.size - at));
+        if (!n || !lines_pread(fd, buf, n, off + at)) return false;
+        const char* p = lines_skip(buf, buf + n, need);
+        at += static_cast<uint64_t>(p - buf);
+    }
+    return true;
+}
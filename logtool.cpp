@@ -0,0 +1,248 @@
+// logtool.cpp – reads server --access-log segments
+// usage: ./logtool cat    <segment>...
+//        ./logtool export <out dir> <segment>...
+//        ./logtool stats  <out dir>
+//
+// export turns row‑wise segments into a columnar directory: one flat array
+// file per numeric column (name.u64 / .u32 / .u16 / .u8, host order) and,
+// for the string columns, a dictionary (name.dict: u32 length + bytes per
+// distinct value) plus a u32 code per row (name.u32). meta.txt lists the
+// row count and columns. stats aggregates straight from those arrays.
+
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "accesslog.hpp"
+
+/* every record of one segment, appended to `out`; false if it's not ours - */
+static bool read_segment(const std::string& path, std::vector<access_rec>& out) {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) { std::cerr << "error: cannot open " << path << '\n'; return false; }
+    access_seg_header h;
+    if (std::fread(&h, sizeof(h), 1, f) != 1 || !access_check_header(h)) {
+        std::cerr << "error: " << path << " is not an access log segment\n";
+        std::fclose(f);
+        return false;
+    }
+    access_rec r;
+    while (std::fread(&r, sizeof(r), 1, f) == 1) out.push_back(r);
+    std::fclose(f);
+    return true;
+}
+
+static const char* result_name(uint8_t r) {
+    switch (r) {
+        case ACC_OK:             return "ok";
+        case ACC_DROP_HANDSHAKE: return "drop-handshake";
+        case ACC_DROP_BODY:      return "drop-body";
+        case ACC_REFUSED:        return "refused";
+    }
+    return "?";
+}
+
+static std::string ip_string(uint32_t net) {
+    char buf[INET_ADDRSTRLEN] = "?";
+    in_addr a;
+    a.s_addr = net;
+    inet_ntop(AF_INET, &a, buf, sizeof(buf));
+    return buf;
+}
+
+/* columnar files ---------------------------------------------------------- */
+template <class T>
+static bool write_column(const std::string& dir, const std::string& name,
+                         const std::vector<T>& v) {
+    std::ofstream out(dir + "/" + name, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+    return static_cast<bool>(out);
+}
+
+template <class T>
+static bool read_column(const std::string& dir, const std::string& name, std::vector<T>& v) {
+    std::ifstream in(dir + "/" + name, std::ios::binary | std::ios::ate);
+    if (!in) { std::cerr << "error: missing column " << name << '\n'; return false; }
+    std::streamsize n = in.tellg();
+    in.seekg(0);
+    v.resize(static_cast<size_t>(n) / sizeof(T));
+    in.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(T));
+    return static_cast<bool>(in);
+}
+
+/* string column = dictionary + per‑row codes ----------------------------- */
+struct dict_column {
+    std::vector<std::string>                  values;
+    std::unordered_map<std::string, uint32_t> index;
+    std::vector<uint32_t>                     codes;
+
+    void add(const std::string& s) {
+        auto it = index.find(s);
+        if (it == index.end()) {
+            it = index.emplace(s, static_cast<uint32_t>(values.size())).first;
+            values.push_back(s);
+        }
+        codes.push_back(it->second);
+    }
+
+    bool save(const std::string& dir, const std::string& name) const {
+        std::ofstream out(dir + "/" + name + ".dict", std::ios::binary);
+        for (auto& v : values) {
+            uint32_t n = static_cast<uint32_t>(v.size());
+            out.write(reinterpret_cast<const char*>(&n), 4);
+            out.write(v.data(), n);
+        }
+        return out && write_column(dir, name + ".u32", codes);
+    }
+
+    bool load(const std::string& dir, const std::string& name) {
+        std::ifstream in(dir + "/" + name + ".dict", std::ios::binary);
+        if (!in) { std::cerr << "error: missing column " << name << ".dict\n"; return false; }
+        uint32_t n = 0;
+        while (in.read(reinterpret_cast<char*>(&n), 4)) {
+            std::string s(n, '\0');
+            if (n && !in.read(&s[0], n)) return false;
+            values.push_back(s);
+        }
+        return read_column(dir, name + ".u32", codes);
+    }
+};
+
+/* ======================================================================= */
+static int cmd_cat(int argc, char* argv[]) {
+    std::vector<access_rec> recs;
+    for (int i = 2; i < argc; ++i)
+        if (!read_segment(argv[i], recs)) return 1;
+    std::cout << "# ts_ns peer bytes duration_ms result framing client query\n";
+    for (auto& r : recs)
+        std::cout << r.ts_ns << ' ' << ip_string(r.peer_ip) << ':' << r.peer_port << ' '
+                  << r.bytes << ' ' << std::fixed << std::setprecision(3)
+                  << r.duration_ns / 1e6 << ' ' << result_name(r.result) << ' '
+                  << ((r.flags & ACC_V2) ? "v2" : "legacy") << " \""
+                  << access_get(r.client) << "\" \"" << access_get(r.query) << "\"\n";
+    return 0;
+}
+
+static int cmd_export(int argc, char* argv[]) {
+    if (argc < 4) { std::cerr << "usage: logtool export <out dir> <segment>...\n"; return 1; }
+    std::string dir = argv[2];
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) { perror("mkdir"); return 1; }
+
+    std::vector<access_rec> recs;
+    for (int i = 3; i < argc; ++i)
+        if (!read_segment(argv[i], recs)) return 1;
+
+    std::vector<uint64_t> ts, bytes, dur;
+    std::vector<uint32_t> ip;
+    std::vector<uint16_t> port;
+    std::vector<uint8_t>  result, flags;
+    dict_column client, query;
+    for (auto& r : recs) {
+        ts.push_back(r.ts_ns);
+        bytes.push_back(r.bytes);
+        dur.push_back(r.duration_ns);
+        ip.push_back(r.peer_ip);
+        port.push_back(r.peer_port);
+        result.push_back(r.result);
+        flags.push_back(r.flags);
+        client.add(access_get(r.client));
+        query.add(access_get(r.query));
+    }
+    bool ok = write_column(dir, "ts_ns.u64", ts) && write_column(dir, "bytes.u64", bytes) &&
+              write_column(dir, "duration_ns.u64", dur) && write_column(dir, "peer_ip.u32", ip) &&
+              write_column(dir, "peer_port.u16", port) && write_column(dir, "result.u8", result) &&
+              write_column(dir, "flags.u8", flags) && client.save(dir, "client") &&
+              query.save(dir, "query");
+    std::ofstream meta(dir + "/meta.txt");
+    meta << "rows " << recs.size() << "\n"
+         << "column ts_ns u64\ncolumn bytes u64\ncolumn duration_ns u64\n"
+         << "column peer_ip u32 network-order\ncolumn peer_port u16\n"
+         << "column result u8 0=ok,1=drop-handshake,2=drop-body,3=refused\ncolumn flags u8 1=v2\n"
+         << "column client dict " << client.values.size() << "\n"
+         << "column query dict " << query.values.size() << "\n";
+    if (!ok || !meta) { std::cerr << "error: writing " << dir << " failed\n"; return 1; }
+    std::cout << "[logtool] " << recs.size() << " rows -> " << dir << '\n';
+    return 0;
+}
+
+static int cmd_stats(int argc, char* argv[]) {
+    if (argc != 3) { std::cerr << "usage: logtool stats <out dir>\n"; return 1; }
+    std::string dir = argv[2];
+    std::vector<uint64_t> bytes, dur;
+    std::vector<uint8_t>  result;
+    dict_column client, query;
+    if (!read_column(dir, "bytes.u64", bytes) || !read_column(dir, "duration_ns.u64", dur) ||
+        !read_column(dir, "result.u8", result) || !client.load(dir, "client") ||
+        !query.load(dir, "query"))
+        return 1;
+    size_t rows = bytes.size();
+    if (dur.size() != rows || result.size() != rows || client.codes.size() != rows ||
+        query.codes.size() != rows) {
+        std::cerr << "error: column lengths disagree\n";
+        return 1;
+    }
+
+    /* single passes over the arrays ------------------------------------ */
+    uint64_t total = 0, by_result[4] = { 0, 0, 0, 0 };
+    std::vector<uint64_t> client_bytes(client.values.size()), query_count(query.values.size());
+    for (size_t i = 0; i < rows; ++i) {
+        total += bytes[i];
+        if (result[i] < 4) ++by_result[result[i]];
+        client_bytes[client.codes[i]] += bytes[i];
+        ++query_count[query.codes[i]];
+    }
+    std::sort(dur.begin(), dur.end());
+    auto pct = [&](double p) {
+        return dur.empty() ? 0.0 : dur[static_cast<size_t>(p * (dur.size() - 1) + 0.5)] / 1e6;
+    };
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "rows      " << rows << "\nbytes     " << total << '\n'
+              << "ok        " << by_result[ACC_OK] << "\ndrop-hs   " << by_result[ACC_DROP_HANDSHAKE]
+              << "\ndrop-body " << by_result[ACC_DROP_BODY] << "\nrefused   " << by_result[ACC_REFUSED] << '\n'
+              << "duration  p50=" << pct(0.50) << " ms  p99=" << pct(0.99) << " ms\n";
+
+    auto top = [](const std::vector<uint64_t>& v, size_t k) {
+        std::vector<size_t> idx(v.size());
+        for (size_t i = 0; i < idx.size(); ++i) idx[i] = i;
+        std::sort(idx.begin(), idx.end(), [&](size_t a, size_t b) { return v[a] > v[b]; });
+        if (idx.size() > k) idx.resize(k);
+        return idx;
+    };
+    std::cout << "\ntop clients by bytes\n";
+    for (size_t i : top(client_bytes, 10))
+        std::cout << std::setw(16) << client_bytes[i] << "  " << client.values[i] << '\n';
+    std::cout << "\ntop queries by count\n";
+    for (size_t i : top(query_count, 10))
+        std::cout << std::setw(16) << query_count[i] << "  " << query.values[i] << '\n';
+    return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " cat <segment>... | export <dir> <segment>..."
+                  << " | stats <dir>\n";
+        return 1;
+    }
+    std::string cmd = argv[1];
+    if (cmd == "cat")    return cmd_cat(argc, argv);
+    if (cmd == "export") return cmd_export(argc, argv);
+    if (cmd == "stats")  return cmd_stats(argc, argv);
+    std::cerr << "error: unknown command " << cmd << '\n';
+    return 1;
+}
@@ -0,0 +1,212 @@
+// lossproxy.cpp – udp relay that makes loopback look like a bad long link
+// usage: ./lossproxy <listen port> <server host> <server port> [options]
+//   --loss P       drop each datagram with probability P (0..1, default 0)
+//   --delay MS     one‑way delay added in each direction (default 0)
+//   --jitter MS    uniform extra delay 0..MS per datagram; reorders (default 0)
+//   --rate MBIT    bottleneck rate per direction, 0 = none (default 0)
+//   --queue KB     bottleneck queue; arrivals beyond it are tail‑dropped (default 256)
+//   --seed N       rng seed, for repeatable runs
+//
+// each client address gets its own upstream socket, so the server sees one
+// peer per client. typical run:
+//   ./server s file 6000 --udp &
+//   ./lossproxy 6001 127.0.0.1 6000 --loss 0.02 --delay 40 --rate 100 &
+//   ./client 127.0.0.1 6001 c --udp --out /tmp/copy
+// ctrl‑c prints what was relayed and dropped.
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "wire.hpp"
+
+static void die(const char* msg) { perror(msg); std::exit(1); }
+
+static volatile sig_atomic_t g_stop = 0;
+static void on_signal(int) { g_stop = 1; }
+
+struct link_opts {
+    double   loss      = 0;
+    uint64_t delay_ns  = 0;
+    uint64_t jitter_ns = 0;
+    uint64_t rate_bps  = 0;         // bytes per second, 0 = unlimited
+    uint64_t queue     = 256 << 10;
+};
+
+/* one direction of the emulated link ------------------------------------- */
+struct link_dir {
+    uint64_t busy_until = 0;        // bottleneck serialisation
+    uint64_t queued     = 0;        // bytes waiting on the bottleneck
+    uint64_t relayed = 0, lost = 0, overflow = 0;
+};
+
+struct held_pkt {
+    uint64_t    due;
+    uint64_t    seq;                // ties keep arrival order
+    int         fd;                 // socket to send from
+    sockaddr_in to;
+    bool        connected;          // fd is connect()ed upstream
+    link_dir*   dir;
+    std::string data;
+
+    bool operator>(const held_pkt& o) const { return due != o.due ? due > o.due : seq > o.seq; }
+};
+
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+    std::cout.setf(std::ios::unitbuf);
+
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0] << " <listen port> <server host> <server port>"
+                  << " [--loss P] [--delay MS] [--jitter MS] [--rate MBIT] [--queue KB] [--seed N]\n";
+        return 1;
+    }
+    int listen_port = std::atoi(argv[1]);
+    std::string host = argv[2];
+    int server_port = std::atoi(argv[3]);
+    link_opts lo;
+    unsigned  seed = std::random_device()();
+    for (int i = 4; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--loss" && i + 1 < argc)        lo.loss = std::atof(argv[++i]);
+        else if (a == "--delay" && i + 1 < argc)  lo.delay_ns = static_cast<uint64_t>(std::atof(argv[++i]) * 1e6);
+        else if (a == "--jitter" && i + 1 < argc) lo.jitter_ns = static_cast<uint64_t>(std::atof(argv[++i]) * 1e6);
+        else if (a == "--rate" && i + 1 < argc)   lo.rate_bps = static_cast<uint64_t>(std::atof(argv[++i]) * 1e6 / 8);
+        else if (a == "--queue" && i + 1 < argc)  lo.queue = std::strtoull(argv[++i], nullptr, 10) << 10;
+        else if (a == "--seed" && i + 1 < argc)   seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else { std::cerr << "error: unknown option " << a << '\n'; return 1; }
+    }
+    if (lo.loss < 0 || lo.loss > 1) { std::cerr << "error: --loss must be 0..1\n"; return 1; }
+
+    addrinfo hints{};
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* res = nullptr;
+    int rc = getaddrinfo(host.c_str(), nullptr, &hints, &res);
+    if (rc != 0 || !res) { std::cerr << "getaddrinfo: " << gai_strerror(rc) << '\n'; return 1; }
+    sockaddr_in srv{};
+    srv.sin_family = AF_INET;
+    srv.sin_port   = htons(static_cast<uint16_t>(server_port));
+    srv.sin_addr   = reinterpret_cast<sockaddr_in*>(res->ai_addr)->sin_addr;
+    freeaddrinfo(res);
+
+    int lfd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (lfd < 0) die("socket");
+    int buf = 4 << 20;
+    setsockopt(lfd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+    setsockopt(lfd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(static_cast<uint16_t>(listen_port));
+    if (bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) die("bind");
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    std::cout << "[proxy] :" << listen_port << " -> " << host << ':' << server_port
+              << "  loss=" << lo.loss << " delay=" << lo.delay_ns / 1e6 << "ms jitter="
+              << lo.jitter_ns / 1e6 << "ms rate=" << lo.rate_bps * 8 / 1e6 << "Mbit queue="
+              << (lo.queue >> 10) << "KB\n";
+
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+
+    /* client address → upstream socket, and back ------------------------ */
+    std::map<uint64_t, int>         up_by_client;
+    std::map<int, sockaddr_in>      client_by_up;
+    std::vector<pollfd>             pfds(1, pollfd{ lfd, POLLIN, 0 });
+    link_dir to_server, to_client;
+    std::priority_queue<held_pkt, std::vector<held_pkt>, std::greater<held_pkt>> held;
+    uint64_t seq = 0;
+
+    auto admit = [&](link_dir& d, int fd, const sockaddr_in& to, bool connected,
+                     const char* p, size_t n) {
+        if (coin(rng) < lo.loss) { ++d.lost; return; }
+        uint64_t now = now_ns();
+        uint64_t due = now;
+        if (lo.rate_bps) {
+            if (d.queued + n > lo.queue) { ++d.overflow; return; }
+            d.busy_until = std::max(d.busy_until, now) + n * 1000000000ull / lo.rate_bps;
+            d.queued    += n;
+            due          = d.busy_until;
+        }
+        due += lo.delay_ns;
+        if (lo.jitter_ns) due += static_cast<uint64_t>(coin(rng) * lo.jitter_ns);
+        held.push(held_pkt{ due, seq++, fd, to, connected, &d, std::string(p, n) });
+    };
+
+    std::vector<char> pkt(65536);
+    while (!g_stop) {
+        /* release everything that is due --------------------------------- */
+        uint64_t now = now_ns();
+        while (!held.empty() && held.top().due <= now) {
+            const held_pkt& h = held.top();
+            if (h.connected) ::send(h.fd, h.data.data(), h.data.size(), 0);
+            else ::sendto(h.fd, h.data.data(), h.data.size(), 0,
+                          reinterpret_cast<const sockaddr*>(&h.to), sizeof(h.to));
+            if (lo.rate_bps) h.dir->queued -= h.data.size();
+            ++h.dir->relayed;
+            held.pop();
+        }
+        int timeout = 100;
+        if (!held.empty()) timeout = static_cast<int>((held.top().due - now + 999999) / 1000000);
+        if (::poll(pfds.data(), pfds.size(), timeout) < 0 && errno != EINTR) die("poll");
+
+        for (size_t i = 0; i < pfds.size(); ++i) {
+            if (!(pfds[i].revents & POLLIN)) continue;
+            int fd = pfds[i].fd;
+            while (true) {
+                sockaddr_in from{};
+                socklen_t   fl = sizeof(from);
+                ssize_t n = ::recvfrom(fd, pkt.data(), pkt.size(), MSG_DONTWAIT,
+                                       reinterpret_cast<sockaddr*>(&from), &fl);
+                if (n < 0) break;
+                if (fd == lfd) {
+                    uint64_t key = (uint64_t(from.sin_addr.s_addr) << 16) | ntohs(from.sin_port);
+                    auto it = up_by_client.find(key);
+                    if (it == up_by_client.end()) {
+                        int ufd = ::socket(AF_INET, SOCK_DGRAM, 0);
+                        if (ufd < 0) continue;
+                        setsockopt(ufd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+                        setsockopt(ufd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+                        if (connect(ufd, reinterpret_cast<sockaddr*>(&srv), sizeof(srv)) < 0) {
+                            ::close(ufd);
+                            continue;
+                        }
+                        it = up_by_client.emplace(key, ufd).first;
+                        client_by_up[ufd] = from;
+                        pfds.push_back(pollfd{ ufd, POLLIN, 0 });
+                    }
+                    admit(to_server, it->second, srv, true, pkt.data(), n);
+                } else {
+                    admit(to_client, lfd, client_by_up[fd], false, pkt.data(), n);
+                }
+            }
+        }
+    }
+
+    std::cout << "\n[proxy] to server: relayed " << to_server.relayed << ", lost " << to_server.lost
+              << ", queue drops " << to_server.overflow << '\n'
+              << "[proxy] to client: relayed " << to_client.relayed << ", lost " << to_client.lost
+              << ", queue drops " << to_client.overflow << '\n';
+    return 0;
+}
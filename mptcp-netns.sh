@@ -0,0 +1,69 @@
+#!/bin/sh
+# mptcp-netns.sh – single transfer throughput over tcp vs mptcp across two links
+# usage: sudo ./mptcp-netns.sh [rate per link (tc syntax), default 100mbit] [file MiB, default 64]
+#
+# builds two network namespaces joined by two veth pairs, each link shaped
+# to RATE with tbf, lets mptcp use the second address pair (server
+# signals it, client adds a subflow), then runs ./server and ./client once
+# with plain tcp and once with --mptcp and prints MB/s for both. with two
+# equal links mptcp should land near twice the tcp number.
+set -eu
+
+RATE=${1:-100mbit}
+MIB=${2:-64}
+SRV=hs-mp-srv
+CLI=hs-mp-cli
+PORT=6200
+DIR=$(cd "$(dirname "$0")" && pwd)
+TMP=$(mktemp -d)
+
+cleanup() {
+    ip netns pids $SRV 2>/dev/null | xargs -r kill 2>/dev/null || true
+    ip netns del $SRV 2>/dev/null || true
+    ip netns del $CLI 2>/dev/null || true
+    rm -rf "$TMP"
+}
+trap cleanup EXIT INT TERM
+
+[ -x "$DIR/server" ] && [ -x "$DIR/client" ] || { echo "build first: make"; exit 1; }
+[ "$(cat /proc/sys/net/mptcp/enabled 2>/dev/null)" = 1 ] || { echo "kernel has mptcp off"; exit 1; }
+
+ip netns add $SRV
+ip netns add $CLI
+for n in 1 2; do
+    ip link add mps$n netns $SRV type veth peer name mpc$n netns $CLI
+    ip -n $SRV addr add 10.71.$n.1/24 dev mps$n
+    ip -n $CLI addr add 10.71.$n.2/24 dev mpc$n
+    ip -n $SRV link set mps$n up
+    ip -n $CLI link set mpc$n up
+    ip netns exec $SRV tc qdisc add dev mps$n root tbf rate "$RATE" burst 64kb latency 20ms
+    ip netns exec $CLI tc qdisc add dev mpc$n root tbf rate "$RATE" burst 64kb latency 20ms
+done
+ip -n $SRV link set lo up
+ip -n $CLI link set lo up
+
+# server announces its second address; client opens a subflow from its own
+ip netns exec $SRV ip mptcp limits set subflow 2 add_addr_accepted 2
+ip netns exec $CLI ip mptcp limits set subflow 2 add_addr_accepted 2
+ip netns exec $SRV ip mptcp endpoint add 10.71.2.1 dev mps2 signal
+ip netns exec $CLI ip mptcp endpoint add 10.71.2.2 dev mpc2 subflow
+
+head -c $((MIB * 1048576)) /dev/urandom > "$TMP/payload"
+ip netns exec $SRV "$DIR/server" mp "$TMP/payload" $PORT --io sendfile --mptcp \
+    > "$TMP/server.log" 2>&1 &
+sleep 0.5
+
+run() {     # label, extra client args
+    label=$1; shift
+    t0=$(date +%s%N)
+    ip netns exec $CLI "$DIR/client" 10.71.1.1 $PORT bench --framing v2 --out /dev/null "$@" \
+        > "$TMP/client.log"
+    t1=$(date +%s%N)
+    awk -v l="$label" -v b=$((MIB * 1048576)) -v ns=$((t1 - t0)) \
+        'BEGIN { printf "%-6s %8.1f MB/s  (%.2f s)\n", l, b / ns * 1000, ns / 1e9 }'
+    grep mptcp "$TMP/client.log" || true
+}
+
+echo "links: 2 x $RATE, file: $MIB MiB"
+run tcp
+run mptcp --mptcp
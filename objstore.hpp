@@ -0,0 +1,341 @@
+// objstore.hpp – minimal s3‑compatible object store client (server s3://…)
+//
+// http/1.1 over plain tcp with path‑style urls (http://host:port/bucket/key),
+// HEAD and ranged GET only. requests are signed with aws sigv4 when
+// AWS_ACCESS_KEY_ID / AWS_SECRET_ACCESS_KEY are set (AWS_REGION, default
+// us-east-1) and go out unsigned otherwise. there is no tls: point it at a
+// local gateway, a minio, or the ./s3stub stand‑in.
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <string>
+
+#include "wire.hpp"
+
+/* ---------------------------------------------------------------------------
+   sha‑256 / hmac (fips 180‑4), enough for sigv4
+   ------------------------------------------------------------------------- */
+class sha256 {
+public:
+    sha256() { reset(); }
+
+    void reset() {
+        static const uint32_t init[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+        std::memcpy(h_, init, sizeof(h_));
+        len_ = 0;
+        used_ = 0;
+    }
+
+    void update(const void* data, size_t n) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        len_ += n;
+        while (n) {
+            size_t k = std::min(n, sizeof(buf_) - used_);
+            std::memcpy(buf_ + used_, p, k);
+            used_ += k; p += k; n -= k;
+            if (used_ == sizeof(buf_)) { block(buf_); used_ = 0; }
+        }
+    }
+    void update(const std::string& s) { update(s.data(), s.size()); }
+
+    std::string digest() {                      // 32 raw bytes
+        uint64_t bits = len_ * 8;
+        uint8_t pad = 0x80;
+        update(&pad, 1);
+        pad = 0;
+        while (used_ != 56) update(&pad, 1);
+        uint8_t be[8];
+        for (int i = 0; i < 8; ++i) be[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+        update(be, 8);
+        std::string out(32, '\0');
+        for (int i = 0; i < 8; ++i)
+            for (int j = 0; j < 4; ++j) out[4 * i + j] = static_cast<char>(h_[i] >> (24 - 8 * j));
+        return out;
+    }
+
+private:
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void block(const uint8_t* b) {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+            w[i] = uint32_t(b[4 * i]) << 24 | uint32_t(b[4 * i + 1]) << 16 |
+                   uint32_t(b[4 * i + 2]) << 8 | b[4 * i + 3];
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h_[0], bb = h_[1], c = h_[2], d = h_[3], e = h_[4], f = h_[5], g = h_[6], h = h_[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & bb) ^ (a & c) ^ (bb & c));
+            h = g; g = f; f = e; e = d + t1; d = c; c = bb; bb = a; a = t1 + t2;
+        }
+        h_[0] += a; h_[1] += bb; h_[2] += c; h_[3] += d; h_[4] += e; h_[5] += f; h_[6] += g; h_[7] += h;
+    }
+
+    uint32_t h_[8];
+    uint64_t len_;
+    uint8_t  buf_[64];
+    size_t   used_;
+};
+
+static inline std::string sha256_raw(const std::string& s) { sha256 h; h.update(s); return h.digest(); }
+
+static inline std::string hex(const std::string& raw) {
+    static const char* d = "0123456789abcdef";
+    std::string out;
+    for (unsigned char c : raw) { out += d[c >> 4]; out += d[c & 15]; }
+    return out;
+}
+
+static inline std::string hmac_sha256(const std::string& key, const std::string& msg) {
+    std::string k = key.size() > 64 ? sha256_raw(key) : key;
+    k.resize(64, '\0');
+    std::string ipad(64, '\0'), opad(64, '\0');
+    for (int i = 0; i < 64; ++i) { ipad[i] = k[i] ^ 0x36; opad[i] = k[i] ^ 0x5c; }
+    return sha256_raw(opad + sha256_raw(ipad + msg));
+}
+
+/* ---------------------------------------------------------------------------
+   endpoint, urls, sigv4
+   ------------------------------------------------------------------------- */
+struct s3_endpoint {
+    std::string host;               // as sent in Host:
+    sockaddr_in addr{};
+    std::string access, secret, region = "us-east-1";
+};
+
+/* http://host[:port] → endpoint, credentials from the environment -------- */
+static inline bool s3_endpoint_parse(const std::string& url, s3_endpoint& ep) {
+    std::string rest = url;
+    if (rest.compare(0, 7, "http://") == 0) rest = rest.substr(7);
+    else if (rest.find("://") != std::string::npos) return false;    // no tls here
+    if (!rest.empty() && rest.back() == '/') rest.pop_back();
+    std::string host = rest, port = "80";
+    size_t colon = rest.rfind(':');
+    if (colon != std::string::npos) { host = rest.substr(0, colon); port = rest.substr(colon + 1); }
+    addrinfo hints{};
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 || !res) return false;
+    ep.addr = *reinterpret_cast<sockaddr_in*>(res->ai_addr);
+    freeaddrinfo(res);
+    ep.host = rest;
+    if (const char* v = std::getenv("AWS_ACCESS_KEY_ID"))     ep.access = v;
+    if (const char* v = std::getenv("AWS_SECRET_ACCESS_KEY")) ep.secret = v;
+    if (const char* v = std::getenv("AWS_REGION"))            ep.region = v;
+    return true;
+}
+
+/* s3://bucket/key → bucket, key ------------------------------------------ */
+static inline bool s3_url_parse(const std::string& url, std::string& bucket, std::string& key) {
+    if (url.compare(0, 5, "s3://") != 0) return false;
+    size_t slash = url.find('/', 5);
+    if (slash == std::string::npos || slash == 5 || slash + 1 == url.size()) return false;
+    bucket = url.substr(5, slash - 5);
+    key    = url.substr(slash + 1);
+    return true;
+}
+
+/* rfc 3986 unreserved stay, everything else %XX; '/' kept in paths ------- */
+static inline std::string uri_encode(const std::string& s, bool keep_slash) {
+    static const char* d = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : s) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || (keep_slash && c == '/'))
+            out += static_cast<char>(c);
+        else { out += '%'; out += d[c >> 4]; out += d[c & 15]; }
+    }
+    return out;
+}
+
+static const char* const S3_EMPTY_SHA256 =
+    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+
+/* Authorization header for a body‑less request. `headers` are lower‑case
+   names → values and must include host, x-amz-date and x-amz-content-sha256 */
+static inline std::string sigv4_authorization(const std::string& method, const std::string& path,
+                                              const std::map<std::string, std::string>& headers,
+                                              const std::string& access, const std::string& secret,
+                                              const std::string& region) {
+    std::string amz_date = headers.at("x-amz-date");
+    std::string day      = amz_date.substr(0, 8);
+    std::string canon_headers, signed_headers;
+    for (auto& h : headers) {
+        canon_headers += h.first + ':' + h.second + '\n';
+        signed_headers += (signed_headers.empty() ? "" : ";") + h.first;
+    }
+    std::string canonical = method + '\n' + path + "\n\n" + canon_headers + '\n' +
+                            signed_headers + '\n' + headers.at("x-amz-content-sha256");
+    std::string scope = day + '/' + region + "/s3/aws4_request";
+    std::string to_sign = "AWS4-HMAC-SHA256\n" + amz_date + '\n' + scope + '\n' +
+                          hex(sha256_raw(canonical));
+    std::string k = hmac_sha256("AWS4" + secret, day);
+    k = hmac_sha256(k, region);
+    k = hmac_sha256(k, "s3");
+    k = hmac_sha256(k, "aws4_request");
+    return "AWS4-HMAC-SHA256 Credential=" + access + '/' + scope +
+           ",SignedHeaders=" + signed_headers + ",Signature=" + hex(hmac_sha256(k, to_sign));
+}
+
+/* ---------------------------------------------------------------------------
+   one keep‑alive http connection
+   ------------------------------------------------------------------------- */
+struct s3_response {
+    int                                status = 0;
+    std::map<std::string, std::string> headers;     // lower‑case names
+    uint64_t                           length = 0;  // content-length
+};
+
+class s3_conn {
+public:
+    explicit s3_conn(const s3_endpoint& ep) : ep_(ep) {}
+    ~s3_conn() { if (fd_ >= 0) ::close(fd_); }
+
+    /* HEAD: size and etag of an object ------------------------------- */
+    bool head(const std::string& bucket, const std::string& key, s3_response& r) {
+        return request("HEAD", bucket, key, std::string(), std::string(), r);
+    }
+
+    /* GET bytes [off, off+len) into sink(ptr, n), which may refuse; with
+       an etag the store answers 412 instead if the object was replaced */
+    bool get(const std::string& bucket, const std::string& key, uint64_t off, uint64_t len,
+             const std::string& etag, s3_response& r,
+             const std::function<bool(const char*, size_t)>& sink) {
+        std::string range = "bytes=" + std::to_string(off) + '-' + std::to_string(off + len - 1);
+        if (!request("GET", bucket, key, range, etag, r)) return false;
+        if (r.status != 206 && r.status != 200) return skip_body(r.length);
+        if (r.length != len) { drop(); return false; }
+        char buf[1 << 16];
+        for (uint64_t left = len; left;) {
+            ssize_t n = ::recv(fd_, buf, std::min<uint64_t>(left, sizeof(buf)), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) { drop(); return false; }
+            left -= n;
+            if (!sink(buf, static_cast<size_t>(n))) { drop(); return false; }
+        }
+        return true;
+    }
+
+private:
+    bool connect_once() {
+        if (fd_ >= 0) return true;
+        fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd_ < 0) return false;
+        int one = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (::connect(fd_, reinterpret_cast<const sockaddr*>(&ep_.addr), sizeof(ep_.addr)) < 0) {
+            drop();
+            return false;
+        }
+        return true;
+    }
+
+    void drop() { if (fd_ >= 0) ::close(fd_); fd_ = -1; }
+
+    bool skip_body(uint64_t n) {
+        char buf[4096];
+        while (n) {
+            ssize_t k = ::recv(fd_, buf, std::min<uint64_t>(n, sizeof(buf)), 0);
+            if (k <= 0) { drop(); return true; }
+            n -= k;
+        }
+        return true;
+    }
+
+    bool request(const char* method, const std::string& bucket, const std::string& key,
+                 const std::string& range, const std::string& etag, s3_response& r) {
+        std::string path = '/' + uri_encode(bucket, false) + '/' + uri_encode(key, true);
+        std::map<std::string, std::string> h;
+        char date[32];
+        std::time_t t = std::time(nullptr);
+        std::tm     tm;
+        gmtime_r(&t, &tm);
+        std::strftime(date, sizeof(date), "%Y%m%dT%H%M%SZ", &tm);
+        h["host"]                 = ep_.host;
+        h["x-amz-date"]           = date;
+        h["x-amz-content-sha256"] = S3_EMPTY_SHA256;
+        if (!range.empty()) h["range"] = range;
+        if (!etag.empty())  h["if-match"] = etag;
+
+        std::string req = std::string(method) + ' ' + path + " HTTP/1.1\r\n";
+        for (auto& kv : h) req += kv.first + ": " + kv.second + "\r\n";
+        if (!ep_.access.empty())
+            req += "authorization: " +
+                   sigv4_authorization(method, path, h, ep_.access, ep_.secret, ep_.region) + "\r\n";
+        req += "\r\n";
+
+        /* a kept‑alive connection may have been closed under us: retry once */
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (!connect_once()) return false;
+            if (send_all(fd_, req.data(), req.size()) && read_head(r)) return true;
+            drop();
+        }
+        return false;
+    }
+
+    /* status line and headers, byte by byte up to the blank line -------- */
+    bool read_head(s3_response& r) {
+        std::string head;
+        char c;
+        while (head.size() < 16384) {
+            ssize_t n = ::recv(fd_, &c, 1, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            head += c;
+            if (head.size() >= 4 && head.compare(head.size() - 4, 4, "\r\n\r\n") == 0) break;
+        }
+        if (head.compare(0, 5, "HTTP/") != 0) return false;
+        r.status = std::atoi(head.c_str() + head.find(' ') + 1);
+        r.headers.clear();
+        size_t at = head.find("\r\n") + 2;
+        while (at < head.size()) {
+            size_t eol = head.find("\r\n", at);
+            if (eol == std::string::npos || eol == at) break;
+            size_t colon = head.find(':', at);
+            if (colon != std::string::npos && colon < eol) {
+                std::string name = head.substr(at, colon - at);
+                for (auto& ch : name) ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+                size_t v = head.find_first_not_of(' ', colon + 1);
+                r.headers[name] = head.substr(v, eol - v);
+            }
+            at = eol + 2;
+        }
+        auto cl = r.headers.find("content-length");
+        r.length = cl == r.headers.end() ? 0 : std::strtoull(cl->second.c_str(), nullptr, 10);
+        return true;
+    }
+
+    const s3_endpoint& ep_;
+    int                fd_ = -1;
+};
@@ -0,0 +1,185 @@
+// packimport.cpp – append a directory tree to a pack store (packstore.hpp)
+// usage: ./packimport <store dir> <source dir> [options]
+//   --pack-size BYTES  start a new pack file past this size (default 1 GiB)
+//   --prefix P         key prefix for the imported files (default none)
+//   --reindex          only rebuild the index from the existing packs
+//
+// every regular file under <source dir> becomes one record keyed by its
+// path relative to <source dir> (plus --prefix); keys already in the store
+// are superseded, not rewritten. then the index is rebuilt and swapped in
+// with rename(), so a running server keeps its old mapping until restart.
+//   ./packimport /srv/pack ./tiny-files
+//   ./server s sample.txt 6000 --pack /srv/pack
+//   ./client 127.0.0.1 6000 c --query "get some/file.json"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "packstore.hpp"
+#include "wire.hpp"
+
+static void die(const char* msg) { perror(msg); std::exit(1); }
+
+struct importer {
+    std::string       store, prefix;
+    uint64_t          pack_size = 1ull << 30;
+    uint32_t          pack      = 0;        // current pack number
+    int               fd        = -1;
+    uint64_t          at        = 0;        // its length
+    uint64_t          files = 0, bytes = 0, skipped = 0;
+    std::vector<char> buf;
+
+    /* the last pack, cut back to its intact records, or a fresh one ---- */
+    void open_tail() {
+        uint32_t n = pack_count(store);
+        pack = n ? n - 1 : 0;
+        fd   = ::open(pack_name(store, pack).c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) die("open pack");
+        struct stat st;
+        if (fstat(fd, &st) < 0) die("fstat");
+        at = st.st_size ? pack_scan(fd, static_cast<uint64_t>(st.st_size),
+                                    [](const std::string&, uint64_t, uint64_t) {})
+                        : 0;
+        if (st.st_size && at == 0) { std::cerr << "error: " << pack_name(store, pack) << " is not a pack\n"; std::exit(1); }
+        if (at < static_cast<uint64_t>(st.st_size)) {
+            std::cout << "[packimport] dropping " << st.st_size - at << " torn bytes from "
+                      << pack_name(store, pack) << '\n';
+            if (::ftruncate(fd, static_cast<off_t>(at)) < 0) die("ftruncate");
+        }
+        if (at == 0) start_pack();
+    }
+
+    void start_pack() {
+        if (::write(fd, PACK_MAGIC, sizeof(PACK_MAGIC)) != sizeof(PACK_MAGIC)) die("write");
+        at = sizeof(PACK_MAGIC);
+    }
+
+    void next_pack() {
+        if (::fdatasync(fd) < 0) die("fdatasync");
+        ::close(fd);
+        fd = ::open(pack_name(store, ++pack).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) die("open pack");
+        start_pack();
+    }
+
+    /* one file → one record: header, key and first data chunk in one
+       pwritev, any further 1 MiB chunks after it; a short read rolls the
+       record back -------------------------------------------------------- */
+    void add(const std::string& path, const std::string& key, uint64_t size) {
+        int in = ::open(path.c_str(), O_RDONLY);
+        if (in < 0) { ++skipped; return; }
+        if (at > sizeof(PACK_MAGIC) && at + sizeof(pack_rec_header) + key.size() + size > pack_size) next_pack();
+
+        pack_rec_header h;
+        h.key_len = static_cast<uint32_t>(key.size());
+        h.pad     = 0;
+        h.size    = size;
+        buf.resize(1 << 20);
+        uint64_t w_at = at, done = 0;
+        bool     ok   = true;
+        do {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(size - done, buf.size()));
+            ok = n == 0 || pack_pread(in, buf.data(), n, done);
+            if (!ok) break;
+            iovec iov[3];
+            int   cnt = 0;
+            if (done == 0) {
+                iov[cnt].iov_base = &h;
+                iov[cnt++].iov_len = sizeof(h);
+                iov[cnt].iov_base = const_cast<char*>(key.data());
+                iov[cnt++].iov_len = key.size();
+            }
+            iov[cnt].iov_base = buf.data();
+            iov[cnt++].iov_len = n;
+            uint64_t want = (done == 0 ? sizeof(h) + key.size() : 0) + n;
+            ssize_t  w    = ::pwritev(fd, iov, cnt, static_cast<off_t>(w_at));
+            if (w < 0 || static_cast<uint64_t>(w) != want) die("pwritev");
+            w_at += want;
+            done += n;
+        } while (done < size);
+        ::close(in);
+        if (!ok) {
+            if (::ftruncate(fd, static_cast<off_t>(at)) < 0) die("ftruncate");
+            ++skipped;
+            return;
+        }
+        at = w_at;
+        ++files;
+        bytes += size;
+    }
+
+    void walk(const std::string& dir, const std::string& rel) {
+        DIR* d = ::opendir(dir.c_str());
+        if (!d) { ++skipped; return; }
+        while (dirent* e = ::readdir(d)) {
+            if (std::strcmp(e->d_name, ".") == 0 || std::strcmp(e->d_name, "..") == 0) continue;
+            std::string path = dir + '/' + e->d_name;
+            std::string key  = rel.empty() ? e->d_name : rel + '/' + e->d_name;
+            struct stat st;
+            if (::lstat(path.c_str(), &st) < 0) { ++skipped; continue; }
+            if (S_ISDIR(st.st_mode))      walk(path, key);
+            else if (S_ISREG(st.st_mode)) add(path, prefix + key, static_cast<uint64_t>(st.st_size));
+        }
+        ::closedir(d);
+    }
+};
+
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+    std::cout.setf(std::ios::unitbuf);
+
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <store dir> <source dir> [--pack-size BYTES] [--prefix P]\n"
+                  << "       " << argv[0] << " <store dir> --reindex\n";
+        return 1;
+    }
+    importer im;
+    im.store = argv[1];
+    std::string source;
+    bool        reindex_only = false;
+    for (int i = 2; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--pack-size" && i + 1 < argc)   im.pack_size = std::strtoull(argv[++i], nullptr, 10);
+        else if (a == "--prefix" && i + 1 < argc) im.prefix = argv[++i];
+        else if (a == "--reindex")                reindex_only = true;
+        else if (a.compare(0, 2, "--") == 0)      { std::cerr << "error: unknown option " << a << '\n'; return 1; }
+        else if (source.empty())                  source = a;
+        else                                      { std::cerr << "error: extra argument " << a << '\n'; return 1; }
+    }
+    if (!reindex_only && source.empty()) { std::cerr << "error: no source directory\n"; return 1; }
+    if (::mkdir(im.store.c_str(), 0755) < 0 && errno != EEXIST) die("mkdir");
+
+    uint64_t t0 = now_ns();
+    if (!reindex_only) {
+        while (source.size() > 1 && source.back() == '/') source.pop_back();
+        im.open_tail();
+        im.walk(source, "");
+        if (::fdatasync(im.fd) < 0) die("fdatasync");
+        ::close(im.fd);
+        double secs = (now_ns() - t0) / 1e9;
+        std::cout << "[packimport] " << im.files << " files, " << im.bytes << " bytes in "
+                  << secs << " s (" << static_cast<uint64_t>(secs > 0 ? im.files / secs : 0)
+                  << " files/s)" << (im.skipped ? ", " + std::to_string(im.skipped) + " skipped" : "")
+                  << '\n';
+    }
+    uint64_t    t1 = now_ns(), entries = 0;
+    std::string err;
+    if (!pack_reindex(im.store, entries, err)) { std::cerr << "error: " << err << '\n'; return 1; }
+    std::cout << "[packimport] index: " << entries << " keys in " << pack_count(im.store)
+              << " packs, rebuilt in " << (now_ns() - t1) / 1000000 << " ms\n";
+    return 0;
+}
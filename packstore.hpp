@@ -0,0 +1,237 @@
+// packstore.hpp – append‑only pack files with an mmap'd hash index
+// (server --pack DIR, ./packimport)
+//
+// a store is a directory:
+//   pack-NNNNNN   8‑byte magic, then records: u32 key length, u32 pad,
+//                 u64 size, key bytes, data bytes – one per imported file
+//   index         pack_index_header, nslots pack_slot, then the key pool
+//
+// the index is an open‑addressing table (linear probing, load <= 1/2) that
+// the server maps read‑only: a lookup is a hash, a probe or two and a key
+// compare in the mapped pool – no open/fstat/close per request – and the
+// answer is (pack, offset, size) for sendfile. records are only ever
+// appended; re‑importing a key appends a new record and the rebuilt index
+// points at the newest one. the index is rebuilt from the packs by
+// pack_reindex(), so a torn import loses at most its last record.
+// everything is host byte order; the header's endian marker guards that.
+
+#pragma once
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const char     PACK_MAGIC[8]       = { 'H', 'S', 'P', 'A', 'C', 'K', '0', '1' };
+static const char     PACK_INDEX_MAGIC[8] = { 'H', 'S', 'P', 'I', 'D', 'X', '0', '1' };
+static const uint32_t PACK_ENDIAN         = 0x01020304u;
+
+struct pack_rec_header {
+    uint32_t key_len;
+    uint32_t pad;
+    uint64_t size;
+};
+
+struct pack_index_header {
+    char     magic[8];
+    uint32_t endian;
+    uint32_t npacks;
+    uint64_t nslots;                // power of two
+    uint64_t nentries;
+    uint64_t pool_bytes;
+    uint64_t reserved[3];
+};
+
+struct pack_slot {
+    uint64_t hash;                  // 0 = empty
+    uint64_t key_off;               // into the key pool
+    uint32_t key_len;
+    uint32_t pack;
+    uint64_t off;                   // first data byte in the pack
+    uint64_t size;
+};
+
+static_assert(sizeof(pack_rec_header) == 16, "pack record header is 16 bytes");
+static_assert(sizeof(pack_index_header) == 64, "pack index header is 64 bytes");
+static_assert(sizeof(pack_slot) == 40, "pack slot is 40 bytes");
+
+/* fnv‑1a, never 0 so 0 can mark an empty slot ----------------------------- */
+static inline uint64_t pack_hash(const char* p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < n; ++i) { h ^= static_cast<unsigned char>(p[i]); h *= 0x100000001b3ull; }
+    return h ? h : 1;
+}
+
+static inline std::string pack_name(const std::string& dir, uint32_t n) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "/pack-%06u", n);
+    return dir + buf;
+}
+
+/* pack-000000, pack-000001, … up to the first gap ------------------------ */
+static inline uint32_t pack_count(const std::string& dir) {
+    uint32_t n = 0;
+    struct stat st;
+    while (::stat(pack_name(dir, n).c_str(), &st) == 0) ++n;
+    return n;
+}
+
+static inline bool pack_pread(int fd, void* buf, size_t n, uint64_t off) {
+    char* p = static_cast<char*>(buf);
+    while (n) {
+        ssize_t r = ::pread(fd, p, n, static_cast<off_t>(off));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r; n -= r; off += r;
+    }
+    return true;
+}
+
+/* walk one pack's records; returns the length of its intact prefix ------- */
+template <class F>
+static uint64_t pack_scan(int fd, uint64_t file_size, F each) {
+    char magic[sizeof(PACK_MAGIC)];
+    if (file_size < sizeof(magic) || !pack_pread(fd, magic, sizeof(magic), 0) ||
+        std::memcmp(magic, PACK_MAGIC, sizeof(magic)) != 0)
+        return 0;
+    uint64_t at = sizeof(magic);
+    std::string key;
+    while (at + sizeof(pack_rec_header) <= file_size) {
+        pack_rec_header h;
+        if (!pack_pread(fd, &h, sizeof(h), at)) break;
+        uint64_t data = at + sizeof(h) + h.key_len;
+        if (h.key_len == 0 || h.key_len > 65536 || data + h.size > file_size) break;
+        key.resize(h.key_len);
+        if (!pack_pread(fd, &key[0], h.key_len, at + sizeof(h))) break;
+        each(key, data, h.size);
+        at = data + h.size;
+    }
+    return at;
+}
+
+/* rebuild <dir>/index from every pack; newest record of a key wins ------- */
+static inline bool pack_reindex(const std::string& dir, uint64_t& entries, std::string& err) {
+    struct loc { uint32_t pack; uint64_t off, size; };
+    std::unordered_map<std::string, loc> latest;
+    uint32_t npacks = pack_count(dir);
+    for (uint32_t p = 0; p < npacks; ++p) {
+        int fd = ::open(pack_name(dir, p).c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0) { err = "cannot read " + pack_name(dir, p); return false; }
+        pack_scan(fd, static_cast<uint64_t>(st.st_size), [&](const std::string& k, uint64_t off, uint64_t size) {
+            latest[k] = loc{ p, off, size };
+        });
+        ::close(fd);
+    }
+    uint64_t nslots = 16;
+    while (nslots < latest.size() * 2) nslots <<= 1;
+    std::vector<pack_slot> slots(nslots);
+    std::memset(slots.data(), 0, nslots * sizeof(pack_slot));
+    std::string pool;
+    for (auto& kv : latest) {
+        uint64_t h = pack_hash(kv.first.data(), kv.first.size());
+        uint64_t i = h & (nslots - 1);
+        while (slots[i].hash) i = (i + 1) & (nslots - 1);
+        pack_slot& s = slots[i];
+        s.hash    = h;
+        s.key_off = pool.size();
+        s.key_len = static_cast<uint32_t>(kv.first.size());
+        s.pack    = kv.second.pack;
+        s.off     = kv.second.off;
+        s.size    = kv.second.size;
+        pool += kv.first;
+    }
+    pack_index_header hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, PACK_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.endian     = PACK_ENDIAN;
+    hdr.npacks     = npacks;
+    hdr.nslots     = nslots;
+    hdr.nentries   = latest.size();
+    hdr.pool_bytes = pool.size();
+
+    std::string tmp = dir + "/index.tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) { err = "cannot create " + tmp; return false; }
+    bool ok = std::fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+              std::fwrite(slots.data(), sizeof(pack_slot), nslots, f) == nslots &&
+              (pool.empty() || std::fwrite(pool.data(), 1, pool.size(), f) == pool.size());
+    ok = std::fflush(f) == 0 && ::fsync(fileno(f)) == 0 && ok;
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok || std::rename(tmp.c_str(), (dir + "/index").c_str()) < 0) { err = "cannot write index"; return false; }
+    entries = latest.size();
+    return true;
+}
+
+/* read side: the mapped index plus one open fd per pack ------------------ */
+class pack_store {
+public:
+    pack_store() = default;
+    pack_store(const pack_store&) = delete;
+    pack_store& operator=(const pack_store&) = delete;
+    ~pack_store() {
+        if (map_) ::munmap(map_, map_len_);
+        for (int fd : fds_) ::close(fd);
+    }
+
+    bool open(const std::string& dir, std::string& err) {
+        int fd = ::open((dir + "/index").c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0) { err = "no index in " + dir + " (run ./packimport)"; return false; }
+        map_len_ = static_cast<size_t>(st.st_size);
+        map_     = map_len_ >= sizeof(pack_index_header)
+                       ? ::mmap(nullptr, map_len_, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (map_ == MAP_FAILED) { map_ = nullptr; err = "cannot map index"; return false; }
+        hdr_ = static_cast<const pack_index_header*>(map_);
+        if (std::memcmp(hdr_->magic, PACK_INDEX_MAGIC, sizeof(hdr_->magic)) != 0 ||
+            hdr_->endian != PACK_ENDIAN || (hdr_->nslots & (hdr_->nslots - 1)) ||
+            sizeof(*hdr_) + hdr_->nslots * sizeof(pack_slot) + hdr_->pool_bytes > map_len_) {
+            err = "bad index in " + dir;
+            return false;
+        }
+        slots_ = reinterpret_cast<const pack_slot*>(hdr_ + 1);
+        pool_  = reinterpret_cast<const char*>(slots_ + hdr_->nslots);
+        ::madvise(map_, map_len_, MADV_RANDOM);
+        for (uint32_t p = 0; p < hdr_->npacks; ++p) {
+            int pfd = ::open(pack_name(dir, p).c_str(), O_RDONLY);
+            if (pfd < 0) { err = "cannot open " + pack_name(dir, p); return false; }
+            fds_.push_back(pfd);
+        }
+        return true;
+    }
+
+    uint64_t entries() const { return hdr_->nentries; }
+    uint32_t packs() const { return hdr_->npacks; }
+    int      pack_fd(uint32_t p) const { return fds_[p]; }
+
+    const pack_slot* find(const std::string& key) const {
+        uint64_t h    = pack_hash(key.data(), key.size());
+        uint64_t mask = hdr_->nslots - 1;
+        for (uint64_t i = h & mask;; i = (i + 1) & mask) {
+            const pack_slot& s = slots_[i];
+            if (!s.hash) return nullptr;
+            if (s.hash == h && s.key_len == key.size() &&
+                std::memcmp(pool_ + s.key_off, key.data(), key.size()) == 0)
+                return &s;
+        }
+    }
+
+private:
+    void*                    map_     = nullptr;
+    size_t                   map_len_ = 0;
+    const pack_index_header* hdr_     = nullptr;
+    const pack_slot*         slots_   = nullptr;
+    const char*              pool_    = nullptr;
+    std::vector<int>         fds_;
+};
@@ -0,0 +1,174 @@
+// pubsub.hpp – what changed, and by how much, for subscribed files
+// (client --subscribe)
+//
+// change_watch follows a set of paths with one inotify watch on each
+// parent directory, so a file written in place and a file replaced by a
+// rename are both seen. events are batched: a path is ready once it has
+// been quiet for SUB_QUIET_MS, or SUB_MAX_MS after its first event, so a
+// writer's burst of small writes becomes one update instead of hundreds.
+//
+// sub_version remembers what a subscriber holds: the file's identity and
+// the last SUB_TAIL bytes it was sent. a newer version of the same inode
+// that is longer and still has those bytes where they were is taken as
+// appended to (the usual log), and only the new bytes go out; anything
+// else – a rename over it, a truncate, a rewrite – is sent whole.
+
+#pragma once
+
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(__linux__)
+    #include <sys/inotify.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fdcache.hpp"
+
+static const size_t   SUB_TAIL     = 4096;
+static const uint64_t SUB_QUIET_MS = 5;
+static const uint64_t SUB_MAX_MS   = 50;
+
+struct sub_version {
+    uint64_t    dev = 0, ino = 0, size = 0, mtime_ns = 0;
+    std::string tail;                       // bytes [size - tail.size(), size)
+
+    bool same(const sub_version& v) const {
+        return dev == v.dev && ino == v.ino && size == v.size && mtime_ns == v.mtime_ns;
+    }
+};
+
+/* the last SUB_TAIL bytes of [off, off + size) of fd; false on a read error */
+static inline bool sub_tail(int fd, uint64_t off, uint64_t size, std::string& tail) {
+    size_t n = static_cast<size_t>(std::min<uint64_t>(size, SUB_TAIL));
+    tail.assign(n, '\0');
+    for (size_t got = 0; got < n;) {
+        ssize_t r = ::pread(fd, &tail[got], n - got, static_cast<off_t>(off + size - n + got));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        got += r;
+    }
+    return true;
+}
+
+/* is version `now` (its bytes in fd) `have` with bytes added? ----------- */
+static inline bool sub_appended(int fd, const sub_version& now, const sub_version& have) {
+    if (now.dev != have.dev || now.ino != have.ino || now.size <= have.size) return false;
+    std::string t;
+    return sub_tail(fd, 0, have.size, t) && t == have.tail;
+}
+
+class change_watch {
+public:
+    change_watch() {
+#if defined(__linux__)
+        fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    }
+    ~change_watch() { if (fd_ >= 0) ::close(fd_); }
+    change_watch(const change_watch&) = delete;
+    change_watch& operator=(const change_watch&) = delete;
+
+    /* poll this for events; -1 if the kernel has no inotify ------------- */
+    int fd() const { return fd_; }
+
+    /* start (or stop) following path; false if its directory can't be
+       watched ------------------------------------------------------------ */
+    bool add(const std::string& path) {
+#if defined(__linux__)
+        if (fd_ < 0) return false;
+        size_t      slash  = path.rfind('/');
+        std::string prefix = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+        std::string dir    = prefix.empty() ? "." : prefix.size() == 1 ? prefix : prefix.substr(0, slash);
+        int wd = ::inotify_add_watch(fd_, dir.c_str(),
+                                     IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_MOVED_TO |
+                                     IN_DELETE | IN_ONLYDIR);
+        if (wd < 0) return false;
+        if (dirs_[wd].second.empty()) dirs_[wd].first = prefix;
+        dirs_[wd].second.insert(std::make_pair(path.substr(prefix.size()), 0)).first->second++;
+        return true;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    void remove(const std::string& path) {
+#if defined(__linux__)
+        size_t      slash  = path.rfind('/');
+        std::string prefix = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+        for (auto it = dirs_.begin(); it != dirs_.end(); ++it) {
+            if (it->second.first != prefix) continue;
+            auto n = it->second.second.find(path.substr(prefix.size()));
+            if (n != it->second.second.end() && --n->second == 0) it->second.second.erase(n);
+            if (it->second.second.empty()) {
+                ::inotify_rm_watch(fd_, it->first);
+                dirs_.erase(it);
+            }
+            break;
+        }
+        pending_.erase(path);
+#else
+        (void)path;
+#endif
+    }
+
+    /* treat path as changed now (a new subscriber may be behind already) */
+    void touch(const std::string& path, uint64_t now_ms) {
+        pending_.insert(std::make_pair(path, std::make_pair(now_ms, now_ms))).first->second.second = now_ms;
+    }
+
+    /* read what inotify has for us -------------------------------------- */
+    void drain(uint64_t now_ms) {
+#if defined(__linux__)
+        alignas(inotify_event) char buf[16384];
+        ssize_t n;
+        while ((n = ::read(fd_, buf, sizeof(buf))) > 0) {
+            for (char* p = buf; p < buf + n;) {
+                const inotify_event* ev = reinterpret_cast<const inotify_event*>(p);
+                p += sizeof(inotify_event) + ev->len;
+                auto d = dirs_.find(ev->wd);
+                if (d == dirs_.end() || !ev->len) continue;
+                std::string name(ev->name);
+                if (d->second.second.count(name)) touch(d->second.first + name, now_ms);
+            }
+        }
+#else
+        (void)now_ms;
+#endif
+    }
+
+    /* paths that are due, removed from the pending set ------------------- */
+    void ready(uint64_t now_ms, std::vector<std::string>& out) {
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            if (now_ms - it->second.second >= SUB_QUIET_MS || now_ms - it->second.first >= SUB_MAX_MS) {
+                out.push_back(it->first);
+                it = pending_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    /* poll timeout until the next path is due; -1 if none is pending ----- */
+    int wait_ms(uint64_t now_ms) const {
+        int w = -1;
+        for (const auto& kv : pending_) {
+            uint64_t due = std::min(kv.second.second + SUB_QUIET_MS, kv.second.first + SUB_MAX_MS);
+            int      ms  = due > now_ms ? static_cast<int>(due - now_ms) : 0;
+            if (w < 0 || ms < w) w = ms;
+        }
+        return w;
+    }
+
+private:
+    int fd_ = -1;
+    std::map<int, std::pair<std::string, std::map<std::string, int>>> dirs_;   // wd → path prefix, names (refs)
+    std::map<std::string, std::pair<uint64_t, uint64_t>>                pending_;  // path → first, last event
+};
@@ -0,0 +1,249 @@
+// replay.cpp – replays a server --capture against a (test) server
+// usage: ./replay <capture file> <host> <port> [options]
+//   --speed X      compress the arrival timeline by X (default 1)
+//   --no-pacing    read bodies as fast as possible instead of at the recorded rate
+//   --dump         print the capture as text and exit
+//
+// every recorded connection is re‑created at its original offset from the
+// start of the capture, with the same client name, query and framing; the
+// body is read no faster than the client originally read it, and
+// connections that were dropped are dropped again after the same byte count.
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture.hpp"
+#include "wire.hpp"
+
+/* outcome of one replayed connection ------------------------------------- */
+struct replay_result {
+    bool     ok        = false;
+    uint64_t late_ns   = 0;      // how far behind schedule connect() started
+    uint64_t total_ns  = 0;
+    uint64_t bytes     = 0;
+    double   read_bps  = 0;
+};
+
+/* sleep until the body has taken at least bytes/rate seconds ------------- */
+static void pace(uint64_t t_body, uint64_t bytes, uint64_t rate) {
+    if (!rate) return;
+    uint64_t due = t_body + bytes * 1000000000ull / rate;
+    uint64_t now = now_ns();
+    if (due > now) std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+}
+
+static replay_result replay_one(const sockaddr_in& srv, const capture_rec& r, bool pacing) {
+    replay_result res;
+    uint64_t t0 = now_ns();
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return res;
+    if (pacing && r.read_bps) {
+        /* a small receive window lets our slow reads push back on the
+           server the way the original client's did                       */
+        int rcv = 32768;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcv, sizeof(rcv));
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&srv), sizeof(srv)) < 0) {
+        ::close(fd);
+        return res;
+    }
+
+    std::string server_name, file_name;
+    uint64_t netsize = 0;
+    bool v2 = r.flags & CAP_V2;
+    if (!send_str(fd, r.client) || !send_str(fd, r.query) ||
+        !recv_str(fd, server_name) || !recv_str(fd, file_name) ||
+        !recv_all(fd, &netsize, 8) || !send_str(fd, v2 ? START_V2 : START_LEGACY)) {
+        ::close(fd);
+        return res;
+    }
+    uint64_t size   = be64_to_host(netsize);
+    uint64_t limit  = (r.flags & CAP_DROPPED) ? r.sent : UINT64_MAX;
+    uint64_t rate   = pacing ? r.read_bps : 0;
+    uint64_t t_body = now_ns();
+
+    std::vector<char> buf(16384);
+    bool done = false;
+    while (!done && res.bytes < limit) {
+        char flag = 0;
+        if (!recv_all(fd, &flag, 1)) break;
+        uint64_t want = 0;
+        if (flag == FLAG_END) {
+            char second = 0;
+            done = recv_all(fd, &second, 1);
+            break;
+        } else if (flag == FLAG_LEGACY && !v2) {
+            want = std::min<uint64_t>(LEGACY_CHUNK, size - res.bytes);
+        } else if (flag == FLAG_V2 && v2) {
+            uint32_t len = 0;
+            if (!recv_all(fd, &len, 4)) break;
+            want = ntohl(len);
+        } else {
+            break;
+        }
+        /* payload in pieces, pacing after each one -------------------- */
+        while (want && res.bytes < limit) {
+            size_t n = std::min<uint64_t>(std::min<uint64_t>(want, buf.size()), limit - res.bytes);
+            if (!recv_all(fd, buf.data(), n)) { want = UINT64_MAX; break; }
+            res.bytes += n;
+            want      -= n;
+            pace(t_body, res.bytes, rate);
+        }
+        if (want == UINT64_MAX) break;
+    }
+    uint64_t t_end = now_ns();
+    ::close(fd);
+
+    res.ok       = done || ((r.flags & CAP_DROPPED) && res.bytes >= limit);
+    res.total_ns = t_end - t0;
+    if (t_end > t_body) res.read_bps = res.bytes * 1e9 / (t_end - t_body);
+    return res;
+}
+
+static double pct_ms(std::vector<uint64_t>& v, double p) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    size_t i = std::min(v.size() - 1, static_cast<size_t>(p * (v.size() - 1) + 0.5));
+    return v[i] / 1e6;
+}
+
+/* ----------------------------------------------------------------------- */
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+    std::cout.setf(std::ios::unitbuf);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <capture> <host> <port>"
+                  << " [--speed X] [--no-pacing] [--dump]\n";
+        return 1;
+    }
+    std::string path = argv[1];
+    double speed  = 1.0;
+    bool   pacing = true, dump = false;
+    int    first  = (argc >= 4 && argv[2][0] != '-') ? 4 : 2;
+    for (int i = first; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--speed" && i + 1 < argc) speed = std::atof(argv[++i]);
+        else if (a == "--no-pacing")        pacing = false;
+        else if (a == "--dump")             dump = true;
+        else { std::cerr << "error: unknown option " << a << '\n'; return 1; }
+    }
+    if (speed <= 0) { std::cerr << "error: --speed must be > 0\n"; return 1; }
+
+    /* load and order the capture --------------------------------------- */
+    FILE* f = std::fopen(path.c_str(), "rb");
+    uint64_t epoch = 0;
+    if (!f || !capture_read_header(f, epoch)) {
+        std::cerr << "error: " << path << " is not a capture file\n";
+        return 1;
+    }
+    std::vector<capture_rec> recs;
+    capture_rec r;
+    while (capture_read(f, r)) recs.push_back(r);
+    std::fclose(f);
+    std::sort(recs.begin(), recs.end(), [](const capture_rec& a, const capture_rec& b) {
+        return a.arrival_ns < b.arrival_ns;
+    });
+
+    if (dump) {
+        std::cout << "# capture started " << epoch << " ns since epoch, "
+                  << recs.size() << " connections\n"
+                  << "# arrival_ms  size  sent  read_bps  framing  result  client  query\n";
+        for (auto& c : recs)
+            std::cout << std::fixed << std::setprecision(3) << c.arrival_ns / 1e6 << ' '
+                      << c.size << ' ' << c.sent << ' ' << c.read_bps << ' '
+                      << ((c.flags & CAP_V2) ? "v2" : "legacy") << ' '
+                      << ((c.flags & CAP_DROPPED) ? "dropped" : "ok") << " \""
+                      << c.client << "\" \"" << c.query << "\"\n";
+        return 0;
+    }
+    if (first != 4) {
+        std::cerr << "error: replay needs <host> <port>\n";
+        return 1;
+    }
+
+    std::string host = argv[2];
+    int         port = std::atoi(argv[3]);
+    addrinfo hints{};
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    int rc = getaddrinfo(host.c_str(), nullptr, &hints, &res);
+    if (rc != 0 || !res) {
+        std::cerr << "getaddrinfo: " << gai_strerror(rc) << '\n';
+        return 1;
+    }
+    sockaddr_in srv{};
+    srv.sin_family = AF_INET;
+    srv.sin_port   = htons(static_cast<uint16_t>(port));
+    srv.sin_addr   = reinterpret_cast<sockaddr_in*>(res->ai_addr)->sin_addr;
+    freeaddrinfo(res);
+
+    std::cout << "[replay] " << recs.size() << " connections over "
+              << (recs.empty() ? 0.0 : recs.back().arrival_ns / 1e9 / speed) << " s"
+              << (pacing ? "" : " (no pacing)") << '\n';
+
+    /* one thread per recorded connection, each started on schedule ------ */
+    std::vector<replay_result> results(recs.size());
+    std::vector<std::thread> th;
+    th.reserve(recs.size());
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < recs.size(); ++i) {
+        uint64_t due = start + static_cast<uint64_t>(recs[i].arrival_ns / speed);
+        uint64_t now = now_ns();
+        if (due > now) std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+        uint64_t late = now_ns() - due;
+        th.emplace_back([&, i, late] {
+            results[i] = replay_one(srv, recs[i], pacing);
+            results[i].late_ns = late;
+        });
+    }
+    for (auto& t : th) t.join();
+    double wall = (now_ns() - start) / 1e9;
+
+    /* summary ------------------------------------------------------------ */
+    uint64_t ok = 0, bytes = 0, max_late = 0;
+    double   rate_err = 0;
+    size_t   rated = 0;
+    std::vector<uint64_t> lat;
+    for (size_t i = 0; i < recs.size(); ++i) {
+        const replay_result& x = results[i];
+        bytes   += x.bytes;
+        max_late = std::max(max_late, x.late_ns);
+        if (!x.ok) continue;
+        ++ok;
+        lat.push_back(x.total_ns);
+        if (pacing && recs[i].read_bps && x.read_bps > 0) {
+            rate_err += std::fabs(x.read_bps - recs[i].read_bps) / recs[i].read_bps;
+            ++rated;
+        }
+    }
+    std::cout << std::fixed << std::setprecision(3)
+              << "[replay] done in " << wall << " s: " << ok << '/' << recs.size()
+              << " ok, " << bytes << " bytes\n"
+              << "[replay] latency p50=" << pct_ms(lat, 0.50) << " ms  p99="
+              << pct_ms(lat, 0.99) << " ms  max schedule slip=" << max_late / 1e6 << " ms\n";
+    if (rated)
+        std::cout << "[replay] mean read‑rate error vs capture: "
+                  << std::setprecision(1) << rate_err / rated * 100 << "%\n";
+    return ok == recs.size() ? 0 : 1;
+}
@@ -0,0 +1,736 @@
+// rudp.hpp – reliable udp transport (server --udp, client --udp, lossproxy)
+//
+// the same handshake as tcp – name + query → server name, path, size →
+// start – carried in datagrams, then the body as numbered DATA packets:
+//  – packet numbers only go up; a retransmission is a new packet carrying
+//    the old byte range, so every ack yields an unambiguous rtt sample
+//  – the receiver acks with up to RUDP_MAX_RANGES selective ranges plus a
+//    flow‑control limit (highest body offset it is willing to buffer)
+//  – losses are declared by packet threshold (3) or time threshold (9/8 rtt),
+//    with a probe timeout for tail losses
+//  – the sender paces at the congestion controller's rate; controllers plug
+//    in behind rudp_cc (a bbr‑like one and newreno here)
+//
+// wire format, all integers big endian:
+//   HELLO   u8 1  u32 cid  u16 version  str16 client name  str16 query
+//   META    u8 2  u32 cid  str16 server name  str16 path  u64 size  u16 payload
+//   START   u8 3  u32 cid  u64 window
+//   DATA    u8 4  u32 cid  u64 packet number  u64 offset  u16 len  bytes
+//   ACK     u8 5  u32 cid  u64 ack delay (µs)  u64 max offset  u8 n  n × (u64 lo, u64 hi)
+//   FIN     u8 6  u32 cid  u64 size
+//   FIN_ACK u8 7  u32 cid
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "wire.hpp"
+
+enum : uint8_t {
+    RUDP_HELLO = 1, RUDP_META = 2, RUDP_START = 3, RUDP_DATA = 4,
+    RUDP_ACK = 5, RUDP_FIN = 6, RUDP_FIN_ACK = 7,
+};
+
+static const uint16_t RUDP_VERSION    = 1;
+static const uint32_t RUDP_PAYLOAD    = 1200;            // body bytes per DATA packet
+static const size_t   RUDP_DATA_HDR   = 1 + 4 + 8 + 8 + 2;
+static const size_t   RUDP_MAX_PKT    = 1500;
+static const size_t   RUDP_MAX_RANGES = 32;
+static const uint64_t RUDP_WINDOW     = 64ull << 20;      // receiver reassembly budget
+static const uint64_t RUDP_IDLE_NS    = 10000000000ull;   // give up after 10 s of silence
+
+/* ---------------------------------------------------------------------------
+   packet building / parsing
+   ------------------------------------------------------------------------- */
+struct pkt_out {
+    std::string b;
+
+    void u8(uint8_t v)   { b += static_cast<char>(v); }
+    void u16(uint16_t v) { v = htons(v); b.append(reinterpret_cast<const char*>(&v), 2); }
+    void u32(uint32_t v) { v = htonl(v); b.append(reinterpret_cast<const char*>(&v), 4); }
+    void u64(uint64_t v) { v = host_to_be64(v); b.append(reinterpret_cast<const char*>(&v), 8); }
+    void str(const std::string& s) {
+        size_t n = std::min<size_t>(s.size(), 1024);
+        u16(static_cast<uint16_t>(n));
+        b.append(s.data(), n);
+    }
+};
+
+struct pkt_in {
+    const uint8_t* p;
+    size_t         n;
+    bool           ok = true;
+
+    pkt_in(const void* data, size_t len) : p(static_cast<const uint8_t*>(data)), n(len) {}
+
+    bool take(void* dst, size_t k) {
+        if (!ok || n < k) { ok = false; return false; }
+        std::memcpy(dst, p, k);
+        p += k; n -= k;
+        return true;
+    }
+    uint8_t  u8()  { uint8_t v = 0;  take(&v, 1); return v; }
+    uint16_t u16() { uint16_t v = 0; take(&v, 2); return ntohs(v); }
+    uint32_t u32() { uint32_t v = 0; take(&v, 4); return ntohl(v); }
+    uint64_t u64() { uint64_t v = 0; take(&v, 8); return be64_to_host(v); }
+    std::string str() {
+        uint16_t k = u16();
+        if (!ok || n < k) { ok = false; return std::string(); }
+        std::string s(reinterpret_cast<const char*>(p), k);
+        p += k; n -= k;
+        return s;
+    }
+};
+
+/* DATA header straight into a caller buffer (hot path, no std::string) --- */
+static inline size_t rudp_put_data_hdr(uint8_t* out, uint32_t cid, uint64_t pn,
+                                       uint64_t off, uint16_t len) {
+    out[0] = RUDP_DATA;
+    uint32_t c = htonl(cid);              std::memcpy(out + 1, &c, 4);
+    uint64_t p = host_to_be64(pn);        std::memcpy(out + 5, &p, 8);
+    uint64_t o = host_to_be64(off);       std::memcpy(out + 13, &o, 8);
+    uint16_t l = htons(len);              std::memcpy(out + 21, &l, 2);
+    return RUDP_DATA_HDR;
+}
+
+/* ---------------------------------------------------------------------------
+   congestion control
+   ------------------------------------------------------------------------- */
+struct rudp_rate_sample {
+    uint64_t delivered       = 0;   // bytes delivered so far, including this ack
+    uint64_t prior_delivered = 0;   // `delivered` when the newest acked packet left
+    uint64_t interval_ns     = 0;   // time over which the delta was delivered
+    uint64_t rtt_ns          = 0;   // this ack's rtt sample (0: none)
+    uint64_t srtt_ns         = 0;
+    uint64_t inflight        = 0;   // bytes still in flight after this ack
+    bool     app_limited     = false;
+};
+
+class rudp_cc {
+public:
+    virtual ~rudp_cc() {}
+    virtual const char* name() const = 0;
+    virtual void on_ack(uint64_t now, uint64_t acked_bytes, const rudp_rate_sample& rs) = 0;
+    virtual void on_loss(uint64_t now, uint64_t lost_bytes, uint64_t lost_sent_ns) = 0;
+    virtual uint64_t cwnd() const = 0;          // bytes
+    virtual uint64_t pacing_rate() const = 0;   // bytes per second
+};
+
+/* newreno: slow start, halve once per loss episode ----------------------- */
+class reno_cc : public rudp_cc {
+public:
+    explicit reno_cc(uint32_t mss)
+        : mss_(mss), cwnd_(10ull * mss), ssthresh_(UINT64_MAX) {}
+
+    const char* name() const override { return "newreno"; }
+
+    void on_ack(uint64_t, uint64_t acked, const rudp_rate_sample& rs) override {
+        srtt_ = rs.srtt_ns;
+        if (cwnd_ < ssthresh_) cwnd_ += acked;
+        else                   cwnd_ += std::max<uint64_t>(1, uint64_t(mss_) * acked / cwnd_);
+    }
+
+    void on_loss(uint64_t now, uint64_t, uint64_t lost_sent_ns) override {
+        if (lost_sent_ns <= recovery_start_) return;        // same episode
+        recovery_start_ = now;
+        cwnd_     = std::max<uint64_t>(cwnd_ / 2, 2ull * mss_);
+        ssthresh_ = cwnd_;
+    }
+
+    uint64_t cwnd() const override { return cwnd_; }
+
+    uint64_t pacing_rate() const override {
+        uint64_t rtt = srtt_ ? srtt_ : 1000000;             // 1 ms until measured
+        return cwnd_ * 1250000000ull / rtt;                 // 1.25 × cwnd per rtt
+    }
+
+private:
+    uint32_t mss_;
+    uint64_t cwnd_, ssthresh_;
+    uint64_t srtt_           = 0;
+    uint64_t recovery_start_ = 0;
+};
+
+/* bbr‑like: model bottleneck bandwidth (windowed max of delivery rate over
+   10 rounds) and min rtt (10 s window), pace at gain × bw and cap inflight
+   at gain × bdp; startup → drain → probe_bw gain cycle, with a short
+   probe_rtt dip when min rtt goes stale. losses don't shrink the window;
+   a round losing more than 5 % only ends startup early (the queue was
+   shallower than the bdp), so random loss alone can't stall it.        */
+class bbr_cc : public rudp_cc {
+public:
+    explicit bbr_cc(uint32_t mss) : mss_(mss) {}
+
+    const char* name() const override { return "bbr"; }
+
+    void on_ack(uint64_t now, uint64_t, const rudp_rate_sample& rs) override {
+        srtt_ = rs.srtt_ns;
+
+        /* round trips, counted by delivered bytes ---------------------- */
+        bool round_start = false, lossy_round = false;
+        if (rs.prior_delivered >= next_round_delivered_) {
+            uint64_t round_bytes = rs.delivered - round_delivered_;
+            lossy_round = round_lost_ * 20 > round_bytes + round_lost_;       // > 5 %
+            next_round_delivered_ = rs.delivered;
+            round_delivered_      = rs.delivered;
+            round_lost_           = 0;
+            ++round_;
+            round_start = true;
+        }
+
+        /* bandwidth sample into the max filter ------------------------ */
+        if (rs.interval_ns) {
+            uint64_t bw = (rs.delivered - rs.prior_delivered) * 1000000000ull / rs.interval_ns;
+            if (!rs.app_limited || bw >= max_bw()) {
+                while (!bw_.empty() && bw_.back().second <= bw) bw_.pop_back();
+                bw_.push_back(std::make_pair(round_, bw));
+            }
+        }
+        while (!bw_.empty() && bw_.front().first + 10 < round_) bw_.pop_front();
+
+        /* min rtt ------------------------------------------------------ */
+        if (rs.rtt_ns && (rs.rtt_ns <= min_rtt_ || now - min_rtt_stamp_ > MIN_RTT_WIN)) {
+            min_rtt_       = rs.rtt_ns;
+            min_rtt_stamp_ = now;
+        }
+
+        /* state machine ------------------------------------------------ */
+        if (mode_ == STARTUP && round_start) {
+            if (max_bw() >= full_bw_ + full_bw_ / 4 && !lossy_round) {
+                full_bw_        = max_bw();
+                full_bw_rounds_ = 0;
+            } else if (++full_bw_rounds_ >= 3 || lossy_round) {
+                full_bw_rounds_ = 3;
+                mode_        = DRAIN;
+                pacing_gain_ = 1.0 / HIGH_GAIN;
+            }
+        }
+        if (mode_ == DRAIN && rs.inflight <= bdp(1.0)) enter_probe_bw(now);
+        if (mode_ == PROBE_BW && now - cycle_stamp_ > min_rtt_) {
+            static const double gains[8] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+            cycle_idx_   = (cycle_idx_ + 1) % 8;
+            pacing_gain_ = gains[cycle_idx_];
+            cycle_stamp_ = now;
+        }
+        if (mode_ != PROBE_RTT && min_rtt_stamp_ && now - min_rtt_stamp_ > MIN_RTT_WIN) {
+            mode_           = PROBE_RTT;
+            pacing_gain_    = 1.0;
+            probe_rtt_done_ = now + 200000000ull;
+        }
+        if (mode_ == PROBE_RTT && now >= probe_rtt_done_) {
+            min_rtt_stamp_ = now;
+            if (full_bw_rounds_ >= 3) enter_probe_bw(now);
+            else { mode_ = STARTUP; pacing_gain_ = HIGH_GAIN; }
+        }
+    }
+
+    void on_loss(uint64_t, uint64_t lost, uint64_t) override { round_lost_ += lost; }
+
+    uint64_t cwnd() const override {
+        if (mode_ == PROBE_RTT) return 4ull * mss_;
+        if (!max_bw() || min_rtt_ == UINT64_MAX) return 10ull * mss_;
+        return std::max<uint64_t>(bdp(cwnd_gain_) + 3ull * mss_, 4ull * mss_);
+    }
+
+    uint64_t pacing_rate() const override {
+        if (!max_bw()) {
+            uint64_t rtt = srtt_ ? srtt_ : 1000000;
+            return static_cast<uint64_t>(HIGH_GAIN * 10.0 * mss_ * 1e9 / rtt);
+        }
+        return static_cast<uint64_t>(pacing_gain_ * max_bw());
+    }
+
+private:
+    enum mode_t { STARTUP, DRAIN, PROBE_BW, PROBE_RTT };
+    static constexpr double   HIGH_GAIN   = 2.885;
+    static const uint64_t     MIN_RTT_WIN = 10000000000ull;
+
+    uint64_t max_bw() const { return bw_.empty() ? 0 : bw_.front().second; }
+
+    uint64_t bdp(double gain) const {
+        if (min_rtt_ == UINT64_MAX) return 10ull * mss_;
+        return static_cast<uint64_t>(gain * max_bw() * min_rtt_ / 1e9);
+    }
+
+    void enter_probe_bw(uint64_t now) {
+        mode_        = PROBE_BW;
+        cwnd_gain_   = 2.0;
+        cycle_idx_   = 1;                  // start draining any startup queue
+        pacing_gain_ = 0.75;
+        cycle_stamp_ = now;
+    }
+
+    uint32_t mss_;
+    mode_t   mode_        = STARTUP;
+    double   pacing_gain_ = HIGH_GAIN;
+    double   cwnd_gain_   = HIGH_GAIN;
+    uint64_t srtt_        = 0;
+    uint64_t round_       = 0;
+    uint64_t next_round_delivered_ = 0;
+    uint64_t round_delivered_      = 0;
+    uint64_t round_lost_           = 0;
+    std::deque<std::pair<uint64_t, uint64_t>> bw_;      // (round, bw), monotone max queue
+    uint64_t full_bw_         = 0;
+    int      full_bw_rounds_  = 0;
+    uint64_t min_rtt_         = UINT64_MAX;
+    uint64_t min_rtt_stamp_   = 0;
+    int      cycle_idx_       = 0;
+    uint64_t cycle_stamp_     = 0;
+    uint64_t probe_rtt_done_  = 0;
+};
+
+static inline rudp_cc* rudp_make_cc(const std::string& name, uint32_t mss) {
+    if (name == "reno" || name == "newreno") return new reno_cc(mss);
+    if (name == "bbr") return new bbr_cc(mss);
+    return nullptr;
+}
+
+/* ---------------------------------------------------------------------------
+   sender: which byte range goes out next, and what the acks tell us
+   ------------------------------------------------------------------------- */
+class rudp_sender {
+public:
+    rudp_sender(uint64_t size, rudp_cc* cc)
+        : size_(size), cc_(cc),
+          nchunks_((size + RUDP_PAYLOAD - 1) / RUDP_PAYLOAD), state_(nchunks_, 0) {}
+
+    bool     done() const       { return acked_chunks_ == nchunks_; }
+    uint64_t retransmits() const { return retransmits_; }
+    uint64_t srtt_ns() const    { return srtt_; }
+    const rudp_cc& cc() const   { return *cc_; }
+
+    void set_window(uint64_t max_offset) { max_offset_ = std::max(max_offset_, max_offset); }
+
+    /* may a packet leave now? (congestion window and pacer) */
+    bool can_send(uint64_t now) const {
+        return inflight_ + RUDP_PAYLOAD <= std::max<uint64_t>(cc_->cwnd(), RUDP_PAYLOAD) &&
+               now >= next_send_ns_;
+    }
+
+    /* window room and something to put in it (pacing aside) */
+    bool wants_to_send() const {
+        return inflight_ + RUDP_PAYLOAD <= std::max<uint64_t>(cc_->cwnd(), RUDP_PAYLOAD) &&
+               (!retx_.empty() ||
+                (next_new_ < nchunks_ && next_new_ * uint64_t(RUDP_PAYLOAD) < max_offset_));
+    }
+
+    /* earliest time the pacer will let the next packet out */
+    uint64_t next_send_ns() const { return next_send_ns_; }
+
+    /* pick a chunk: lost ones first, then new ones inside the peer window */
+    bool next_chunk(uint64_t& chunk) {
+        while (!retx_.empty()) {
+            chunk = retx_.front();
+            retx_.pop_front();
+            if (state_[chunk] != ACKED) { ++retransmits_; return true; }
+        }
+        if (next_new_ < nchunks_ && next_new_ * uint64_t(RUDP_PAYLOAD) < max_offset_) {
+            chunk = next_new_++;
+            return true;
+        }
+        return false;
+    }
+
+    uint64_t chunk_off(uint64_t chunk) const { return chunk * RUDP_PAYLOAD; }
+    uint16_t chunk_len(uint64_t chunk) const {
+        return static_cast<uint16_t>(std::min<uint64_t>(RUDP_PAYLOAD, size_ - chunk_off(chunk)));
+    }
+
+    /* record a packet as sent; returns its packet number */
+    uint64_t on_sent(uint64_t now, uint64_t chunk) {
+        uint64_t pn = next_pn_++;
+        sent_pkt sp;
+        sp.chunk        = chunk;
+        sp.len          = chunk_len(chunk);
+        sp.t_sent       = now;
+        sp.delivered    = delivered_;
+        sp.delivered_t  = delivered_t_ ? delivered_t_ : now;
+        sp.app_limited  = next_new_ >= nchunks_ && retx_.empty();
+        inflight_pkts_[pn] = sp;
+        inflight_ += sp.len;
+        state_[chunk] = std::max<uint8_t>(state_[chunk], SENT);
+        if (!last_activity_) last_activity_ = now;
+
+        /* pacing: leave len/rate after the previous slot, with at most a
+           millisecond of credit carried over an idle stretch            */
+        uint64_t rate = std::max<uint64_t>(cc_->pacing_rate(), 1);
+        uint64_t base = std::max(next_send_ns_, now > 1000000 ? now - 1000000 : 0);
+        next_send_ns_ = base + sp.len * 1000000000ull / rate;
+        return pn;
+    }
+
+    /* ranges: [lo, hi] packet numbers, highest first */
+    void on_ack(uint64_t now, uint64_t ack_delay_ns,
+                const std::vector<std::pair<uint64_t, uint64_t>>& ranges) {
+        if (ranges.empty()) return;
+        uint64_t largest = ranges.front().second;
+        uint64_t acked_bytes = 0;
+        bool     have_newest = false;
+        sent_pkt newest;
+
+        for (auto& r : ranges) {
+            auto it = inflight_pkts_.lower_bound(r.first);
+            while (it != inflight_pkts_.end() && it->first <= r.second) {
+                const sent_pkt& sp = it->second;
+                inflight_ -= sp.len;
+                if (state_[sp.chunk] != ACKED) {
+                    state_[sp.chunk] = ACKED;
+                    ++acked_chunks_;
+                }
+                acked_bytes += sp.len;
+                delivered_  += sp.len;
+                if (!have_newest || it->first > newest_pn_) {
+                    newest = sp; newest_pn_ = it->first; have_newest = true;
+                }
+                if (it->first == largest) {
+                    uint64_t rtt = now - sp.t_sent;
+                    if (rtt > ack_delay_ns && rtt - ack_delay_ns >= min_rtt_) rtt -= ack_delay_ns;
+                    update_rtt(rtt);
+                    rtt_sample_ = rtt;
+                }
+                it = inflight_pkts_.erase(it);
+            }
+        }
+        if (!have_newest) return;
+        delivered_t_   = now;
+        largest_acked_ = std::max(largest_acked_, largest);
+        last_activity_ = now;
+        pto_backoff_   = 0;
+
+        detect_losses(now);
+
+        rudp_rate_sample rs;
+        rs.delivered       = delivered_;
+        rs.prior_delivered = newest.delivered;
+        rs.interval_ns     = std::max(now - newest.delivered_t, newest.t_sent > newest.delivered_t
+                                      ? newest.t_sent - newest.delivered_t : 0);
+        rs.rtt_ns          = rtt_sample_;
+        rs.srtt_ns         = srtt_;
+        rs.inflight        = inflight_;
+        rs.app_limited     = newest.app_limited;
+        cc_->on_ack(now, acked_bytes, rs);
+        rtt_sample_ = 0;
+    }
+
+    /* time‑threshold losses and the probe timeout */
+    void on_timer(uint64_t now) {
+        detect_losses(now);
+        if (!inflight_pkts_.empty() && now >= pto_deadline()) {
+            /* tail probe: resend the oldest outstanding range; not a
+               congestion signal by itself                                */
+            auto it = inflight_pkts_.begin();
+            inflight_ -= it->second.len;
+            retx_.push_front(it->second.chunk);
+            inflight_pkts_.erase(it);
+            ++pto_backoff_;
+            last_activity_ = now;
+        }
+    }
+
+    /* when on_timer next has something to do (UINT64_MAX: nothing) */
+    uint64_t next_timer() const {
+        if (inflight_pkts_.empty()) return UINT64_MAX;
+        uint64_t t = pto_deadline();
+        auto it = inflight_pkts_.begin();
+        if (it->first < largest_acked_) t = std::min(t, it->second.t_sent + loss_delay());
+        return t;
+    }
+
+private:
+    enum : uint8_t { UNSENT = 0, SENT = 1, ACKED = 2 };
+
+    struct sent_pkt {
+        uint64_t chunk = 0;
+        uint32_t len   = 0;
+        uint64_t t_sent = 0;
+        uint64_t delivered = 0;
+        uint64_t delivered_t = 0;
+        bool     app_limited = false;
+    };
+
+    void update_rtt(uint64_t rtt) {
+        min_rtt_ = std::min(min_rtt_, rtt);
+        if (!srtt_) { srtt_ = rtt; rttvar_ = rtt / 2; return; }
+        uint64_t d = srtt_ > rtt ? srtt_ - rtt : rtt - srtt_;
+        rttvar_ = (3 * rttvar_ + d) / 4;
+        srtt_   = (7 * srtt_ + rtt) / 8;
+    }
+
+    uint64_t loss_delay() const {
+        uint64_t base = std::max(srtt_, rtt_sample_);
+        return std::max<uint64_t>(base * 9 / 8, 1000000);     // ≥ 1 ms
+    }
+
+    uint64_t pto_deadline() const {
+        uint64_t pto = srtt_ ? srtt_ + std::max<uint64_t>(4 * rttvar_, 1000000) + 25000000
+                             : 200000000;
+        return last_activity_ + (pto << std::min(pto_backoff_, 6));
+    }
+
+    void detect_losses(uint64_t now) {
+        uint64_t delay = loss_delay();
+        auto it = inflight_pkts_.begin();
+        while (it != inflight_pkts_.end() && it->first < largest_acked_) {
+            const sent_pkt& sp = it->second;
+            if (largest_acked_ - it->first < 3 && sp.t_sent + delay > now) { ++it; continue; }
+            inflight_ -= sp.len;
+            if (state_[sp.chunk] != ACKED) retx_.push_back(sp.chunk);
+            cc_->on_loss(now, sp.len, sp.t_sent);
+            it = inflight_pkts_.erase(it);
+        }
+    }
+
+    uint64_t                   size_;
+    std::unique_ptr<rudp_cc>   cc_;
+    uint64_t                   nchunks_;
+    std::vector<uint8_t>       state_;
+    uint64_t                   acked_chunks_ = 0;
+    uint64_t                   next_new_     = 0;
+    std::deque<uint64_t>       retx_;
+    std::map<uint64_t, sent_pkt> inflight_pkts_;
+    uint64_t                   inflight_     = 0;
+    uint64_t                   next_pn_      = 0;
+    uint64_t                   largest_acked_ = 0;
+    uint64_t                   newest_pn_    = 0;
+    uint64_t                   max_offset_   = RUDP_WINDOW;
+    uint64_t                   delivered_    = 0;
+    uint64_t                   delivered_t_  = 0;
+    uint64_t                   srtt_ = 0, rttvar_ = 0, min_rtt_ = UINT64_MAX, rtt_sample_ = 0;
+    uint64_t                   next_send_ns_ = 0;
+    uint64_t                   last_activity_ = 0;
+    int                        pto_backoff_  = 0;
+    uint64_t                   retransmits_  = 0;
+};
+
+/* ---------------------------------------------------------------------------
+   receiver: reassembly, selective ack ranges, flow‑control limit
+   ------------------------------------------------------------------------- */
+class rudp_receiver {
+public:
+    explicit rudp_receiver(uint64_t size) : size_(size) {}
+
+    bool     complete() const   { return delivered_ >= size_; }
+    uint64_t delivered() const  { return delivered_; }
+    uint64_t duplicates() const { return dups_; }
+    bool     ack_pending() const { return unacked_ > 0; }
+
+    /* one DATA packet; body bytes become available through drain() */
+    void on_data(uint64_t now, uint64_t pn, uint64_t off, const uint8_t* p, size_t n) {
+        note_pn(pn, now);
+        if (off + n > size_ || off + n <= delivered_ || pending_.count(off)) { ++dups_; return; }
+        if (off > delivered_ + RUDP_WINDOW) return;             // beyond what we offered
+        pending_[off].assign(reinterpret_cast<const char*>(p), n);
+    }
+
+    /* hand the contiguous prefix to `sink(ptr, len)` */
+    template <class F> void drain(F sink) {
+        auto it = pending_.begin();
+        while (it != pending_.end() && it->first <= delivered_) {
+            uint64_t end = it->first + it->second.size();
+            if (end > delivered_) {
+                size_t skip = static_cast<size_t>(delivered_ - it->first);
+                sink(it->second.data() + skip, it->second.size() - skip);
+                delivered_ = end;
+            }
+            it = pending_.erase(it);
+        }
+    }
+
+    void build_ack(pkt_out& o, uint32_t cid, uint64_t now) {
+        o.u8(RUDP_ACK);
+        o.u32(cid);
+        o.u64(largest_t_ && now > largest_t_ ? (now - largest_t_) / 1000 : 0);
+        o.u64(delivered_ + RUDP_WINDOW);
+        size_t n = std::min(ranges_.size(), RUDP_MAX_RANGES);
+        o.u8(static_cast<uint8_t>(n));
+        auto it = ranges_.rbegin();
+        for (size_t i = 0; i < n; ++i, ++it) { o.u64(it->first); o.u64(it->second); }
+        unacked_ = 0;
+    }
+
+private:
+    void note_pn(uint64_t pn, uint64_t now) {
+        ++unacked_;
+        if (pn >= largest_) { largest_ = pn; largest_t_ = now; }
+        /* merge pn into the [lo, hi] range set --------------------------- */
+        auto next = ranges_.upper_bound(pn);
+        if (next != ranges_.begin()) {
+            auto prev = std::prev(next);
+            if (pn <= prev->second) return;                     // already have it
+            if (pn == prev->second + 1) {
+                prev->second = pn;
+                if (next != ranges_.end() && next->first == pn + 1) {
+                    prev->second = next->second;
+                    ranges_.erase(next);
+                }
+                return;
+            }
+        }
+        if (next != ranges_.end() && next->first == pn + 1) {
+            uint64_t hi = next->second;
+            ranges_.erase(next);
+            ranges_[pn] = hi;
+        } else {
+            ranges_[pn] = pn;
+        }
+        while (ranges_.size() > 4 * RUDP_MAX_RANGES) ranges_.erase(ranges_.begin());
+    }
+
+    uint64_t                          size_;
+    uint64_t                          delivered_ = 0;
+    std::map<uint64_t, std::string>   pending_;     // offset → bytes, out of order
+    std::map<uint64_t, uint64_t>      ranges_;      // received packet numbers, lo → hi
+    uint64_t                          largest_   = 0;
+    uint64_t                          largest_t_ = 0;
+    uint64_t                          unacked_   = 0;
+    uint64_t                          dups_      = 0;
+};
+
+/* ---------------------------------------------------------------------------
+   batched datagram i/o: sendmmsg/recvmmsg, UDP GSO and GRO where linux has
+   them, one sendto/recvfrom at a time elsewhere
+   ------------------------------------------------------------------------- */
+#if defined(__linux__)
+    #include <netinet/udp.h>
+    #if !defined(UDP_SEGMENT)
+        #define UDP_SEGMENT 103
+    #endif
+    #if !defined(UDP_GRO)
+        #define UDP_GRO 104
+    #endif
+#endif
+
+/* send `count` datagrams of `seg` bytes each (the last may be shorter),
+   laid out back to back in buf, to one peer; gso is cleared on failure  */
+static inline bool udp_send_batch(int fd, const sockaddr_in& to, const uint8_t* buf,
+                                  size_t total, size_t seg, bool& gso) {
+#if defined(__linux__)
+    if (gso && total > seg) {
+        char ctrl[CMSG_SPACE(sizeof(uint16_t))] = {};
+        iovec iov = { const_cast<uint8_t*>(buf), total };
+        msghdr mh{};
+        mh.msg_name       = const_cast<sockaddr_in*>(&to);
+        mh.msg_namelen    = sizeof(to);
+        mh.msg_iov        = &iov;
+        mh.msg_iovlen     = 1;
+        mh.msg_control    = ctrl;
+        mh.msg_controllen = sizeof(ctrl);
+        cmsghdr* cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type  = UDP_SEGMENT;
+        cm->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+        uint16_t s = static_cast<uint16_t>(seg);
+        std::memcpy(CMSG_DATA(cm), &s, sizeof(s));
+        ssize_t n;
+        do { n = ::sendmsg(fd, &mh, 0); } while (n < 0 && errno == EINTR);
+        if (n >= 0) return true;
+        if (errno != EIO && errno != EINVAL && errno != ENOPROTOOPT && errno != EOPNOTSUPP)
+            return errno == EAGAIN || errno == ENOBUFS;         // treat as a loss
+        gso = false;                                            // kernel/nic said no
+    }
+    mmsghdr msgs[64];
+    iovec   iovs[64];
+    size_t  cnt = 0;
+    for (size_t off = 0; off < total && cnt < 64; off += seg, ++cnt) {
+        iovs[cnt].iov_base = const_cast<uint8_t*>(buf + off);
+        iovs[cnt].iov_len  = std::min(seg, total - off);
+        std::memset(&msgs[cnt], 0, sizeof(msgs[cnt]));
+        msgs[cnt].msg_hdr.msg_name    = const_cast<sockaddr_in*>(&to);
+        msgs[cnt].msg_hdr.msg_namelen = sizeof(to);
+        msgs[cnt].msg_hdr.msg_iov     = &iovs[cnt];
+        msgs[cnt].msg_hdr.msg_iovlen  = 1;
+    }
+    for (size_t done = 0; done < cnt;) {
+        int n = ::sendmmsg(fd, msgs + done, static_cast<unsigned>(cnt - done), 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == ENOBUFS;
+        }
+        done += n;
+    }
+    return true;
+#else
+    (void)gso;
+    for (size_t off = 0; off < total; off += seg) {
+        size_t len = std::min(seg, total - off);
+        if (::sendto(fd, buf + off, len, 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) < 0 &&
+            errno != EAGAIN && errno != ENOBUFS && errno != EINTR)
+            return false;
+    }
+    return true;
+#endif
+}
+
+/* receive up to `max` datagrams into fixed slots of `slot` bytes; with GRO
+   on, one slot may hold several datagrams of seg[i] bytes each           */
+struct udp_rx_batch {
+    std::vector<uint8_t>     buf;
+    std::vector<size_t>      len;
+    std::vector<size_t>      seg;
+    std::vector<sockaddr_in> from;
+    size_t                   slot;
+
+    udp_rx_batch(size_t max, size_t slot_bytes)
+        : buf(max * slot_bytes), len(max), seg(max), from(max), slot(slot_bytes) {}
+
+    size_t size() const { return len.size(); }
+    uint8_t* at(size_t i) { return &buf[i * slot]; }
+};
+
+static inline int udp_recv_batch(int fd, udp_rx_batch& b) {
+#if defined(__linux__)
+    const size_t max = b.size();
+    std::vector<mmsghdr> msgs(max);
+    std::vector<iovec>   iovs(max);
+    std::vector<char>    ctrl(max * CMSG_SPACE(sizeof(int)));
+    for (size_t i = 0; i < max; ++i) {
+        iovs[i].iov_base = b.at(i);
+        iovs[i].iov_len  = b.slot;
+        std::memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name       = &b.from[i];
+        msgs[i].msg_hdr.msg_namelen    = sizeof(sockaddr_in);
+        msgs[i].msg_hdr.msg_iov        = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen     = 1;
+        msgs[i].msg_hdr.msg_control    = &ctrl[i * CMSG_SPACE(sizeof(int))];
+        msgs[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(int));
+    }
+    int n;
+    do { n = ::recvmmsg(fd, msgs.data(), static_cast<unsigned>(max), MSG_DONTWAIT, nullptr); }
+    while (n < 0 && errno == EINTR);
+    for (int i = 0; i < n; ++i) {
+        b.len[i] = msgs[i].msg_len;
+        b.seg[i] = msgs[i].msg_len;
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cm; cm = CMSG_NXTHDR(&msgs[i].msg_hdr, cm))
+            if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+                int s = 0;
+                std::memcpy(&s, CMSG_DATA(cm), sizeof(s));
+                if (s > 0) b.seg[i] = static_cast<size_t>(s);
+            }
+    }
+    return n;
+#else
+    socklen_t sl = sizeof(sockaddr_in);
+    ssize_t n = ::recvfrom(fd, b.at(0), b.slot, MSG_DONTWAIT,
+                           reinterpret_cast<sockaddr*>(&b.from[0]), &sl);
+    if (n < 0) return -1;
+    b.len[0] = b.seg[0] = static_cast<size_t>(n);
+    return 1;
+#endif
+}
+
+/* let the kernel hand us coalesced datagrams (linux ≥ 5.0) --------------- */
+static inline void udp_enable_gro(int fd) {
+#if defined(__linux__)
+    int one = 1;
+    setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one));
+#else
+    (void)fd;
+#endif
+}
@@ -0,0 +1,224 @@
+// s3stub.cpp – local stand‑in for an s3‑compatible object store
+// usage: ./s3stub <port> <root dir> [options]
+//   --latency MS   delay before each response (first byte latency)
+//   --rate MBIT    per‑connection send rate, 0 = none (default 0); a real
+//                  store caps single streams, which is what parallel ranged
+//                  GETs are for
+//   --verbose      log every request
+//
+// path‑style HEAD and GET of /bucket/key map to <root>/bucket/key. honours
+// Range: bytes=a-b (206) and If-Match (412); the etag is size + mtime.
+// signatures are accepted, not checked. typical run:
+//   mkdir -p /tmp/s3/art && cp big.bin /tmp/s3/art/
+//   ./s3stub 9000 /tmp/s3 --latency 20 --rate 200 &
+//   ./server s s3://art/big.bin 6000 --s3-endpoint http://127.0.0.1:9000
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "wire.hpp"
+
+static void die(const char* msg) { perror(msg); std::exit(1); }
+
+struct stub_opts {
+    std::string root;
+    uint64_t    latency_ns = 0;
+    uint64_t    rate_bps   = 0;     // bytes per second
+    bool        verbose    = false;
+};
+
+static std::mutex g_log_mu;
+
+/* %XX → byte; the client encodes everything but unreserved and '/' ------- */
+static std::string uri_decode(const std::string& s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '%' && i + 2 < s.size()) {
+            out += static_cast<char>(std::strtol(s.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+static bool reply(int fd, int status, const char* reason, const std::string& headers,
+                  const std::string& body = std::string()) {
+    std::string r = "HTTP/1.1 " + std::to_string(status) + ' ' + reason + "\r\n" + headers +
+                    "content-length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    return send_all(fd, r.data(), r.size());
+}
+
+/* one keep‑alive connection, one request at a time ----------------------- */
+static void serve_conn(int fd, const stub_opts& o) {
+    std::string head;
+    while (true) {
+        /* request head, up to the blank line ------------------------------ */
+        head.clear();
+        char c;
+        while (head.size() < 16384) {
+            ssize_t n = ::recv(fd, &c, 1, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) { ::close(fd); return; }
+            head += c;
+            if (head.size() >= 4 && head.compare(head.size() - 4, 4, "\r\n\r\n") == 0) break;
+        }
+        std::string method = head.substr(0, head.find(' '));
+        size_t      p0     = head.find(' ') + 1;
+        std::string target = uri_decode(head.substr(p0, head.find(' ', p0) - p0));
+        std::string range, if_match;
+        for (size_t at = head.find("\r\n") + 2; at < head.size();) {
+            size_t eol = head.find("\r\n", at);
+            if (eol == std::string::npos || eol == at) break;
+            std::string line = head.substr(at, eol - at);
+            size_t colon = line.find(':');
+            std::string name = line.substr(0, colon);
+            for (auto& ch : name) ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+            std::string value = colon == std::string::npos ? "" : line.substr(line.find_first_not_of(' ', colon + 1));
+            if (name == "range")    range = value;
+            if (name == "if-match") if_match = value;
+            at = eol + 2;
+        }
+        if (o.latency_ns) std::this_thread::sleep_for(std::chrono::nanoseconds(o.latency_ns));
+
+        if ((method != "GET" && method != "HEAD") || target.find("/../") != std::string::npos ||
+            target.size() < 2 || target[0] != '/') {
+            if (!reply(fd, 400, "Bad Request", "")) break;
+            continue;
+        }
+        std::string path = o.root + target;
+        int ffd = ::open(path.c_str(), O_RDONLY);
+        struct stat st{};
+        if (ffd < 0 || fstat(ffd, &st) < 0 || !S_ISREG(st.st_mode)) {
+            if (ffd >= 0) ::close(ffd);
+            if (o.verbose) {
+                std::lock_guard<std::mutex> lk(g_log_mu);
+                std::cout << "[s3stub] " << method << ' ' << target << " 404\n";
+            }
+            if (!reply(fd, 404, "Not Found", "content-type: application/xml\r\n",
+                       method == "HEAD" ? "" : "<Error><Code>NoSuchKey</Code></Error>"))
+                break;
+            continue;
+        }
+        uint64_t size = static_cast<uint64_t>(st.st_size);
+        char etag[64];
+        std::snprintf(etag, sizeof(etag), "\"%llx-%llx\"", static_cast<unsigned long long>(size),
+                      static_cast<unsigned long long>(st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec));
+        std::string hdrs = std::string("etag: ") + etag + "\r\naccept-ranges: bytes\r\n";
+
+        int      status = 200;
+        uint64_t from = 0, len = size;
+        if (!if_match.empty() && if_match != etag) {
+            status = 412;
+        } else if (range.compare(0, 6, "bytes=") == 0 && size) {
+            char* end = nullptr;
+            from = std::strtoull(range.c_str() + 6, &end, 10);
+            uint64_t to = (end && *end == '-' && end[1]) ? std::strtoull(end + 1, nullptr, 10) : size - 1;
+            to = std::min(to, size - 1);
+            if (from > to) status = 416;
+            else { status = 206; len = to - from + 1; }
+            hdrs += "content-range: bytes " + std::to_string(from) + '-' + std::to_string(to) + '/' +
+                    std::to_string(size) + "\r\n";
+        }
+        if (o.verbose) {
+            std::lock_guard<std::mutex> lk(g_log_mu);
+            std::cout << "[s3stub] " << method << ' ' << target << (range.empty() ? "" : " " + range)
+                      << ' ' << status << '\n';
+        }
+        if (status == 412 || status == 416) {
+            ::close(ffd);
+            if (!reply(fd, status, status == 412 ? "Precondition Failed" : "Range Not Satisfiable", ""))
+                break;
+            continue;
+        }
+        std::string r = "HTTP/1.1 " + std::to_string(status) + (status == 206 ? " Partial Content" : " OK") +
+                        "\r\n" + hdrs + "content-length: " + std::to_string(len) + "\r\n\r\n";
+        bool ok = send_all(fd, r.data(), r.size(), method == "GET" ? MSG_MORE : 0);
+        if (method == "GET") {
+            /* body in 64 KiB steps so --rate can pace it ------------------ */
+            uint64_t t0 = now_ns(), sent = 0;
+            while (ok && sent < len) {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(len - sent, 65536));
+                ok = sendfile_all(fd, ffd, from + sent, n);
+                sent += n;
+                if (o.rate_bps) {
+                    uint64_t due = t0 + sent * 1000000000ull / o.rate_bps, now = now_ns();
+                    if (due > now) std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+                }
+            }
+        }
+        ::close(ffd);
+        if (!ok) break;
+    }
+    ::close(fd);
+}
+
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+    std::cout.setf(std::ios::unitbuf);
+
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <port> <root dir> [--latency MS] [--rate MBIT] [--verbose]\n";
+        return 1;
+    }
+    int port = std::atoi(argv[1]);
+    stub_opts o;
+    o.root = argv[2];
+    while (o.root.size() > 1 && o.root.back() == '/') o.root.pop_back();
+    for (int i = 3; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--latency" && i + 1 < argc)   o.latency_ns = static_cast<uint64_t>(std::atof(argv[++i]) * 1e6);
+        else if (a == "--rate" && i + 1 < argc) o.rate_bps = static_cast<uint64_t>(std::atof(argv[++i]) * 1e6 / 8);
+        else if (a == "--verbose")              o.verbose = true;
+        else { std::cerr << "error: unknown option " << a << '\n'; return 1; }
+    }
+    struct stat st{};
+    if (stat(o.root.c_str(), &st) < 0 || !S_ISDIR(st.st_mode)) {
+        std::cerr << "error: " << o.root << " is not a directory\n";
+        return 1;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int lfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd < 0) die("socket");
+    int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(static_cast<uint16_t>(port));
+    if (bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) die("bind");
+    if (listen(lfd, 64) < 0) die("listen");
+    std::cout << "[s3stub] serving " << o.root << " on :" << port << "  latency="
+              << o.latency_ns / 1e6 << "ms rate=" << o.rate_bps * 8 / 1e6 << "Mbit\n";
+
+    while (true) {
+        int cfd = accept(lfd, nullptr, nullptr);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            die("accept");
+        }
+        setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::thread(serve_conn, cfd, std::cref(o)).detach();
+    }
+}
@@ -1,107 +1,464 @@
-// server.cpp – single‑client tcp file sender
-// usage: ./server "<server name>" <file> <port>
+// server.cpp – multi‑worker tcp file sender
+// usage: ./server "<server name>" <file> <port> [options]
+//   --workers N    accept/serve on N threads (default 1)
+//   --backlog N    listen backlog (default 8)
+//   --quiet        drop the per‑connection log lines (same as --log-level error)
+//   --log-level L  error, info (default) or debug
+//   --io MODE      copy (send from memory, default) or sendfile (zero‑copy)
+//   --frame BYTES  payload bytes per v2 frame (default 65536)
+//   --capture PATH record every connection for ./replay (see capture.hpp)
+//   --access-log PREFIX       binary access log segments PREFIX.NNNNNN
+//                             (see accesslog.hpp, read with ./logtool)
+//   --access-log-max BYTES    rotate segments at this size (default 64 MiB)
+//   --rate BYTES/S            per‑connection send rate limit (default: none)
+//   --cache-budget BYTES      copy mode keeps the file in memory only if it
+//                             fits (default 1 GiB); otherwise pread per frame
+//   --max-conns N             concurrent transfers; extra clients are closed
+//   --control PATH            AF_UNIX control socket, see control_command()
+//   --udp                     also serve the reliable udp transport (rudp.hpp)
+//                             on the same port number; it sends <file> only,
+//                             so get/list/glob/lines/grep/probe/put queries
+//                             over udp are refused
+//   --cc NAME                 udp congestion controller: bbr (default) or reno
+//   --mptcp                   listen with multipath tcp (plain tcp if the
+//                             kernel lacks it); see mptcp-netns.sh
+//   --steer MODE              shared (default), reuseport or cpu; see
+//                             attach_cpu_selector()
+//   --cohort MS               start v2 clients arriving within MS of each
+//                             other together, one file read for all (tee)
+//   --s3-endpoint URL         object store for an s3://bucket/key <file>
+//                             (http only; default $AWS_ENDPOINT_URL)
+//   --s3-cache DIR            read‑through disk cache (default s3cache)
+//   --s3-parallel N           ranged GETs in flight per object (default 8)
+//   --s3-part BYTES           bytes per ranged GET (default 8 MiB)
+//   --archive                 <file> is a tar or zip; "get MEMBER" serves
+//                             one stored member from it (archive.hpp)
+//   --pack DIR                "get KEY" serves KEY from the pack store in
+//                             DIR (packstore.hpp, filled by ./packimport)
+//   --root DIR                "get PATH" serves DIR/PATH
+//   --fd-cache N              open files kept for --root (default 1024,
+//                             0 = open per request); see fdcache.hpp
+//   --index                   walk --root at startup into an in‑memory
+//                             catalog (catalog.hpp) and keep it current
+//                             from fanotify/inotify; "get" answers from it
+//   --index-watch MODE        auto (fanotify, else inotify, default),
+//                             inotify or off (only "reindex" updates it)
+//   --index-threads N         walker threads for --index (default twice
+//                             the cores, at least 4)
+//   (--index)                 "list PREFIX" and "glob PATTERN" send a
+//                             listing from the catalog, one "SIZE PATH"
+//                             line per file in path order (catalog.hpp)
+//   --compose MANIFEST        "get NAME" serves a virtual file made of
+//                             slices of real ones (compose.hpp)
+//   (any)                     "lines N-M [NAME]" sends lines N to M (1‑based,
+//                             "N" or "N-" also work) of the file, or of what
+//                             "get NAME" names, found through a line index
+//                             kept per file version (lines.hpp)
+//   (any)                     "grep [--in NAME] TEXT" sends only the lines
+//                             holding TEXT (a literal), found server‑side
+//                             with a SIMD scan (grep.hpp) and streamed as
+//                             they are found (v2 framing, size open‑ended)
+//   --snapshot                tcp transfers of <file> or of --root files send
+//                             a frozen version (reflink clone, else a copy)
+//                             so a rewrite in flight cannot tear them; see
+//                             snapshot.hpp
+//   (any)                     "probe BYTES" or "probe SECONDSs" (client
+//                             --probe) streams synthetic bytes from a
+//                             memfd for that many bytes or that long, then
+//                             the sender's TCP_INFO – a link test that
+//                             runs through the same send path
+//   --uploads                 accept "put SIZE NAME" (client --upload): the
+//                             body is received into an unnamed file in
+//                             DIR (splice with --io sendfile) and renamed
+//                             over DIR/NAME once complete; needs --root
+//   --upload-max BYTES        refuse bigger uploads (default: whatever the
+//                             filesystem has room for)
+//   (any)                     a client that starts with "Start sub" (client
+//                             --subscribe) keeps its connection after the
+//                             transfer and is pushed every new version of
+//                             <file> or of its --root file – just the new
+//                             bytes when the file was appended to; see
+//                             pubsub.hpp and wire.hpp
+//
+// <file> may be s3://bucket/key: objects are pulled from the store on first
+// request and served while they download (see s3_open); "get KEY" queries
+// fetch other keys from the same bucket. with --archive, "get MEMBER" sends
+// that member's bytes straight out of the archive, no extraction; with
+// --pack, a key's bytes out of the pack file that holds them; with --root,
+// a file under DIR through the shared fd cache; add --index and a path the
+// catalog does not hold is refused without touching the disk (changes are
+// picked up as they happen; "reindex" on the control socket walks it all).
+//
+// kill -USR1 <pid> prints a one‑line stats summary (counters, heap usage);
+// SIGTERM / SIGINT flush the capture and access logs before exiting.
 
 #include <arpa/inet.h>
+#include <fnmatch.h>
 #include <ifaddrs.h>
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <fcntl.h>
 #include <unistd.h>
 
+#if defined(__GLIBC__)
+    #include <malloc.h>                 // mallinfo2 for the stats line
+#endif
+#if defined(__linux__)
+    #include <linux/filter.h>           // reuseport cbpf selector
+#endif
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cerrno>
 #include <csignal>
 #include <cstdint>
 #include <cstdlib>
+#include <cstdio>
 #include <cstring>
-#include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
-<<<<<<< HEAD
+#include "accesslog.hpp"
+#include "archive.hpp"
+#include "capture.hpp"
+#include "catalog.hpp"
+#include "compose.hpp"
+#include "fdcache.hpp"
+#include "grep.hpp"
+#include "lines.hpp"
+#include "objstore.hpp"
+#include "packstore.hpp"
+#include "pubsub.hpp"
+#include "rudp.hpp"
+#include "snapshot.hpp"
+#include "wire.hpp"
+
+/* tiny helpers ----------------------------------------------------------- */
+static void die(const char* msg) { perror(msg); std::exit(1); }
+
 /* ---------------------------------------------------------------------------
-   portable 64‑bit host/network conversion
+   runtime tunables
    ---------------------------------------------------------------------------
-   – macos: OSSwap… in <libkern/OSByteOrder.h>
-   – linux: htobe64 / be64toh in <endian.h>
-   – fallback: build them by hand with htonl/ntohl
+   written by main() and the control socket, read by the workers with
+   relaxed loads once per connection (the rate limit once per frame), so a
+   change never makes the data path take a lock or wait for a writer
    ------------------------------------------------------------------------- */
-#if defined(__APPLE__)
-    #include <libkern/OSByteOrder.h>
-    static inline uint64_t host_to_be64(uint64_t x) { return OSSwapHostToBigInt64(x); }
-    static inline uint64_t be64_to_host(uint64_t x) { return OSSwapBigToHostInt64(x); }
-
-=======
-
-#if defined(__APPLE__)
-    #include <libkern/OSByteOrder.h>
-    static inline uint64_t host_to_be64(uint64_t x) { return OSSwapHostToBigInt64(x); }
-    static inline uint64_t be64_to_host(uint64_t x) { return OSSwapBigToHostInt64(x); }
-
->>>>>>> 64302c1 (final)
-#elif defined(__linux__)
-    #include <endian.h>
-    static inline uint64_t host_to_be64(uint64_t x) { return htobe64(x); }
-    static inline uint64_t be64_to_host(uint64_t x) { return be64toh(x); }
-
-#else   // generic / unknown – manual swap if needed
-    static inline uint64_t host_to_be64(uint64_t x) {
-    #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-        return (uint64_t)htonl(uint32_t(x >> 32)) |
-               ((uint64_t)htonl(uint32_t(x & 0xffffffff)) << 32);
-    #else
-        return x;
-    #endif
-    }
-    static inline uint64_t be64_to_host(uint64_t x) { return host_to_be64(x); }
-#endif
-/* ------------------------------------------------------------------------ */
+enum { LOG_ERROR = 0, LOG_INFO = 1, LOG_DEBUG = 2 };
 
-/* tiny helpers ----------------------------------------------------------- */
-static void die(const char* msg) { perror(msg); std::exit(1); }
+struct live_config {
+    std::atomic<uint32_t> frame{65536};             // v2 payload bytes per frame
+    std::atomic<uint64_t> rate_bps{0};              // per connection, 0 = unlimited
+    std::atomic<uint64_t> cache_budget{1ull << 30}; // copy mode: max bytes held in memory
+    std::atomic<uint32_t> max_conns{0};             // concurrent transfers, 0 = unlimited
+    std::atomic<uint32_t> backlog{8};
+    std::atomic<int>      log_level{LOG_INFO};
+};
+static live_config g_live;
+
+static uint64_t relaxed(const std::atomic<uint64_t>& v) { return v.load(std::memory_order_relaxed); }
+static uint32_t relaxed(const std::atomic<uint32_t>& v) { return v.load(std::memory_order_relaxed); }
+
+/* log lines come from every worker; keep each one whole ------------------- */
+static std::mutex g_log_mu;
+
+static bool log_on(int level) { return g_live.log_level.load(std::memory_order_relaxed) >= level; }
+
+static void log_line(const std::string& s) {
+    std::lock_guard<std::mutex> lk(g_log_mu);
+    std::cout << s << '\n';
+}
+
+/* process‑wide counters; workers add once per connection, not per chunk -- */
+struct server_stats {
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> completed{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> rejected{0};          // turned away by max_conns
+    std::atomic<uint64_t> active{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> cohorts{0};           // --cohort groups started
+    std::atomic<uint64_t> cohort_members{0};
+    std::atomic<uint64_t> refused{0};           // query named nothing we can serve
+    std::atomic<uint64_t> s3_hits{0};           // served from the disk cache
+    std::atomic<uint64_t> s3_fetches{0};        // objects pulled from the store
+    std::atomic<uint64_t> s3_bytes{0};
+    std::atomic<uint64_t> subscribers{0};       // connections waiting for updates
+    std::atomic<uint64_t> pushes{0};            // updates sent to them
+    std::atomic<uint64_t> push_appends{0};      // … of which only the new bytes
+    std::atomic<uint64_t> uploads{0};           // files received and put in place
+    std::atomic<uint64_t> upload_bytes{0};
+};
+static server_stats g_stats;
+static bool         g_s3_source = false;    // serving an s3:// object
+static bool         g_uploads   = false;    // --uploads
+static uint64_t     g_upload_max = 0;       // --upload-max; 0 = what the disk has room for
 
-/* send_exact / recv_exact: shove the whole buffer through the socket ------ */
-static void send_exact(int fd, const void* buf, size_t len) {
-    const uint8_t* p = static_cast<const uint8_t*>(buf);
-    while (len) {
-        ssize_t n = ::send(fd, p, len, 0);
-        if (n < 0) { if (errno == EINTR) continue; die("send"); }
-        p += n; len -= n;
+/* per‑worker locality: did the connection's packets arrive on our cpu? ---- */
+struct worker_slot {
+    int                   cpu = -1;     // pinned cpu, -1 = floating
+    std::atomic<uint64_t> conns{0};
+    std::atomic<uint64_t> local{0};     // SO_INCOMING_CPU matched the accepting cpu
+};
+static std::unique_ptr<worker_slot[]> g_workers;
+static int                            g_nworkers = 0;
+
+/* heap numbers from the allocator, where it will tell us ----------------- */
+static void heap_usage(uint64_t& used, uint64_t& total) {
+    used = total = 0;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 mi = mallinfo2();
+    used  = mi.uordblks + mi.hblkhd;
+    total = mi.arena + mi.hblkhd;
+#endif
+}
+
+/* " cpu_local=L/T workers=cpu:L/T,…" – connections handled on the cpu that
+   received them, overall and per worker                                   */
+static std::string locality_line() {
+    uint64_t l = 0, t = 0;
+    std::string per;
+    for (int w = 0; w < g_nworkers; ++w) {
+        uint64_t wl = g_workers[w].local.load(), wt = g_workers[w].conns.load();
+        l += wl;
+        t += wt;
+        per += (w ? "," : "") + (g_workers[w].cpu < 0 ? std::string("*") : std::to_string(g_workers[w].cpu)) +
+               ':' + std::to_string(wl) + '/' + std::to_string(wt);
     }
+    return " cpu_local=" + std::to_string(l) + '/' + std::to_string(t) + " workers=" + per;
+}
+
+/* " fd_cache=open/hits/misses/evictions/invalidations" with --root ------ */
+static fd_cache* g_fd_cache = nullptr;
+static std::string fd_cache_line() {
+    if (!g_fd_cache) return std::string();
+    return " fd_cache=" + std::to_string(g_fd_cache->size()) + '/' + std::to_string(g_fd_cache->hits.load()) +
+           '/' + std::to_string(g_fd_cache->misses.load()) + '/' + std::to_string(g_fd_cache->evictions.load()) +
+           '/' + std::to_string(g_fd_cache->invalidations.load());
+}
+
+/* " catalog=files/updates/rescans" with --index ------------------------- */
+static live_catalog* g_catalog = nullptr;
+static std::string catalog_line() {
+    if (!g_catalog) return std::string();
+    return " catalog=" + std::to_string(g_catalog->snapshot()->size()) + '/' +
+           std::to_string(g_catalog->updates.load()) + '/' + std::to_string(g_catalog->rescans.load());
 }
 
-static void recv_exact(int fd, void* buf, size_t len) {
-    uint8_t* p = static_cast<uint8_t*>(buf);
-    while (len) {
-        ssize_t n = ::recv(fd, p, len, 0);
-        if (n == 0) { std::cerr << "[server] client closed early\n"; std::exit(1); }
-        if (n < 0) { if (errno == EINTR) continue; die("recv"); }
-        p += n; len -= n;
+/* " snapshots=clones/copies/reused/failed" with --snapshot -------------- */
+static snapshotter* g_snaps = nullptr;
+static std::string snapshot_line() {
+    if (!g_snaps) return std::string();
+    return " snapshots=" + std::to_string(g_snaps->clones.load()) + '/' + std::to_string(g_snaps->copies.load()) +
+           '/' + std::to_string(g_snaps->reused.load()) + '/' + std::to_string(g_snaps->failed.load());
+}
+
+static std::string log_drops_line();
+
+static std::string stats_line() {
+    uint64_t used = 0, total = 0;
+    heap_usage(used, total);
+    return "[server] stats accepted=" + std::to_string(g_stats.accepted.load()) +
+           " completed=" + std::to_string(g_stats.completed.load()) +
+           " dropped="   + std::to_string(g_stats.dropped.load()) +
+           " rejected="  + std::to_string(g_stats.rejected.load()) +
+           " active="    + std::to_string(g_stats.active.load()) +
+           " bytes="     + std::to_string(g_stats.bytes.load()) +
+           " cohorts="   + std::to_string(g_stats.cohorts.load()) +
+           " cohort_members=" + std::to_string(g_stats.cohort_members.load()) +
+           " refused="   + std::to_string(g_stats.refused.load()) +
+           " subs="      + std::to_string(g_stats.subscribers.load()) + '/' + std::to_string(g_stats.pushes.load()) +
+           '/' + std::to_string(g_stats.push_appends.load()) + fd_cache_line() + catalog_line() + snapshot_line() +
+           log_drops_line() +
+           (g_s3_source ? " s3_hits="    + std::to_string(g_stats.s3_hits.load()) +
+                          " s3_fetches=" + std::to_string(g_stats.s3_fetches.load()) +
+                          " s3_bytes="   + std::to_string(g_stats.s3_bytes.load())
+                        : std::string()) +
+           (g_uploads ? " uploads=" + std::to_string(g_stats.uploads.load()) + '/' +
+                            std::to_string(g_stats.upload_bytes.load())
+                      : std::string()) +
+           " heap_used=" + std::to_string(used) +
+           " heap_total=" + std::to_string(total) + locality_line();
+}
+
+/* ---------------------------------------------------------------------------
+   bg_writer: append‑only log file fed from the workers
+   ---------------------------------------------------------------------------
+   – append() copies a whole record into a pending buffer under a short lock
+     and never touches the disk; if the writer falls 16 MiB behind, records
+     are dropped and counted rather than stalling a transfer
+   – one thread swaps the buffer out and write()s it in one go, at most
+     every 200 ms, starting a new segment once the current one is full
+   – with rotate_bytes == 0 the path is used as is and never rotated
+   – a batch that can't be written (failed rotation, write error) is
+     dropped and counted like one that didn't fit
+   ------------------------------------------------------------------------- */
+class bg_writer {
+public:
+    bool open(const std::string& path, uint64_t rotate_bytes, const std::string& seg_header) {
+        path_   = path;
+        rotate_ = rotate_bytes;
+        header_ = seg_header;
+        if (!next_segment()) return false;
+        open_ = true;
+        th_   = std::thread(&bg_writer::run, this);
+        return true;
     }
+
+    /* fd_ belongs to the writer thread; workers only ask this */
+    bool is_open() const { return open_.load(std::memory_order_relaxed); }
+
+    void append(const void* p, size_t n) {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (pending_.size() + n > MAX_PENDING) { ++dropped_; return; }
+        pending_.append(static_cast<const char*>(p), n);
+        ++pending_n_;
+    }
+
+    /* write out whatever is pending and stop the thread (shutdown only) */
+    void close() {
+        if (!open_.exchange(false)) return;
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        th_.join();
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    static const size_t MAX_PENDING = 16u << 20;
+
+    bool next_segment() {
+        if (fd_ >= 0) ::close(fd_);
+        if (rotate_ == 0) {
+            fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        } else {
+            /* first unused PREFIX.NNNNNN, so a restart never overwrites */
+            do {
+                char suffix[16];
+                std::snprintf(suffix, sizeof(suffix), ".%06u", seq_++);
+                fd_ = ::open((path_ + suffix).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+            } while (fd_ < 0 && errno == EEXIST);
+        }
+        if (fd_ < 0) return false;
+        seg_bytes_ = 0;
+        return write_out(header_);
+    }
+
+    bool write_out(const std::string& buf) {
+        const char* p = buf.data();
+        size_t left = buf.size();
+        while (left) {
+            ssize_t n = ::write(fd_, p, left);
+            if (n < 0) { if (errno == EINTR) continue; return false; }
+            p += n; left -= n;
+        }
+        seg_bytes_ += buf.size();
+        return true;
+    }
+
+    void run() {
+        std::string batch;
+        uint64_t    records;
+        while (true) {
+            bool stop;
+            {
+                std::unique_lock<std::mutex> lk(mu_);
+                cv_.wait_for(lk, std::chrono::milliseconds(200));
+                batch.swap(pending_);
+                records    = pending_n_;
+                pending_n_ = 0;
+                stop       = stop_;
+            }
+            if (!batch.empty()) {
+                if (rotate_ && (fd_ < 0 || seg_bytes_ >= rotate_) && !next_segment())
+                    log_line("[server] log rotation failed: " + std::string(std::strerror(errno)));
+                if (fd_ < 0) {
+                    dropped_ += records;
+                } else if (!write_out(batch)) {
+                    log_line("[server] log write failed: " + std::string(std::strerror(errno)));
+                    dropped_ += records;
+                }
+                batch.clear();
+            }
+            if (stop) return;
+        }
+    }
+
+    std::string             path_, header_;
+    uint64_t                rotate_    = 0;
+    uint64_t                seg_bytes_ = 0;
+    unsigned                seq_       = 0;
+    int                     fd_        = -1;
+    std::mutex              mu_;
+    std::condition_variable cv_;
+    std::string             pending_;
+    uint64_t                pending_n_ = 0;     // records in pending_
+    bool                    stop_ = false;
+    std::atomic<bool>       open_{false};
+    std::atomic<uint64_t>   dropped_{0};
+    std::thread             th_;
+};
+
+static bg_writer g_capture_log;
+static bg_writer g_access_log;
+
+/* " log_dropped=capture/access" when either log is on --------------------- */
+static std::string log_drops_line() {
+    if (!g_capture_log.is_open() && !g_access_log.is_open()) return std::string();
+    return " log_dropped=" + std::to_string(g_capture_log.dropped()) + '/' + std::to_string(g_access_log.dropped());
 }
+static uint64_t  g_capture_t0 = 0;      // now_ns() at open; arrivals are relative
 
-/* length‑prefixed string helpers ---------------------------------------- */
-static void send_str(int fd, const std::string& s) {
-    uint32_t n = htonl(static_cast<uint32_t>(s.size()));
-    send_exact(fd, &n, 4);
-    if (!s.empty()) send_exact(fd, s.data(), s.size());
+static uint64_t wall_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
 }
 
-static std::string recv_str(int fd) {
-    uint32_t n = 0; recv_exact(fd, &n, 4); n = ntohl(n);
-    std::string s(n, '\0');
-    if (n) recv_exact(fd, &s[0], n);
-    return s;
+/* SIGUSR1 / SIGTERM / SIGINT are blocked everywhere and collected here, so
+   reports and shutdown run on a normal thread, not in a signal handler --- */
+static void signal_loop(sigset_t set) {
+    while (true) {
+        int sig = 0;
+        if (sigwait(&set, &sig) != 0) continue;
+        if (sig == SIGUSR1) { log_line(stats_line()); continue; }
+        g_capture_log.close();
+        g_access_log.close();
+        log_line("[server] shutting down");
+        _exit(0);                       // workers are mid‑syscall; skip static dtors
+    }
 }
 
-/* find a non‑loopback ipv4 address (handy for display) ------------------- */
-static std::string find_local_ip() {
+/* non‑loopback ipv4 addresses, in interface order (handy for display) --- */
+static std::vector<std::string> local_ips() {
+    std::vector<std::string> out;
     ifaddrs* ifaddr = nullptr;
-    if (getifaddrs(&ifaddr) == -1 || !ifaddr) return "127.0.0.1";
-    std::string best;
+    if (getifaddrs(&ifaddr) == -1 || !ifaddr) return out;
     for (ifaddrs* ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
         if (!ifa->ifa_addr) continue;
         if (ifa->ifa_addr->sa_family != AF_INET) continue;
@@ -114,26 +471,2119 @@ static std::string find_local_ip() {
 
         char ip[NI_MAXHOST] = {};
         if (getnameinfo(ifa->ifa_addr, sizeof(sockaddr_in), ip, sizeof(ip),
-                        nullptr, 0, NI_NUMERICHOST) == 0) {
-            best = ip;
+                        nullptr, 0, NI_NUMERICHOST) == 0)
+            out.push_back(ip);
+    }
+    freeifaddrs(ifaddr);
+    return out;
+}
+
+static std::string find_local_ip() {
+    std::vector<std::string> ips = local_ips();
+    return ips.empty() ? "127.0.0.1" : ips.front();
+}
+
+/* how file bytes leave the process --------------------------------------- */
+enum class io_mode { copy, sendfile };
+
+/* everything a worker needs; read‑only once the workers start ------------ */
+struct server_ctx {
+    std::string name;
+    std::string file_path;
+    int         fd   = -1;
+    uint64_t    size = 0;
+    io_mode     io   = io_mode::copy;
+    bool        mptcp = false;          // listener really is IPPROTO_MPTCP
+    /* s3://bucket/key source (fd stays -1) ----------------------------- */
+    std::string s3_bucket, s3_key;
+    s3_endpoint s3;
+    std::string s3_cache    = "s3cache";
+    int         s3_parallel = 8;
+    uint64_t    s3_part     = 8ull << 20;
+    /* --archive: member index of the file ------------------------------- */
+    std::unique_ptr<archive_index> archive;
+    /* --pack: mapped index and open packs ------------------------------- */
+    std::unique_ptr<pack_store>    pack;
+    /* --root: files under a directory, through the fd cache ------------- */
+    std::string                    root;
+    std::unique_ptr<fd_cache>      fds;
+    std::unique_ptr<live_catalog>  catalog;             // --index
+    std::unique_ptr<snapshotter>   snaps;               // --snapshot
+    compose_table                  composed;            // --compose
+};
+
+/* copy mode’s in‑memory file, when it fits the cache budget --------------
+   published with std::atomic_store; a transfer takes its own reference at
+   the start, so shrinking the budget frees the memory once the last
+   transfer using it is done                                               */
+typedef std::shared_ptr<const std::vector<char>> file_cache;
+static file_cache g_cache;
+
+static void cache_apply(const server_ctx& ctx) {
+    bool want = ctx.fd >= 0 && ctx.io == io_mode::copy && ctx.size <= relaxed(g_live.cache_budget);
+    bool have = static_cast<bool>(std::atomic_load(&g_cache));
+    if (want == have) return;
+    if (!want) {
+        std::atomic_store(&g_cache, file_cache());
+        if (log_on(LOG_INFO)) log_line("[server] file cache dropped");
+        return;
+    }
+    std::shared_ptr<std::vector<char>> buf = std::make_shared<std::vector<char>>(ctx.size);
+    for (uint64_t got = 0; got < ctx.size;) {
+        ssize_t n = ::pread(ctx.fd, &(*buf)[got], ctx.size - got, got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { log_line("[server] file cache load failed"); return; }
+        got += n;
+    }
+    std::atomic_store(&g_cache, file_cache(buf));
+    if (log_on(LOG_INFO)) log_line("[server] file cache loaded (" + std::to_string(ctx.size) + " bytes)");
+}
+
+/* ---------------------------------------------------------------------------
+   s3://bucket/key: read‑through disk cache in front of an object store
+   ---------------------------------------------------------------------------
+   the first request for an object HEADs it, creates <cache>/<name>.part.N at
+   full size and starts s3_fetch_run, which pulls the object with
+   --s3-parallel ranged GETs (If-Match: etag) of --s3-part bytes each,
+   pwrite()ing them in place. the sender streams from the .part file as the
+   contiguous prefix grows, so the client never waits for the whole object;
+   later requests for the same object join the same fetch. once complete
+   the file is renamed into place next to a .meta (etag, size) and served
+   straight from disk until a HEAD shows a different etag. no eviction:
+   size the disk for the working set.
+   ------------------------------------------------------------------------- */
+struct s3_fetch {
+    std::string            bucket, key, etag, tmp_path, path;
+    uint64_t               size = 0, part = 0;
+    std::vector<uint64_t>  got;                 // bytes landed per part
+    std::atomic<uint64_t>  ready{0};            // contiguous prefix on disk
+    std::atomic<bool>      failed{false};
+    std::mutex             mu;
+    std::condition_variable cv;
+
+    uint64_t part_len(size_t p) const { return std::min(part, size - p * part); }
+
+    /* a fetcher wrote part p up to `done` bytes ------------------------ */
+    void land(size_t p, uint64_t done) {
+        std::lock_guard<std::mutex> lk(mu);
+        got[p] = done;
+        size_t first = static_cast<size_t>(ready.load() / part);
+        while (first < got.size() && got[first] == part_len(first)) ++first;
+        ready = first < got.size() ? first * part + got[first] : size;
+        cv.notify_all();
+    }
+
+    void fail() {
+        std::lock_guard<std::mutex> lk(mu);
+        failed = true;
+        cv.notify_all();
+    }
+
+    /* sender side: block until [0, upto) is on disk; false if it never will */
+    bool wait(uint64_t upto) {
+        if (ready.load(std::memory_order_acquire) >= upto) return true;
+        std::unique_lock<std::mutex> lk(mu);
+        cv.wait(lk, [&] { return ready.load() >= upto || failed.load(); });
+        return ready.load() >= upto;
+    }
+};
+
+static std::mutex                                     g_s3_mu;
+static std::map<std::string, std::weak_ptr<s3_fetch>> g_s3_inflight;   // by cache path
+static std::atomic<uint64_t>                          g_s3_seq{0};
+
+static bool write_small(const std::string& path, const std::string& data) {
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool ok = ::write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    ::close(fd);
+    return ok && ::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+static std::string read_small(const std::string& path) {
+    std::string out;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return out;
+    char buf[512];
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n > 0) out.assign(buf, n);
+    ::close(fd);
+    return out;
+}
+
+static void s3_fetch_run(const server_ctx& ctx, std::shared_ptr<s3_fetch> f) {
+    uint64_t t0     = now_ns();
+    size_t   nparts = f->got.size();
+    int      wfd    = ::open(f->tmp_path.c_str(), O_WRONLY);
+    std::atomic<size_t> next{0};
+
+    /* each puller owns one keep‑alive connection and takes parts in
+       order, so the low parts (what clients read first) land first ----- */
+    auto pull = [&]() {
+        s3_conn conn(ctx.s3);
+        for (size_t p; !f->failed && (p = next++) < nparts;) {
+            uint64_t start = p * f->part, len = f->part_len(p), done = 0;
+            for (int attempt = 0; done < len && !f->failed; ++attempt) {
+                if (attempt == 3) { f->fail(); return; }
+                s3_response r;
+                conn.get(f->bucket, f->key, start + done, len - done, f->etag, r,
+                         [&](const char* b, size_t n) {
+                             while (n) {
+                                 ssize_t w = ::pwrite(wfd, b, n, start + done);
+                                 if (w < 0 && errno == EINTR) continue;
+                                 if (w <= 0) return false;
+                                 b += w; n -= w; done += w;
+                             }
+                             g_stats.s3_bytes += done - f->got[p];
+                             f->land(p, done);
+                             return true;
+                         });
+                if (r.status == 404 || r.status == 412) { f->fail(); return; }   // gone or replaced
+            }
+        }
+    };
+    if (wfd < 0) {
+        f->fail();
+    } else {
+        std::vector<std::thread> pullers;
+        size_t n = std::min<size_t>(static_cast<size_t>(std::max(ctx.s3_parallel, 1)), nparts);
+        for (size_t i = 1; i < n; ++i) pullers.emplace_back(pull);
+        pull();
+        for (auto& t : pullers) t.join();
+    }
+
+    bool ok = !f->failed && wfd >= 0 && ::fdatasync(wfd) == 0 &&
+              ::rename(f->tmp_path.c_str(), f->path.c_str()) == 0 &&
+              write_small(f->path + ".meta", f->etag + '\n' + std::to_string(f->size) + '\n');
+    if (wfd >= 0) ::close(wfd);
+    if (!ok) {
+        f->fail();
+        ::unlink(f->tmp_path.c_str());
+    }
+    {
+        std::lock_guard<std::mutex> lk(g_s3_mu);
+        auto it = g_s3_inflight.find(f->path);
+        if (it != g_s3_inflight.end() && it->second.lock() == f) g_s3_inflight.erase(it);
+    }
+    double secs = (now_ns() - t0) / 1e9;
+    if (!ok)
+        log_line("[server] s3 fetch of " + f->bucket + '/' + f->key + " failed");
+    else if (log_on(LOG_INFO))
+        log_line("[server] s3 fetched " + f->bucket + '/' + f->key + " (" + std::to_string(f->size) +
+                 " bytes, " + std::to_string(nparts) + " parts, " +
+                 std::to_string(secs > 0 ? static_cast<uint64_t>(f->size / secs / 1e6) : 0) + " MB/s)");
+}
+
+/* what one transfer sends: `size` bytes of `fd` from `off`. the default
+   file is ctx.fd; a file opened for the transfer (or shared through the fd
+   cache) rides along in `file`, which closes it once nobody holds it.
+   while an object is still arriving from the store, `fetch` holds the
+   sender back to what is already on disk. a composed file has no fd of
+   its own: `parts` maps each range to its sources. `follow` names the file
+   on disk a subscriber is kept current with, if there is one. for a "put"
+   the bytes flow the other way: fd is an unnamed file that becomes
+   `upload` once the client has sent all `size` bytes. a probe sends the
+   `wrap` bytes of fd over and over, for `size` bytes or `for_ns`. a grep
+   is no range at all: `grep` scans its source as it sends ------------- */
+struct grep_scan;
+struct content {
+    std::string                path;    // reported to the client
+    int                        fd   = -1;
+    std::shared_ptr<open_file> file;
+    std::shared_ptr<const composed_file> parts;   // --compose: fd unused
+    uint64_t                   off  = 0;
+    uint64_t                  size = 0;
+    std::shared_ptr<s3_fetch> fetch;
+    std::string               error;    // non‑empty: refuse with this
+    std::string               follow;
+    std::string               upload;
+    uint64_t                  wrap   = 0;
+    uint64_t                  for_ns = 0;
+    std::shared_ptr<const grep_scan> grep;
+};
+
+/* take ownership of a freshly opened fd ---------------------------------- */
+static void hold_fd(content& c, int fd) {
+    c.file     = std::make_shared<open_file>();
+    c.file->fd = fd;
+    c.fd       = fd;
+}
+
+static content s3_open(const server_ctx& ctx, const std::string& key) {
+    content c;
+    c.path = "s3://" + ctx.s3_bucket + '/' + key;
+    s3_conn     conn(ctx.s3);
+    s3_response r;
+    if (!conn.head(ctx.s3_bucket, key, r)) { c.error = "object store unreachable"; return c; }
+    if (r.status == 404) { c.error = "no such object " + c.path; return c; }
+    if (r.status != 200) { c.error = "object store answered " + std::to_string(r.status); return c; }
+    c.size = r.length;
+    std::string etag = r.headers["etag"];
+    std::string path = ctx.s3_cache + '/' + uri_encode(ctx.s3_bucket + '/' + key, false);
+
+    std::lock_guard<std::mutex> lk(g_s3_mu);
+    auto it = g_s3_inflight.find(path);
+    std::shared_ptr<s3_fetch> f = it == g_s3_inflight.end() ? nullptr : it->second.lock();
+    if (f && f->etag == etag && !f->failed) {                  // join the running fetch
+        int fd = ::open(f->tmp_path.c_str(), O_RDONLY);
+        if (fd >= 0) { hold_fd(c, fd); c.fetch = f; return c; }
+    }
+    if (read_small(path + ".meta") == etag + '\n' + std::to_string(c.size) + '\n') {
+        int fd = ::open(path.c_str(), O_RDONLY);               // cache hit
+        if (fd >= 0) { hold_fd(c, fd); ++g_stats.s3_hits; return c; }
+    }
+
+    f = std::make_shared<s3_fetch>();
+    f->bucket   = ctx.s3_bucket;
+    f->key      = key;
+    f->etag     = etag;
+    f->size     = c.size;
+    f->part     = std::max<uint64_t>(ctx.s3_part, 1);
+    f->path     = path;
+    f->tmp_path = path + ".part." + std::to_string(++g_s3_seq);
+    f->got.assign(static_cast<size_t>((c.size + f->part - 1) / f->part), 0);
+    ::unlink((path + ".meta").c_str());
+    int wfd = ::open(f->tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (wfd < 0 || ::ftruncate(wfd, static_cast<off_t>(c.size)) < 0) {
+        if (wfd >= 0) ::close(wfd);
+        c.error = "cannot create cache file";
+        return c;
+    }
+    ::close(wfd);
+    int fd = ::open(f->tmp_path.c_str(), O_RDONLY);
+    if (fd < 0) { c.error = "cannot open cache file"; return c; }
+    hold_fd(c, fd);
+    c.fetch = f;
+    g_s3_inflight[path] = f;
+    ++g_stats.s3_fetches;
+    std::thread(s3_fetch_run, std::cref(ctx), f).detach();
+    return c;
+}
+
+/* --archive: a member is a slice of the archive, sent as it lies ------- */
+static content archive_open(const server_ctx& ctx, const std::string& name) {
+    content c;
+    c.path = ctx.file_path + "!/" + name;
+    const archive_member* m = ctx.archive->find(name);
+    if (!m) { c.error = "no such member " + c.path; return c; }
+    if (m->method != ARC_STORED) {
+        c.error = "member " + name + " is compressed (zip method " + std::to_string(m->method) +
+                  "); only stored members are served";
+        return c;
+    }
+    c.fd   = ctx.fd;
+    c.off  = m->off;
+    c.size = m->size;
+    return c;
+}
+
+/* --pack: one hash probe in the mapped index, then a slice of a pack
+   that is already open – no path lookup or open() per request --------- */
+static content pack_open(const server_ctx& ctx, const std::string& key) {
+    content c;
+    c.path = "pack:" + key;
+    const pack_slot* s = ctx.pack->find(key);
+    if (!s) { c.error = "no such key " + key; return c; }
+    c.fd   = ctx.pack->pack_fd(s->pack);
+    c.off  = s->off;
+    c.size = s->size;
+    return c;
+}
+
+/* --snapshot: send the version of the whole file at `path` as it is now;
+   if none can be taken the live file goes out as before                  */
+static void snapshot_content(const server_ctx& ctx, content& c, const std::string& path) {
+    if (!ctx.snaps) return;
+    std::shared_ptr<open_file> s = ctx.snaps->take(path, c.fd);
+    if (!s) return;
+    c.file = s;
+    c.fd   = s->fd;
+    c.off  = 0;
+    c.size = s->size;
+}
+
+/* --root: PATH relative to DIR, no way out of it ------------------------- */
+static bool root_path_ok(const std::string& rel) {
+    for (size_t at = 0; at <= rel.size();) {
+        size_t slash = rel.find('/', at);
+        if (slash == std::string::npos) slash = rel.size();
+        std::string part = rel.substr(at, slash - at);
+        if (part.empty() || part == "." || part == "..") return false;
+        at = slash + 1;
+    }
+    return true;
+}
+
+static content root_open(const server_ctx& ctx, const std::string& rel) {
+    content c;
+    c.path = rel;
+    if (!root_path_ok(rel)) { c.error = "bad path " + rel; return c; }
+    if (ctx.catalog && !ctx.catalog->snapshot()->find(rel)) { c.error = "no such file " + rel; return c; }
+    c.file = ctx.fds->acquire(ctx.root + '/' + rel);
+    if (!c.file) { c.error = "no such file " + rel; return c; }
+    c.fd     = c.file->fd;
+    c.size   = c.file->size;
+    c.follow = ctx.root + '/' + rel;
+    snapshot_content(ctx, c, c.follow);
+    return c;
+}
+
+/* --index: walk --root again and publish the result as one version ------ */
+static std::string catalog_rebuild(const server_ctx& ctx) {
+    catalog_stats st;
+    if (!ctx.catalog->rebuild(st)) return "error: cannot read " + ctx.root;
+    double secs = st.ns / 1e9;
+    return "indexed " + std::to_string(st.files) + " files (" + std::to_string(st.dirs) + " dirs" +
+           (st.errors ? ", " + std::to_string(st.errors) + " unreadable" : std::string()) + ") in " +
+           std::to_string(st.ns / 1000000) + " ms on " + std::to_string(ctx.catalog->threads()) + " threads (" +
+           std::to_string(static_cast<uint64_t>(secs > 0 ? st.files / secs : 0)) + " files/s)";
+}
+
+/* a reply built here (a listing) goes out of a memfd -------------------- */
+struct memfd_reply {
+    std::shared_ptr<open_file> f = std::make_shared<open_file>();
+    std::string                buf;
+    bool                       ok;
+
+    explicit memfd_reply(const char* name) { f->fd = ::memfd_create(name, MFD_CLOEXEC); ok = f->fd >= 0; }
+
+    void add(const char* p, size_t n) {
+        buf.append(p, n);
+        if (buf.size() >= 65536) flush();
+    }
+    void flush() {
+        ok = ok && ::write(f->fd, buf.data(), buf.size()) == static_cast<ssize_t>(buf.size());
+        f->size += buf.size();
+        buf.clear();
+    }
+    /* c sends what was added; false (and errno) if it could not be kept */
+    bool finish(content& c) {
+        flush();
+        if (!ok) return false;
+        c.file = f;
+        c.fd   = f->fd;
+        c.size = f->size;
+        return true;
+    }
+};
+
+/* --index: "list PREFIX" / "glob PATTERN" → "SIZE PATH\n" lines from the
+   catalog's trie, sent from a memfd like any file. a glob (see
+   fnmatch, '*' stays within one directory) walks only the subtree of its
+   literal prefix                                                         */
+static content listing_open(const server_ctx& ctx, const std::string& query) {
+    content c;
+    c.path = query;
+    if (!ctx.catalog) { c.error = "\"list\" and \"glob\" need --root DIR --index"; return c; }
+    bool        glob   = query.compare(0, 5, "glob ") == 0;
+    std::string arg    = query.size() > 5 ? query.substr(5) : std::string();
+    std::string prefix = glob ? arg.substr(0, arg.find_first_of("*?[\\")) : arg;
+
+    memfd_reply out("listing");
+    ctx.catalog->snapshot()->list(prefix, [&](const std::string& path, const catalog_entry& e) {
+        if (glob && ::fnmatch(arg.c_str(), path.c_str(), FNM_PATHNAME) != 0) return;
+        std::string line = std::to_string(e.size) + ' ' + path + '\n';
+        out.add(line.data(), line.size());
+    });
+    if (!out.finish(c)) c.error = std::string("cannot build listing: ") + std::strerror(errno);
+    return c;
+}
+
+/* "lines N-M": narrow c to those lines. the index is built on first use
+   and kept per file version (and byte range, for pack or archive slices) */
+typedef std::tuple<uint64_t, uint64_t, uint64_t, uint64_t, uint64_t> line_key;  // dev ino mtime off size
+static std::mutex                                              g_lines_mu;
+static std::map<line_key, std::shared_ptr<const line_index>>   g_lines;
+
+static void lines_slice(content& c, const std::string& range) {
+    if (!c.error.empty()) return;
+    if (c.parts || c.fetch || c.fd < 0) { c.error = "line ranges need a file that is all on disk"; return; }
+    /* digits only on each side: strtoull alone takes "-3" and " 5" too */
+    size_t      dash = range.find('-');
+    std::string lo   = range.substr(0, dash), hi = dash == std::string::npos ? lo : range.substr(dash + 1);
+    auto digits = [](const std::string& t) { return t.find_first_not_of("0123456789") == std::string::npos; };
+    errno          = 0;
+    uint64_t first = lo.empty() || !digits(lo) ? 0 : std::strtoull(lo.c_str(), nullptr, 10);
+    uint64_t last  = hi.empty() ? UINT64_MAX : digits(hi) ? std::strtoull(hi.c_str(), nullptr, 10) : 0;
+    if (errno || first < 1 || last < first) { c.error = "bad line range '" + range + "' (want N, N-M or N-)"; return; }
+
+    open_file id;
+    if (!file_identity("", c.fd, id)) { c.error = "cannot stat " + c.path; return; }
+    line_key                          k(id.dev, id.ino, id.mtime_ns, c.off, c.size);
+    std::shared_ptr<const line_index> idx;
+    {
+        std::lock_guard<std::mutex> lk(g_lines_mu);
+        auto it = g_lines.find(k);
+        if (it != g_lines.end()) idx = it->second;
+    }
+    if (!idx) {
+        uint64_t t0 = now_ns();
+        if (!(idx = line_index_build(c.fd, c.off, c.size))) { c.error = "cannot read " + c.path; return; }
+        if (log_on(LOG_DEBUG))
+            log_line("[server] line index for " + c.path + ": " + std::to_string(idx->lines) + " lines in " +
+                     std::to_string((now_ns() - t0) / 1000) + " us");
+        std::lock_guard<std::mutex> lk(g_lines_mu);
+        if (g_lines.size() >= 256) g_lines.clear();
+        g_lines[k] = idx;
+    }
+    uint64_t a = 0, b = 0;
+    if (!line_start(c.fd, c.off, *idx, first, a) ||
+        !line_start(c.fd, c.off, *idx, last > idx->lines ? idx->lines + 1 : last + 1, b)) {
+        c.error = "cannot read " + c.path;
+        return;
+    }
+    c.path += ':' + range;
+    c.off += a;
+    c.size = b - a;
+}
+
+static content resolve_content(const server_ctx& ctx, const std::string& query);
+
+static const char*  g_grep_isa  = "";
+static grep_find_fn g_grep_find = grep_pick(g_grep_isa);
+
+/* "grep": the source and the needle; send_grep reads the one and sends
+   the lines holding the other as it finds them, so the reply is
+   open‑ended (size UINT64_MAX, v2 frames only) and memory stays at one
+   read buffer however much matches ------------------------------------- */
+struct grep_scan {
+    content     src;
+    std::string text;
+};
+
+static content grep_open(const server_ctx& ctx, const std::string& query) {
+    std::string text = query.substr(5), name;
+    if (text.compare(0, 5, "--in ") == 0) {
+        size_t sp = text.find(' ', 5);
+        name = text.substr(5, sp == std::string::npos ? sp : sp - 5);
+        text = sp == std::string::npos ? std::string() : text.substr(sp + 1);
+    }
+    content src = resolve_content(ctx, name.empty() ? std::string() : "get " + name);
+    if (!src.error.empty()) return src;
+    content c;
+    c.path = query;
+    if (text.empty() || text.find('\n') != std::string::npos) { c.error = "grep needs one line of text"; return c; }
+    if (src.parts || src.fetch || src.fd < 0) { c.error = "grep needs a file that is all on disk"; return c; }
+    std::shared_ptr<grep_scan> g = std::make_shared<grep_scan>();
+    g->src  = src;
+    g->text = text;
+    c.grep  = g;
+    c.size  = UINT64_MAX;                               // open‑ended: the scan ends it
+    return c;
+}
+
+/* "put SIZE NAME" (--uploads): an unnamed file in NAME's directory, with
+   its blocks allocated up front so a full disk says so before the first
+   byte moves rather than halfway through --------------------------------- */
+static content upload_open(const server_ctx& ctx, const std::string& query) {
+    content            c;
+    std::istringstream in(query.substr(4));
+    std::string        size_s, rel;
+    in >> size_s;
+    std::getline(in >> std::ws, rel);
+    c.path = rel;
+    if (!g_uploads) { c.error = "uploads are off (server --uploads)"; return c; }
+    errno  = 0;
+    c.size = std::strtoull(size_s.c_str(), nullptr, 10);        // digits only: no sign, no "-1"
+    if (size_s.empty() || size_s.find_first_not_of("0123456789") != std::string::npos || errno || rel.empty()) {
+        c.error = "want put SIZE NAME";
+        return c;
+    }
+    if (g_upload_max && c.size > g_upload_max) {
+        c.error = "uploads are " + std::to_string(g_upload_max) + " bytes at most";
+        return c;
+    }
+    if (!root_path_ok(rel)) { c.error = "bad path " + rel; return c; }
+    c.upload        = ctx.root + '/' + rel;
+    std::string dir = c.upload.substr(0, c.upload.rfind('/'));
+    int         fd  = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        c.error = errno == ENOENT ? "no directory for " + rel : "cannot write under " + dir + ": " + std::strerror(errno);
+        return c;
+    }
+    hold_fd(c, fd);
+    struct statvfs vfs;
+    if (c.size && ::fstatvfs(fd, &vfs) == 0 && vfs.f_frsize && c.size / vfs.f_frsize >= vfs.f_bavail) {
+        c.error = "no room for " + std::to_string(c.size) + " bytes under " + dir;
+        return c;
+    }
+    /* only a filesystem without preallocation may skip it */
+    if (c.size && ::fallocate(fd, 0, 0, static_cast<off_t>(c.size)) < 0 && errno != EOPNOTSUPP)
+        c.error = errno == ENOSPC ? "no room for " + std::to_string(c.size) + " bytes under " + dir
+                                  : "cannot reserve " + std::to_string(c.size) + " bytes under " + dir + ": " +
+                                        std::strerror(errno);
+    return c;
+}
+
+/* "probe 1g" / "probe 10s": a memfd of PROBE_BLOCK pseudo‑random bytes
+   (incompressible, so nothing on the path can shrink them) stored twice,
+   so any frame read at off % PROBE_BLOCK is contiguous; sendfile takes it
+   from the page cache like any file and memory stays at 2 × 16 MiB ------ */
+static const uint64_t PROBE_BLOCK    = V2_MAX_FRAME;
+static const uint64_t PROBE_MAX_SECS = 600;
+
+static bool parse_size(const std::string& s, uint64_t& v);
+
+static int probe_fd_make() {
+    int fd = ::memfd_create("probe", MFD_CLOEXEC);
+    if (fd < 0) return -1;
+    std::vector<uint64_t> block(PROBE_BLOCK / 8);
+    uint64_t              x = 0x9e3779b97f4a7c15ull;
+    for (uint64_t& w : block) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        w = x;
+    }
+    for (int copy = 0; copy < 2; ++copy)
+        if (::pwrite(fd, block.data(), PROBE_BLOCK, static_cast<off_t>(copy * PROBE_BLOCK)) !=
+            static_cast<ssize_t>(PROBE_BLOCK)) {
+            ::close(fd);
+            return -1;
+        }
+    return fd;
+}
+
+static content probe_open(const std::string& query) {
+    static const int fd = probe_fd_make();
+    content     c;
+    std::string spec = query.substr(6);
+    c.path = "probe " + spec;
+    uint64_t n = 0;
+    size_t   unit = spec.size() > 2 && spec.compare(spec.size() - 2, 2, "ms") == 0 ? 2
+                  : spec.size() > 1 && spec.back() == 's' ? 1 : 0;
+    if (unit) {
+        char* end = nullptr;
+        n = std::strtoull(spec.c_str(), &end, 10);
+        if (end != spec.c_str() + spec.size() - unit || !n) { c.error = "probe wants BYTES or a time like 10s or 500ms"; return c; }
+        c.for_ns = n * (unit == 2 ? 1000000ull : 1000000000ull);
+        if (c.for_ns > PROBE_MAX_SECS * 1000000000ull) { c.error = "probe runs " + std::to_string(PROBE_MAX_SECS) + " s at most"; return c; }
+        c.size = UINT64_MAX;                            // open‑ended: time ends it
+    } else if (!parse_size(spec, n) || !n) {
+        c.error = "probe wants BYTES or a time like 10s or 500ms";
+        return c;
+    } else {
+        c.size = n;
+    }
+    if (fd < 0) { c.error = "no memory for the probe data"; return c; }
+    c.fd   = fd;
+    c.wrap = PROBE_BLOCK;
+    return c;
+}
+
+/* does the query name anything but <file>? (anything else, the default
+   "Query file name" included, means <file>) ----------------------------- */
+static bool query_selects(const std::string& query) {
+    for (const char* kind : { "get ", "put ", "probe ", "lines ", "grep ", "list ", "glob " })
+        if (query.compare(0, std::strlen(kind), kind) == 0) return true;
+    return query == "list";
+}
+
+/* the client's query → what to send. "get NAME" names a --compose file
+   first, else an object in the bucket, a member of the archive, a key in
+   the pack store or a file under --root; anything else is the file (or
+   object) the server was started on                                      */
+static content resolve_content(const server_ctx& ctx, const std::string& query) {
+    if (query.compare(0, 4, "put ") == 0) return upload_open(ctx, query);
+    if (query.compare(0, 6, "probe ") == 0) return probe_open(query);
+    if (query.compare(0, 6, "lines ") == 0) {
+        std::istringstream in(query.substr(6));
+        std::string        range, name;
+        in >> range;
+        std::getline(in >> std::ws, name);
+        content c = resolve_content(ctx, name.empty() ? std::string() : "get " + name);
+        lines_slice(c, range);
+        return c;
+    }
+    if (query.compare(0, 5, "grep ") == 0) return grep_open(ctx, query);
+    std::string key;
+    if (query.compare(0, 4, "get ") == 0) key = query.substr(4);
+    if (query == "list" || query.compare(0, 5, "list ") == 0 || query.compare(0, 5, "glob ") == 0)
+        return listing_open(ctx, query);
+    if (!key.empty() && ctx.composed.count(key)) {
+        content c;
+        c.path  = key;
+        c.parts = ctx.composed.find(key)->second;
+        c.size  = c.parts->size;
+        return c;
+    }
+    if (!ctx.s3_bucket.empty()) return s3_open(ctx, key.empty() ? ctx.s3_key : key);
+    if (ctx.archive && !key.empty()) return archive_open(ctx, key);
+    if (ctx.pack && !key.empty()) return pack_open(ctx, key);
+    if (ctx.fds && !key.empty()) return root_open(ctx, key);
+    content c;
+    if (!key.empty()) {
+        c.error = ctx.composed.empty() ? "\"get\" needs an s3:// source, --archive, --pack, --root or --compose"
+                                       : "no such file " + key;
+        return c;
+    }
+    c.path   = ctx.file_path;
+    c.fd     = ctx.fd;
+    c.size   = ctx.size;
+    c.follow = ctx.file_path;
+    snapshot_content(ctx, c, ctx.file_path);
+    return c;
+}
+
+/* per‑transfer state: the tunables and cache as they were when it began -- */
+struct xfer {
+    const server_ctx& ctx;
+    const content&    c;
+    file_cache        cache;            // only for the default file
+    size_t            frame;
+    uint64_t          t_body;
+    std::vector<char> buf;              // copy mode without a cache: pread target
+
+    xfer(const server_ctx& cx, const content& ct)
+        : ctx(cx), c(ct), cache(ct.fd == cx.fd && !ct.parts ? std::atomic_load(&g_cache) : file_cache()),
+          frame(relaxed(g_live.frame)), t_body(now_ns()) {}
+
+    /* where body offset off lies in c.fd (a probe repeats its bytes) ---- */
+    uint64_t at(uint64_t off) const { return c.off + (c.wrap ? off % c.wrap : off); }
+};
+
+static bool pread_full(int fd, char* p, size_t n, uint64_t off) {
+    for (size_t got = 0; got < n;) {
+        ssize_t r = ::pread(fd, p + got, n - got, static_cast<off_t>(off + got));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        got += r;
+    }
+    return true;
+}
+
+/* ---------------------------------------------------------------------------
+   the transfer loop, specialised per connection
+   ---------------------------------------------------------------------------
+   send_loop<Framing, Io> exists once for every framing × i/o pair, and
+   send_body picks the pair when a transfer starts – so the frame size,
+   header layout and the way body bytes reach the socket are fixed at
+   compile time and the per‑frame path has no mode tests left in it.
+
+   a framing policy gives the payload bytes per frame and writes a frame's
+   header. an i/o policy sends one header plus n body bytes from body
+   offset off, and says whether it needs the transfer's buffer:
+     sendfile_io          header corked with MSG_MORE, then sendfile, so
+                          both leave in the same segment
+     cached_io            header and body (copy mode's in‑memory file) in
+                          one gathered sendmsg
+     pread_io             pread into the transfer's buffer, then as above
+     composed_sendfile_io --compose: a frame may span segments; one
+     composed_copy_io     sendfile per piece, or the pieces gathered into
+                          the buffer
+   a new backend is one more struct with send() and a line in send_body.
+   ------------------------------------------------------------------------- */
+struct legacy_framing {
+    static size_t payload(const xfer&) { return LEGACY_CHUNK; }
+    static size_t header(char* h, size_t) {
+        h[0] = FLAG_LEGACY;
+        return 1;
+    }
+};
+
+struct v2_framing {
+    static size_t payload(const xfer& x) { return x.frame; }
+    static size_t header(char* h, size_t n) {
+        uint32_t len = htonl(static_cast<uint32_t>(n));
+        h[0] = FLAG_V2;
+        std::memcpy(h + 1, &len, 4);
+        return 5;
+    }
+};
+
+static bool send_gathered(int cfd, const char* hdr, size_t hlen, const char* body, size_t n) {
+    iovec iov[2];
+    iov[0].iov_base = const_cast<char*>(hdr);
+    iov[0].iov_len  = hlen;
+    iov[1].iov_base = const_cast<char*>(body);
+    iov[1].iov_len  = n;
+    return sendv_all(cfd, iov, 2);
+}
+
+struct sendfile_io {
+    static const bool buffered = false;
+    static bool send(int cfd, xfer& x, const char* hdr, size_t hlen, uint64_t off, size_t n) {
+        return send_all(cfd, hdr, hlen, MSG_MORE) && sendfile_all(cfd, x.c.fd, x.at(off), n);
+    }
+};
+
+struct cached_io {
+    static const bool buffered = false;
+    static bool send(int cfd, xfer& x, const char* hdr, size_t hlen, uint64_t off, size_t n) {
+        return send_gathered(cfd, hdr, hlen, &(*x.cache)[x.at(off)], n);
+    }
+};
+
+struct pread_io {
+    static const bool buffered = true;
+    static bool send(int cfd, xfer& x, const char* hdr, size_t hlen, uint64_t off, size_t n) {
+        return pread_full(x.c.fd, x.buf.data(), n, x.at(off)) && send_gathered(cfd, hdr, hlen, x.buf.data(), n);
+    }
+};
+
+struct composed_sendfile_io {
+    static const bool buffered = false;
+    static bool send(int cfd, xfer& x, const char* hdr, size_t hlen, uint64_t off, size_t n) {
+        return send_all(cfd, hdr, hlen, MSG_MORE) &&
+               x.c.parts->each(off, n, [cfd](int fd, uint64_t at, uint64_t len) { return sendfile_all(cfd, fd, at, len); });
+    }
+};
+
+struct composed_copy_io {
+    static const bool buffered = true;
+    static bool send(int cfd, xfer& x, const char* hdr, size_t hlen, uint64_t off, size_t n) {
+        char* p = x.buf.data();
+        return x.c.parts->each(off, n, [&p](int fd, uint64_t at, uint64_t len) {
+                   bool ok = pread_full(fd, p, static_cast<size_t>(len), at);
+                   p += len;
+                   return ok;
+               }) &&
+               send_gathered(cfd, hdr, hlen, x.buf.data(), n);
+    }
+};
+
+/* --rate: sleep until `sent` bytes are no longer ahead of the budget ----- */
+static void pace(const xfer& x, uint64_t sent) {
+    uint64_t rate = relaxed(g_live.rate_bps);
+    if (!rate) return;
+    uint64_t due = x.t_body + sent * 1000000000ull / rate;
+    uint64_t now = now_ns();
+    if (due > now) std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+}
+
+/* whole body, then the termination pair ‘0’ ‘0’ ------------------------- */
+template <class Framing, class Io>
+static bool send_loop(int cfd, xfer& x, uint64_t& sent) {
+    const content& c    = x.c;
+    const size_t   step = Framing::payload(x);
+    const uint64_t stop = c.for_ns ? x.t_body + c.for_ns : 0;
+    if (Io::buffered) x.buf.resize(static_cast<size_t>(std::min<uint64_t>(step, c.size)));
+    while (sent < c.size && !(stop && now_ns() >= stop)) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(step, c.size - sent));
+        if (c.fetch && !c.fetch->wait(sent + n)) return false;
+        char   hdr[5];
+        size_t hlen = Framing::header(hdr, n);
+        if (!Io::send(cfd, x, hdr, hlen, sent, n)) return false;
+        sent += n;
+        pace(x, sent);
+    }
+    const char zeros[2] = { FLAG_END, FLAG_END };
+    return send_all(cfd, zeros, 2);
+}
+
+template <class Io>
+static bool send_framed(int cfd, xfer& x, bool v2, uint64_t& sent) {
+    return v2 ? send_loop<v2_framing, Io>(cfd, x, sent) : send_loop<legacy_framing, Io>(cfd, x, sent);
+}
+
+/* "grep": pread the source GREP_BUF at a time, the partial last line
+   carried over to the next read, and send the matching lines in v2 frames
+   as they pile up. a line may grow the buffer to GREP_MAX_LINE; one longer
+   than that is searched in pieces. a source truncated under us (a rotated
+   log) just ends the scan early ------------------------------------------ */
+static const size_t GREP_BUF      = 1u << 20;
+static const size_t GREP_MAX_LINE = V2_MAX_FRAME;
+
+static bool send_grep(int cfd, xfer& x, uint64_t& sent) {
+    const grep_scan&  g   = *x.c.grep;
+    const content&    src = g.src;
+    std::vector<char> in(GREP_BUF);
+    std::string       out;
+    size_t            have  = 0;                // bytes in `in`, the carried line first
+    uint64_t          off   = 0, lines = 0, t0 = now_ns();
+    bool              ok    = true;
+    auto emit  = [&out](const char* p, size_t n) {   // newline‑ended, as grep(1) does
+        out.append(p, n);
+        if (p[n - 1] != '\n') out += '\n';
+    };
+    auto flush = [&](bool all) {                // whole frames, or everything
+        size_t at = 0;
+        while (ok && (all ? at < out.size() : out.size() - at >= x.frame)) {
+            size_t n = std::min(out.size() - at, x.frame);
+            char   hdr[5];
+            ok = send_gathered(cfd, hdr, v2_framing::header(hdr, n), out.data() + at, n);
+            at   += n;
+            sent += n;
+            pace(x, sent);
+        }
+        out.erase(0, at);
+    };
+    while (ok && off < src.size) {
+        if (have == in.size()) {                // no '\n' in a full buffer
+            if (in.size() < GREP_MAX_LINE) {
+                in.resize(std::min(in.size() * 2, GREP_MAX_LINE));
+            } else {
+                lines += grep_lines(in.data(), have, g.text, g_grep_find, emit);
+                have = 0;
+            }
+        }
+        size_t  want = static_cast<size_t>(std::min<uint64_t>(in.size() - have, src.size - off));
+        ssize_t r    = ::pread(src.fd, in.data() + have, want, static_cast<off_t>(src.off + off));
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) { ok = false; break; }
+        if (r == 0) break;                      // shrank: what we have is all there is
+        const char* nl = static_cast<const char*>(::memrchr(in.data() + have, '\n', static_cast<size_t>(r)));
+        off  += r;
+        have += r;
+        if (!nl) continue;
+        size_t done = static_cast<size_t>(nl + 1 - in.data());
+        lines += grep_lines(in.data(), done, g.text, g_grep_find, emit);
+        std::memmove(in.data(), in.data() + done, have - done);
+        have -= done;
+        flush(false);
+    }
+    if (ok && have) lines += grep_lines(in.data(), have, g.text, g_grep_find, emit);
+    flush(true);
+    if (log_on(LOG_DEBUG)) {
+        uint64_t ns = std::max<uint64_t>(now_ns() - t0, 1);
+        log_line("[server] grep " + src.path + ": " + std::to_string(lines) + " lines of " + std::to_string(off) +
+                 " bytes in " + std::to_string(ns / 1000) + " us (" + std::to_string(off * 1000 / ns) + " MB/s, " +
+                 g_grep_isa + ")");
+    }
+    const char zeros[2] = { FLAG_END, FLAG_END };
+    return ok && send_all(cfd, zeros, 2);
+}
+
+/* whole body in the framing the client asked for, then the end pair ----- */
+static bool send_body(int cfd, const server_ctx& ctx, const content& c, bool v2, uint64_t& sent) {
+    xfer x(ctx, c);
+    bool zero_copy = ctx.io == io_mode::sendfile;
+    if (c.grep) {
+        if (v2) return send_grep(cfd, x, sent);
+        if (log_on(LOG_INFO)) log_line("[server] grep output is open‑ended; a legacy start can't frame it");
+        return false;
+    }
+    if (c.parts) return zero_copy ? send_framed<composed_sendfile_io>(cfd, x, v2, sent)
+                                  : send_framed<composed_copy_io>(cfd, x, v2, sent);
+    if (zero_copy) return send_framed<sendfile_io>(cfd, x, v2, sent);
+    if (x.cache)   return send_framed<cached_io>(cfd, x, v2, sent);
+    return send_framed<pread_io>(cfd, x, v2, sent);
+}
+
+/* what we learned about one connection, for stats and the capture log --- */
+struct conn_info {
+    uint64_t    t_accept_wall = 0;  // wall clock at accept, for the access log
+    uint64_t    t_accept = 0;       // now_ns() stamps; 0 = never got there
+    uint64_t    t_body   = 0;
+    uint64_t    t_done   = 0;
+    std::string client_name;
+    std::string query;
+    bool        v2   = false;
+    bool        subscribe = false;  // wants later versions pushed
+    uint64_t    size = 0;           // bytes offered in the metadata
+    uint64_t    sent = 0;           // file bytes pushed, finished or not
+    bool        refused = false;    // answered with an error instead of a file
+};
+
+/* --capture: one compact record per connection ----------------------------- */
+static bool capture_open(const std::string& path) {
+    g_capture_t0 = now_ns();
+    std::string hdr;
+    capture_header(hdr, wall_ns());
+    return g_capture_log.open(path, 0, hdr);
+}
+
+static void capture_conn(const conn_info& ci, bool ok) {
+    if (!g_capture_log.is_open()) return;
+    capture_rec r;
+    r.flags      = (ci.v2 ? CAP_V2 : 0) | (ok ? 0 : CAP_DROPPED);
+    r.arrival_ns = ci.t_accept - g_capture_t0;
+    r.size       = ci.size;
+    r.sent       = ci.sent;
+    if (ci.t_body && ci.t_done > ci.t_body)
+        r.read_bps = ci.sent * 1000000000ull / (ci.t_done - ci.t_body);
+    r.client = ci.client_name;
+    r.query  = ci.query;
+    std::string rec;
+    capture_encode(rec, r);
+    g_capture_log.append(rec.data(), rec.size());
+}
+
+/* --access-log: one fixed‑size record per connection ---------------------- */
+static bool access_open(const std::string& prefix, uint64_t rotate_bytes) {
+    access_seg_header h = access_make_header(wall_ns());
+    return g_access_log.open(prefix, rotate_bytes,
+                             std::string(reinterpret_cast<const char*>(&h), sizeof(h)));
+}
+
+static void access_conn(const sockaddr_in& peer, const conn_info& ci, bool ok) {
+    if (!g_access_log.is_open()) return;
+    access_rec r;
+    std::memset(&r, 0, sizeof(r));
+    r.ts_ns       = ci.t_accept_wall;
+    r.bytes       = ci.sent;
+    r.duration_ns = ci.t_done - ci.t_accept;
+    r.result      = ok ? ACC_OK : ci.refused ? ACC_REFUSED : ci.t_body ? ACC_DROP_BODY : ACC_DROP_HANDSHAKE;
+    r.flags       = ci.v2 ? ACC_V2 : 0;
+    if (peer.sin_family == AF_INET) {
+        r.peer_ip   = peer.sin_addr.s_addr;
+        r.peer_port = ntohs(peer.sin_port);
+    }
+    access_set(r.client, ci.client_name);
+    access_set(r.query, ci.query);
+    g_access_log.append(&r, sizeof(r));
+}
+
+/* handshake up to the client's start; false if the client went away or
+   asked for something we cannot serve. a refusal goes out in place of the
+   metadata as the path "error: why" with size 0, and we hang up          */
+static bool serve_handshake(int cfd, const server_ctx& ctx, conn_info& ci, content& c) {
+    /* handshake 1: get client name & query -------------------------- */
+    if (!recv_str(cfd, ci.client_name) || !recv_str(cfd, ci.query)) return false;
+    if (log_on(LOG_INFO)) log_line("[server] client says: " + ci.client_name);
+
+    c = resolve_content(ctx, ci.query);
+    if (!c.error.empty()) {
+        ci.refused = true;
+        if (log_on(LOG_INFO)) log_line("[server] refused: " + c.error);
+        uint64_t zero = 0;
+        send_str(cfd, ctx.name) && send_str(cfd, "error: " + c.error) && send_all(cfd, &zero, 8);
+        return false;
+    }
+
+    /* handshake 2: send metadata ----------------------------------- */
+    ci.size = c.size;
+    uint64_t netsize = host_to_be64(c.size);
+    if (!send_str(cfd, ctx.name) || !send_str(cfd, c.path) ||
+        !send_all(cfd, &netsize, 8))
+        return false;
+
+    /* wait for “start” from client --------------------------------- */
+    std::string start;
+    if (!recv_str(cfd, start)) return false;
+
+    ci.v2        = start == START_V2 || start == START_V2_SUB;
+    ci.subscribe = start == START_LEGACY_SUB || start == START_V2_SUB;
+    ci.t_body = now_ns();
+    return true;
+}
+
+/* stats, logs and close, once a connection is over (worker or cohort) --- */
+static void finish_conn(int cfd, const sockaddr_in& peer, conn_info& ci, bool ok,
+                        const server_ctx& ctx) {
+    ci.t_done = now_ns();
+    g_stats.bytes += ci.sent;
+    ++(ok ? g_stats.completed : ci.refused ? g_stats.refused : g_stats.dropped);
+    capture_conn(ci, ok);
+    access_conn(peer, ci, ok);
+    if (log_on(LOG_INFO)) {
+        std::string extra;
+        if (ctx.mptcp) {
+            int sf = mptcp_subflows(cfd);
+            extra = sf > 0 ? " (mptcp, " + std::to_string(sf) + " subflows)" : " (tcp fallback)";
+        }
+        log_line(ok ? "[server] done; closing connection" + extra
+                    : ci.refused ? "[server] closing connection" + extra
+                    : "[server] client dropped; closing connection" + extra);
+    }
+    ::close(cfd);
+    --g_stats.active;
+}
+
+/* ---------------------------------------------------------------------------
+   --cohort MS: one read of the file, many sockets
+   ---------------------------------------------------------------------------
+   v2 clients whose start arrives within MS of the first one form a cohort;
+   the worker hands the socket over and goes back to accept(). when the
+   window closes, a cohort thread splices each frame from the file into a
+   pipe once, tee()s it into a scratch pipe and splices that to every member
+   but the last, which gets the original – disk reads and user‑space copies
+   stay the same whatever the cohort size. the cohort moves at its slowest
+   member's pace; a member that errors is dropped and the rest carry on.
+   legacy‑framing clients are still served one by one.
+   ------------------------------------------------------------------------- */
+struct cohort_member {
+    int         fd = -1;
+    sockaddr_in peer{};
+    conn_info   ci;
+    bool        ok = true;
+};
+
+static std::mutex                 g_cohort_mu;
+static std::vector<cohort_member> g_cohort_forming;
+static uint32_t                   g_cohort_ms = 0;
+
+#if defined(__linux__)
+/* move exactly n bytes between fds with splice (one side must be a pipe);
+   *moved says how far it got, also on failure ---------------------------- */
+static bool splice_all(int in, loff_t* off, int out, size_t n, unsigned flags, size_t* moved = nullptr) {
+    if (moved) *moved = 0;
+    while (n) {
+        ssize_t k = ::splice(in, off, out, nullptr, n, SPLICE_F_MOVE | flags);
+        if (k < 0) { if (errno == EINTR) continue; return false; }
+        if (k == 0) { errno = EIO; return false; }
+        n -= k;
+        if (moved) *moved += k;
+    }
+    return true;
+}
+
+/* throw away what a failed member left in a pipe: exactly n bytes, which
+   must be there, or the read blocks on a pipe we hold both ends of ------- */
+static void drain_pipe(int rd, size_t n) {
+    char buf[4096];
+    while (n) {
+        ssize_t k = ::read(rd, buf, std::min(n, sizeof(buf)));
+        if (k <= 0) return;
+        n -= k;
+    }
+}
+
+static void cohort_run(const server_ctx& ctx) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(g_cohort_ms));
+    std::vector<cohort_member> m;
+    {
+        std::lock_guard<std::mutex> lk(g_cohort_mu);
+        m.swap(g_cohort_forming);
+    }
+    ++g_stats.cohorts;
+    g_stats.cohort_members += m.size();
+    if (log_on(LOG_INFO)) log_line("[server] cohort of " + std::to_string(m.size()) + " starting");
+
+    int src[2] = { -1, -1 }, dup[2] = { -1, -1 };
+    bool piped = ::pipe(src) == 0 && ::pipe(dup) == 0;
+    size_t chunk = relaxed(g_live.frame);
+    if (piped) {
+        int cap = ::fcntl(src[1], F_SETPIPE_SZ, static_cast<int>(std::min<size_t>(chunk, 1u << 20)));
+        ::fcntl(dup[1], F_SETPIPE_SZ, cap > 0 ? cap : 65536);
+        if (cap > 0) chunk = std::min<size_t>(chunk, static_cast<size_t>(cap));
+        else         chunk = std::min<size_t>(chunk, 65536);
+    }
+
+    uint64_t rate   = relaxed(g_live.rate_bps);
+    uint64_t t_body = now_ns();
+    loff_t   off    = 0;
+    size_t   live   = piped ? m.size() : 0;
+    for (auto& x : m) if (!piped) x.ok = false;
+    while (live && static_cast<uint64_t>(off) < ctx.size) {
+        size_t n = std::min<uint64_t>(chunk, ctx.size - off);
+        char hdr[5];
+        hdr[0] = FLAG_V2;
+        uint32_t len = htonl(static_cast<uint32_t>(n));
+        std::memcpy(hdr + 1, &len, 4);
+
+        /* the one disk read of this frame ------------------------------- */
+        if (!splice_all(ctx.fd, &off, src[1], n, SPLICE_F_MORE)) {
+            for (auto& x : m) x.ok = false;
             break;
         }
+        size_t last = m.size();
+        for (size_t i = m.size(); i-- > 0;) if (m[i].ok) { last = i; break; }
+        for (size_t i = 0; i < m.size(); ++i) {
+            cohort_member& x = m[i];
+            if (!x.ok) continue;
+            size_t moved = 0;
+            if (i == last) {                                    // gets the original
+                x.ok = send_all(x.fd, hdr, 5, MSG_MORE) &&
+                       splice_all(src[0], nullptr, x.fd, n, SPLICE_F_MORE, &moved);
+                if (!x.ok) drain_pipe(src[0], n - moved);
+            } else {
+                ssize_t t;
+                do { t = ::tee(src[0], dup[1], n, 0); } while (t < 0 && errno == EINTR);
+                size_t teed = t > 0 ? static_cast<size_t>(t) : 0;
+                x.ok = teed == n && send_all(x.fd, hdr, 5, MSG_MORE) &&
+                       splice_all(dup[0], nullptr, x.fd, n, SPLICE_F_MORE, &moved);
+                if (!x.ok) drain_pipe(dup[0], teed - moved);
+            }
+            if (x.ok) x.ci.sent += n;
+            else      --live;
+        }
+        if (rate) {
+            uint64_t due = t_body + static_cast<uint64_t>(off) * 1000000000ull / rate;
+            uint64_t now = now_ns();
+            if (due > now) std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+        }
     }
-    freeifaddrs(ifaddr);
-    return best.empty() ? "127.0.0.1" : best;
+    for (int fd : { src[0], src[1], dup[0], dup[1] }) if (fd >= 0) ::close(fd);
+
+    const char zeros[2] = { FLAG_END, FLAG_END };
+    for (auto& x : m) {
+        bool ok = x.ok && send_all(x.fd, zeros, 2);
+        finish_conn(x.fd, x.peer, x.ci, ok, ctx);
+    }
+}
+#endif
+
+/* the worker's part: queue the socket, start the window if we're first -- */
+static void cohort_join(int cfd, const sockaddr_in& peer, const conn_info& ci, const server_ctx& ctx) {
+#if defined(__linux__)
+    cohort_member x;
+    x.fd   = cfd;
+    x.peer = peer;
+    x.ci   = ci;
+    std::lock_guard<std::mutex> lk(g_cohort_mu);
+    g_cohort_forming.push_back(x);
+    if (g_cohort_forming.size() == 1) std::thread(cohort_run, std::cref(ctx)).detach();
+#else
+    (void)cfd; (void)peer; (void)ci; (void)ctx;
+#endif
+}
+
+/* ---------------------------------------------------------------------------
+   subscriptions ("Start sub", client --subscribe)
+   ---------------------------------------------------------------------------
+   after its transfer a subscriber's socket goes to the publisher thread,
+   which follows every subscribed file with a change_watch (pubsub.hpp) and
+   polls the idle sockets so a client that hangs up is let go at once. a
+   new version is opened (and snapshotted, with --snapshot) once for all
+   its subscribers: those holding the version it grew from get only the
+   appended bytes, the others the whole file. an update of up to SUB_SHARED
+   bytes is read and framed once and that buffer goes to every subscriber
+   on the same framing; a bigger one is framed per subscriber, SUB_SHARED
+   at a time, as its socket takes it. sockets are non‑blocking and every
+   busy one is polled for POLLOUT, so a slow subscriber only ever delays
+   itself; a version that comes while it is still busy is sent once it
+   is done. one whose socket takes nothing for SUB_SEND_TIMEOUT_S is
+   dropped.
+   ------------------------------------------------------------------------- */
+struct subscriber {
+    int         fd = -1;
+    sockaddr_in peer{};
+    conn_info   ci;
+    sub_version have;                   // what the client holds, or is being sent
+    /* the update on its way out ---------------------------------------- */
+    std::shared_ptr<const std::string> out;         // framed bytes; null = idle
+    size_t                             out_at = 0;
+    content                            src;         // a big update frames the rest from here
+    uint64_t                           next = 0, end = 0;
+    uint64_t                           body = 0;    // body bytes in this update
+    bool                               append = false;
+    bool                               behind = false;  // a newer version came while busy
+    uint64_t                           moved_ms = 0;    // last time the socket took bytes
+};
+
+static const uint64_t SUB_SHARED         = 256u << 10;
+static const int      SUB_SEND_TIMEOUT_S = 5;
+
+static std::mutex                                      g_sub_mu;
+static std::vector<std::pair<std::string, subscriber>> g_sub_joining;  // file, subscriber
+static int                                             g_sub_wake[2] = { -1, -1 };
+
+static void sub_drop(subscriber& s, bool ok, const server_ctx& ctx) {
+    --g_stats.subscribers;
+    finish_conn(s.fd, s.peer, s.ci, ok, ctx);
+    s.fd = -1;
+    s.out.reset();
+    s.src = content();
+}
+
+/* body [from, to) of fd as frames in the subscriber's framing, appended
+   to out; false on a read error ----------------------------------------- */
+static bool sub_frames(int fd, uint64_t from, uint64_t to, bool v2, std::string& out) {
+    std::string body(static_cast<size_t>(to - from), '\0');
+    if (!body.empty() && !pread_full(fd, &body[0], body.size(), from)) return false;
+    size_t step = v2 ? relaxed(g_live.frame) : LEGACY_CHUNK;
+    for (size_t b = 0; b < body.size(); b += step) {
+        size_t n = std::min(step, body.size() - b);
+        if (v2) {
+            uint32_t len = htonl(static_cast<uint32_t>(n));
+            out += FLAG_V2;
+            out.append(reinterpret_cast<const char*>(&len), 4);
+        } else {
+            out += FLAG_LEGACY;
+        }
+        out.append(body, b, n);
+    }
+    return true;
+}
+
+/* the next SUB_SHARED of a big update (and the end pair after the last);
+   legacy frames only end short at the very end, so whole chunks there -- */
+static bool sub_refill(subscriber& s, std::string& out) {
+    uint64_t span = s.ci.v2 ? SUB_SHARED : SUB_SHARED / LEGACY_CHUNK * LEGACY_CHUNK;
+    uint64_t to   = std::min(s.end, s.next + span);
+    if (!sub_frames(s.src.fd, s.next, to, s.ci.v2, out)) return false;
+    s.next = to;
+    if (s.next == s.end) {
+        out += FLAG_END;
+        out += FLAG_END;
+        s.src = content();
+    }
+    return true;
+}
+
+/* send what the socket takes now; false if the client is gone or the
+   update can't be read --------------------------------------------------- */
+static bool sub_pump(subscriber& s, uint64_t now_ms) {
+    while (s.out) {
+        while (s.out_at < s.out->size()) {
+            ssize_t n = ::send(s.fd, s.out->data() + s.out_at, s.out->size() - s.out_at, MSG_DONTWAIT);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            if (n <= 0) return false;
+            s.out_at  += n;
+            s.moved_ms = now_ms;
+        }
+        s.out.reset();
+        s.out_at = 0;
+        if (s.src.fd >= 0) {
+            std::string b;
+            if (!sub_refill(s, b)) return false;
+            s.out = std::make_shared<const std::string>(std::move(b));
+            continue;
+        }
+        s.ci.sent += s.body;                            // all of it is out
+        ++g_stats.pushes;
+        if (s.append) ++g_stats.push_appends;
+    }
+    return true;
+}
+
+/* bring every subscriber of path up to its current version; ones still
+   busy with an earlier one are marked and get it later ------------------- */
+static void sub_publish(const server_ctx& ctx, const std::string& path, std::vector<subscriber>& subs,
+                        uint64_t now_ms) {
+    uint64_t t0 = now_ns();
+    int      fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;                                 // gone for now; its return is an event too
+    content src;
+    hold_fd(src, fd);
+    open_file id;
+    if (!file_identity("", fd, id)) return;
+    src.size = id.size;
+    snapshot_content(ctx, src, path);
+    sub_version now;
+    now.dev      = id.dev;
+    now.ino      = id.ino;
+    now.size     = src.size;
+    now.mtime_ns = id.mtime_ns;
+    if (!sub_tail(src.fd, 0, now.size, now.tail)) return;
+
+    typedef std::tuple<uint64_t, uint64_t, uint64_t, uint64_t> held;     // dev, ino, size, mtime
+    std::map<held, bool>                                                 grew;    // `now` = that + new bytes?
+    std::map<std::pair<uint64_t, bool>, std::shared_ptr<const std::string>> framed;  // (from, v2) → update
+    uint64_t full = 0, appends = 0;
+    for (subscriber& s : subs) {
+        if (s.fd < 0 || s.have.same(now)) continue;
+        if (s.out) { s.behind = true; continue; }
+        held k(s.have.dev, s.have.ino, s.have.size, s.have.mtime_ns);
+        auto g = grew.find(k);
+        if (g == grew.end()) g = grew.insert(std::make_pair(k, sub_appended(src.fd, now, s.have))).first;
+        uint64_t from = g->second ? s.have.size : 0;
+
+        char hdr[18];
+        hdr[0] = FLAG_UPDATE;
+        hdr[1] = g->second ? UPDATE_APPEND : UPDATE_FULL;
+        uint64_t be_from = host_to_be64(from), be_size = host_to_be64(now.size);
+        std::memcpy(hdr + 2, &be_from, 8);
+        std::memcpy(hdr + 10, &be_size, 8);
+        bool ok = true;
+        if (now.size - from <= SUB_SHARED) {
+            std::shared_ptr<const std::string>& b = framed[std::make_pair(from, s.ci.v2)];
+            if (!b) {
+                std::string f(hdr, sizeof(hdr));
+                if (sub_frames(src.fd, from, now.size, s.ci.v2, f)) {
+                    f += FLAG_END;
+                    f += FLAG_END;
+                    b = std::make_shared<const std::string>(std::move(f));
+                }
+            }
+            s.out = b;
+            ok    = static_cast<bool>(b);
+        } else {
+            std::string f(hdr, sizeof(hdr));
+            s.src  = src;
+            s.next = from;
+            s.end  = now.size;
+            ok     = sub_refill(s, f);
+            s.out  = std::make_shared<const std::string>(std::move(f));
+        }
+        s.out_at   = 0;
+        s.body     = now.size - from;
+        s.append   = g->second;
+        s.behind   = false;
+        s.moved_ms = now_ms;
+        s.have     = now;
+        if (!ok || !sub_pump(s, now_ms)) {
+            if (log_on(LOG_INFO)) log_line("[server] subscriber " + s.ci.client_name + " lost on " + path);
+            sub_drop(s, false, ctx);
+            continue;
+        }
+        ++(g->second ? appends : full);
+    }
+    if ((full || appends) && log_on(LOG_DEBUG))
+        log_line("[server] pushing " + path + " (" + std::to_string(now.size) + " bytes) to " +
+                 std::to_string(full + appends) + " subscribers, " + std::to_string(appends) + " as appends, " +
+                 "queued in " + std::to_string((now_ns() - t0) / 1000) + " us");
+}
+
+static void sub_run(const server_ctx& ctx) {
+    change_watch                                   watch;
+    std::map<std::string, std::vector<subscriber>> topics;     // file → its subscribers
+    std::vector<pollfd>                            pfds;
+    std::vector<std::pair<const std::string*, subscriber*>> polled;
+    while (true) {
+        pfds.assign(1, pollfd{ g_sub_wake[0], POLLIN, 0 });
+        if (watch.fd() >= 0) pfds.push_back(pollfd{ watch.fd(), POLLIN, 0 });
+        size_t first = pfds.size();
+        bool   busy  = false;
+        polled.clear();
+        for (auto& t : topics)
+            for (subscriber& s : t.second) {
+                pfds.push_back(pollfd{ s.fd, static_cast<short>(POLLIN | (s.out ? POLLOUT : 0)), 0 });
+                polled.push_back(std::make_pair(&t.first, &s));
+                busy = busy || s.out;
+            }
+        int wait = watch.wait_ms(now_ns() / 1000000);
+        if (busy && (wait < 0 || wait > 1000)) wait = 1000;       // to notice a stalled one
+        if (::poll(pfds.data(), pfds.size(), wait) < 0 && errno != EINTR) {
+            log_line("[server] subscriptions: poll failed: " + std::string(std::strerror(errno)));
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        uint64_t now_ms = now_ns() / 1000000;
+
+        /* a client only ever talks again to hang up; anything else it sends is ignored */
+        for (size_t i = first; i < pfds.size(); ++i) {
+            subscriber& s = *polled[i - first].second;
+            if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+                char    buf[256];
+                ssize_t n = ::recv(s.fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                    sub_drop(s, n == 0 && !s.out, ctx);
+                    continue;
+                }
+            }
+            if (!s.out) continue;
+            if ((pfds[i].revents & POLLOUT) && !sub_pump(s, now_ms)) {
+                sub_drop(s, false, ctx);
+            } else if (s.out && now_ms - s.moved_ms >= SUB_SEND_TIMEOUT_S * 1000ull) {
+                if (log_on(LOG_INFO))
+                    log_line("[server] subscriber " + s.ci.client_name + " fell behind on " + *polled[i - first].first);
+                sub_drop(s, false, ctx);
+            } else if (!s.out && s.behind) {
+                watch.touch(*polled[i - first].first, now_ms);    // send what it missed
+            }
+        }
+        if (pfds[0].revents) {
+            char drain[64];
+            while (::read(g_sub_wake[0], drain, sizeof(drain)) > 0) {}
+            std::vector<std::pair<std::string, subscriber>> joining;
+            {
+                std::lock_guard<std::mutex> lk(g_sub_mu);
+                joining.swap(g_sub_joining);
+            }
+            for (auto& j : joining) {
+                std::vector<subscriber>& t = topics[j.first];
+                if (t.empty() && !watch.add(j.first)) {
+                    if (log_on(LOG_INFO)) log_line("[server] cannot watch " + j.first + "; no updates for it");
+                    sub_drop(j.second, true, ctx);
+                    topics.erase(j.first);
+                    continue;
+                }
+                t.push_back(j.second);
+                watch.touch(j.first, now_ms);               // it may have changed since its transfer
+            }
+        }
+        if (first > 1 && pfds[1].revents) watch.drain(now_ms);
+
+        std::vector<std::string> due;
+        watch.ready(now_ms, due);
+        for (const std::string& path : due) {
+            auto t = topics.find(path);
+            if (t != topics.end()) sub_publish(ctx, path, t->second, now_ms);
+        }
+        for (auto t = topics.begin(); t != topics.end();) {
+            t->second.erase(std::remove_if(t->second.begin(), t->second.end(),
+                                           [](const subscriber& s) { return s.fd < 0; }),
+                            t->second.end());
+            if (!t->second.empty()) { ++t; continue; }
+            watch.remove(t->first);
+            t = topics.erase(t);
+        }
+    }
+}
+
+/* the worker's part: note what the client now holds, hand the socket over */
+static void sub_join(int cfd, const sockaddr_in& peer, const conn_info& ci, const content& c,
+                     const server_ctx& ctx) {
+    subscriber s;
+    s.fd   = cfd;
+    s.peer = peer;
+    s.ci   = ci;
+    ++g_stats.subscribers;
+    s.have.size = c.size;
+    open_file id;
+    if (c.follow.empty() || !sub_tail(c.fd, c.off, c.size, s.have.tail)) {
+        if (log_on(LOG_INFO)) log_line("[server] " + c.path + " cannot be followed; not subscribing");
+        sub_drop(s, true, ctx);
+        return;
+    }
+    if (file_identity(c.follow.c_str(), -1, id)) {
+        s.have.dev      = id.dev;
+        s.have.ino      = id.ino;
+        s.have.mtime_ns = id.size == c.size ? id.mtime_ns : 0;   // else it moved on already
+    }
+    ::fcntl(cfd, F_SETFL, ::fcntl(cfd, F_GETFL) | O_NONBLOCK);   // the publisher never waits on it
+    if (log_on(LOG_INFO)) log_line("[server] " + ci.client_name + " subscribed to " + c.follow);
+
+    std::lock_guard<std::mutex> lk(g_sub_mu);
+    if (g_sub_wake[0] < 0) {
+        if (::pipe2(g_sub_wake, O_CLOEXEC | O_NONBLOCK) < 0) {
+            g_sub_wake[0] = g_sub_wake[1] = -1;
+            sub_drop(s, true, ctx);
+            return;
+        }
+        std::thread(sub_run, std::cref(ctx)).detach();
+    }
+    g_sub_joining.push_back(std::make_pair(c.follow, s));
+    char one = 1;
+    if (::write(g_sub_wake[1], &one, 1) < 0) {}             // a full pipe is already a wake‑up
+}
+
+/* ---------------------------------------------------------------------------
+   uploads ("put SIZE NAME", server --uploads, client --upload)
+   ---------------------------------------------------------------------------
+   the same exchange run backwards: after the metadata the client sends
+   the body as v2 frames and the end pair, then waits for one status
+   string ("ok …" or "error: …"). with --io sendfile each frame moves
+   socket → pipe → file with splice, so the bytes never enter user space
+   (the client sends them with sendfile); copy mode recv()s and pwrite()s.
+   the body lands in the unnamed file upload_open made, which is synced,
+   linked under a temporary name and renamed over NAME: readers see the
+   old file or the new one, never a partial one, and a transfer that
+   breaks off leaves nothing behind.
+   ------------------------------------------------------------------------- */
+static std::atomic<uint64_t> g_upload_seq{0};
+
+/* n frame bytes from the socket into fd at its file position ----------- */
+static bool upload_frame(int cfd, const server_ctx& ctx, int fd, uint64_t off, size_t n,
+                         int pipe_fd[2], size_t pipe_cap, std::vector<char>& buf) {
+#if defined(__linux__)
+    if (ctx.io == io_mode::sendfile && pipe_fd[0] >= 0) {
+        while (n) {                     // drain what each splice brought: skbs fill pipe slots unevenly
+            ssize_t k = ::splice(cfd, nullptr, pipe_fd[1], nullptr, std::min(n, pipe_cap), SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (k < 0 && errno == EINTR) continue;
+            if (k <= 0) { if (k == 0) errno = ECONNRESET; return false; }
+            if (!splice_all(pipe_fd[0], nullptr, fd, static_cast<size_t>(k), 0)) return false;
+            n -= k;
+        }
+        return true;
+    }
+#endif
+    while (n) {
+        size_t k = std::min(n, buf.size());
+        if (!recv_all(cfd, buf.data(), k)) return false;
+        for (size_t w = 0; w < k;) {
+            ssize_t r = ::pwrite(fd, buf.data() + w, k - w, static_cast<off_t>(off + w));
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return false;
+            w += r;
+        }
+        off += k;
+        n -= k;
+    }
+    return true;
+}
+
+/* the body, then the file into place and the status to the client -------- */
+static bool upload_recv(int cfd, const server_ctx& ctx, const content& c, conn_info& ci) {
+    if (!ci.v2) {
+        send_str(cfd, "error: uploads are sent as v2 frames");
+        return false;
+    }
+    int    p[2]     = { -1, -1 };
+    size_t pipe_cap = 0;
+    std::vector<char> buf;
+#if defined(__linux__)
+    if (ctx.io == io_mode::sendfile && ::pipe2(p, O_CLOEXEC) == 0) {
+        int cap  = ::fcntl(p[1], F_SETPIPE_SZ, 1 << 20);
+        pipe_cap = cap > 0 ? static_cast<size_t>(cap) : 65536;
+    }
+#endif
+    if (p[0] < 0) buf.resize(1 << 20);
+
+    std::string why;
+    while (why.empty()) {
+        char flag = 0;
+        if (!recv_all(cfd, &flag, 1)) { why = "client went away"; break; }
+        if (flag == FLAG_END) {
+            if (!recv_all(cfd, &flag, 1)) why = "client went away";
+            else if (ci.sent != c.size) why = "got " + std::to_string(ci.sent) + " of " + std::to_string(c.size) + " bytes";
+            break;
+        }
+        uint32_t len = 0;
+        if (flag != FLAG_V2 || !recv_all(cfd, &len, 4)) { why = "bad frame"; break; }
+        len = ntohl(len);
+        if (len > V2_MAX_FRAME || len > c.size - ci.sent) { why = "bad frame length"; break; }
+        if (!upload_frame(cfd, ctx, c.fd, ci.sent, len, p, pipe_cap, buf)) { why = std::string("receive: ") + std::strerror(errno); break; }
+        ci.sent += len;
+    }
+    for (int fd : p) if (fd >= 0) ::close(fd);
+
+    if (why.empty() && ::fdatasync(c.fd) < 0) why = std::string("sync: ") + std::strerror(errno);
+    if (why.empty()) {
+        std::string tmp = c.upload + ".upload." + std::to_string(::getpid()) + '.' + std::to_string(++g_upload_seq);
+        std::string proc = "/proc/self/fd/" + std::to_string(c.fd);
+        if (::linkat(AT_FDCWD, proc.c_str(), AT_FDCWD, tmp.c_str(), AT_SYMLINK_FOLLOW) < 0) {
+            why = std::string("link: ") + std::strerror(errno);
+        } else if (::rename(tmp.c_str(), c.upload.c_str()) < 0) {
+            why = std::string("rename: ") + std::strerror(errno);
+            ::unlink(tmp.c_str());
+        }
+    }
+    uint64_t us = (now_ns() - ci.t_body) / 1000;
+    if (!why.empty()) {
+        if (log_on(LOG_INFO)) log_line("[server] upload of " + c.path + " failed: " + why);
+        send_str(cfd, "error: " + why);
+        return false;
+    }
+    if (ctx.catalog) ctx.catalog->refresh(c.path);
+    ++g_stats.uploads;
+    g_stats.upload_bytes += c.size;
+    if (log_on(LOG_INFO))
+        log_line("[server] received " + c.path + " (" + std::to_string(c.size) + " bytes in " + std::to_string(us) +
+                 " us, " + std::to_string(us ? c.size / us : 0) + " MB/s)");
+    return send_str(cfd, "ok " + c.path + ' ' + std::to_string(c.size));
+}
+
+/* after a probe's end pair: what the sending side's tcp saw ------------- */
+static bool probe_done(int cfd, const conn_info& ci) {
+    std::string tcp  = tcp_info_line(cfd, true);
+    int         one  = 1;
+    setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));  // don't let nagle hold it behind the end pair
+    uint64_t    ns   = now_ns() - ci.t_body;
+    if (log_on(LOG_INFO))
+        log_line("[server] probe to " + ci.client_name + ": " + std::to_string(ci.sent) + " bytes in " +
+                 std::to_string(ns / 1000000) + " ms (" + std::to_string(ns ? ci.sent * 8000 / ns : 0) + " Mbit/s) " + tcp);
+    return send_str(cfd, tcp);
+}
+
+/* count the connection as local if its packets land on the cpu we run on */
+static void note_locality(worker_slot& slot, int cfd) {
+    ++slot.conns;
+#if defined(__linux__) && defined(SO_INCOMING_CPU)
+    int       in_cpu = -1;
+    socklen_t len    = sizeof(in_cpu);
+    if (getsockopt(cfd, SOL_SOCKET, SO_INCOMING_CPU, &in_cpu, &len) == 0 && in_cpu == sched_getcpu())
+        ++slot.local;
+#else
+    (void)cfd;
+#endif
+}
+
+/* each worker runs its own accept loop, on the shared listener or (with
+   --steer) on its own reuseport listener, pinned to its cpu ------------- */
+static void worker_loop(int lfd, const server_ctx& ctx, int w) {
+    worker_slot& slot = g_workers[w];
+#if defined(__linux__)
+    if (slot.cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(slot.cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+    while (true) {
+        sockaddr_in cli{};
+        socklen_t   clen = sizeof(cli);
+        int cfd = accept(lfd, reinterpret_cast<sockaddr*>(&cli), &clen);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            die("accept");
+        }
+        ++g_stats.accepted;
+        note_locality(slot, cfd);
+        uint32_t cap = relaxed(g_live.max_conns);
+        if (g_stats.active.fetch_add(1) >= cap && cap) {
+            --g_stats.active;
+            ++g_stats.rejected;
+            if (log_on(LOG_DEBUG)) log_line("[server] at max-conns; turned away " + peer_to_string(cfd));
+            ::close(cfd);
+            continue;
+        }
+        conn_info ci;
+        ci.t_accept      = now_ns();
+        ci.t_accept_wall = g_access_log.is_open() ? wall_ns() : 0;
+        if (log_on(LOG_INFO)) log_line("[server] accepted from " + peer_to_string(cfd));
+
+        content c;
+        bool ok = serve_handshake(cfd, ctx, ci, c);
+        if (ok && ci.v2 && !ci.subscribe && g_cohort_ms && c.fd == ctx.fd && !c.off && c.size == ctx.size) {
+            cohort_join(cfd, cli, ci, ctx);                 // the cohort finishes it
+            continue;
+        }
+        if (ok) ok = c.upload.empty() ? send_body(cfd, ctx, c, ci.v2, ci.sent) : upload_recv(cfd, ctx, c, ci);
+        if (ok && c.wrap) ok = probe_done(cfd, ci);
+        if (ok && ci.subscribe) {
+            sub_join(cfd, cli, ci, c, ctx);                 // the publisher has it now
+            continue;
+        }
+        c = content();                                  // let go of the file first
+        finish_conn(cfd, cli, ci, ok, ctx);
+    }
+}
+
+/* ---------------------------------------------------------------------------
+   --udp: reliable udp transport (rudp.hpp) on the same port number
+   ---------------------------------------------------------------------------
+   one thread owns the socket and every session: it drains datagrams with
+   recvmmsg, feeds handshakes and acks to the sessions, then lets each
+   session send what its congestion window and pacer allow – a batch of
+   equal‑size DATA packets per sendmsg with UDP GSO, sendmmsg without
+   ------------------------------------------------------------------------- */
+struct udp_session {
+    enum { META_SENT, SENDING, FIN_SENT } state = META_SENT;
+    sockaddr_in                  peer{};
+    uint32_t                     cid = 0;
+    conn_info                    ci;
+    std::unique_ptr<rudp_sender> snd;
+    file_cache                   cache;
+    std::string                  meta;          // encoded META, resent on duplicate HELLOs
+    uint64_t                     last_heard = 0;
+    uint64_t                     fin_next   = 0;
+    int                          fin_tries  = 0;
+};
+
+static const size_t UDP_BATCH = 16;
+
+static std::string udp_peer(const sockaddr_in& a) {
+    char ip[INET_ADDRSTRLEN] = "?";
+    inet_ntop(AF_INET, &a.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ':' + std::to_string(ntohs(a.sin_port));
+}
+
+static uint64_t udp_key(const sockaddr_in& a, uint32_t cid) {
+    return (uint64_t(a.sin_addr.s_addr) ^ (uint64_t(a.sin_port) << 32)) * 0x9e3779b97f4a7c15ull ^ cid;
+}
+
+static void udp_finish(udp_session& s, bool ok) {
+    s.ci.t_done = now_ns();
+    g_stats.bytes += s.ci.sent;
+    ++(ok ? g_stats.completed : g_stats.dropped);
+    --g_stats.active;
+    capture_conn(s.ci, ok);
+    access_conn(s.peer, s.ci, ok);
+    if (log_on(LOG_INFO)) {
+        std::string extra;
+        if (s.snd)
+            extra = " (" + std::string(s.snd->cc().name()) + ", srtt " +
+                    std::to_string(s.snd->srtt_ns() / 1000) + " us, " +
+                    std::to_string(s.snd->retransmits()) + " retransmits)";
+        log_line(ok ? "[server] udp " + udp_peer(s.peer) + " done" + extra
+                    : "[server] udp " + udp_peer(s.peer) + " dropped" + extra);
+    }
+}
+
+/* DATA packets for one session, as many as cwnd and the pacer allow ------ */
+static void udp_send_data(int ufd, const server_ctx& ctx, udp_session& s, bool& gso,
+                          std::vector<uint8_t>& out, uint64_t now) {
+    rudp_sender& snd = *s.snd;
+    while (true) {
+        size_t   bytes = 0, seg = 0;
+        uint64_t chunk = 0;
+        while (bytes / (RUDP_DATA_HDR + RUDP_PAYLOAD) < UDP_BATCH && snd.can_send(now) &&
+               snd.next_chunk(chunk)) {
+            uint64_t off = snd.chunk_off(chunk);
+            uint16_t len = snd.chunk_len(chunk);
+            uint8_t* p   = &out[bytes];
+            rudp_put_data_hdr(p, s.cid, snd.on_sent(now, chunk), off, len);
+            if (s.cache) {
+                std::memcpy(p + RUDP_DATA_HDR, &(*s.cache)[off], len);
+            } else {
+                for (size_t got = 0; got < len;) {
+                    ssize_t r = ::pread(ctx.fd, p + RUDP_DATA_HDR + got, len - got, off + got);
+                    if (r < 0 && errno == EINTR) continue;
+                    if (r <= 0) return;
+                    got += r;
+                }
+            }
+            s.ci.sent = std::max(s.ci.sent, off + len);
+            bytes += RUDP_DATA_HDR + len;
+            seg    = std::max<size_t>(seg, RUDP_DATA_HDR + len);
+            if (len < RUDP_PAYLOAD) break;          // the short tail chunk ends a gso batch
+        }
+        if (!bytes) return;
+        udp_send_batch(ufd, s.peer, out.data(), bytes, seg, gso);
+    }
+}
+
+static void udp_handle(int ufd, const server_ctx& ctx, std::map<uint64_t, udp_session>& sessions,
+                       const sockaddr_in& from, const uint8_t* p, size_t n, uint64_t now,
+                       const std::string& cc_name) {
+    pkt_in in(p, n);
+    uint8_t  type = in.u8();
+    uint32_t cid  = in.u32();
+    if (!in.ok) return;
+    uint64_t key = udp_key(from, cid);
+    auto it = sessions.find(key);
+
+    if (type == RUDP_HELLO) {
+        if (it == sessions.end()) {
+            uint16_t ver = in.u16();
+            udp_session s;
+            s.ci.client_name = in.str();
+            s.ci.query       = in.str();
+            if (!in.ok || ver != RUDP_VERSION) return;
+            if (query_selects(s.ci.query)) {
+                /* get/list/lines/grep/probe/put are tcp only: the udp path
+                   sends <file> and nothing else, so say so, don't send it */
+                ++g_stats.refused;
+                if (log_on(LOG_INFO))
+                    log_line("[server] udp refused from " + udp_peer(from) + ": query \"" + s.ci.query + '"');
+                pkt_out m;
+                m.u8(RUDP_META);
+                m.u32(cid);
+                m.str(ctx.name);
+                m.str("error: queries are served over tcp only");
+                m.u64(0);
+                m.u16(static_cast<uint16_t>(RUDP_PAYLOAD));
+                ::sendto(ufd, m.b.data(), m.b.size(), 0, reinterpret_cast<const sockaddr*>(&from), sizeof(from));
+                s.ci.refused       = true;
+                s.ci.t_accept      = s.ci.t_done = now;
+                s.ci.t_accept_wall = g_access_log.is_open() ? wall_ns() : 0;
+                access_conn(from, s.ci, false);
+                return;
+            }
+            ++g_stats.accepted;
+            uint32_t cap = relaxed(g_live.max_conns);
+            if (g_stats.active.fetch_add(1) >= cap && cap) {
+                --g_stats.active;
+                ++g_stats.rejected;
+                return;                                     // client times out
+            }
+            s.peer        = from;
+            s.cid         = cid;
+            s.ci.t_accept = now;
+            s.ci.t_accept_wall = g_access_log.is_open() ? wall_ns() : 0;
+            s.ci.size     = ctx.size;
+            pkt_out m;
+            m.u8(RUDP_META);
+            m.u32(cid);
+            m.str(ctx.name);
+            m.str(ctx.file_path);
+            m.u64(ctx.size);
+            m.u16(static_cast<uint16_t>(RUDP_PAYLOAD));
+            s.meta = m.b;
+            if (log_on(LOG_INFO))
+                log_line("[server] udp hello from " + udp_peer(from) + ": " + s.ci.client_name);
+            it = sessions.emplace(key, std::move(s)).first;
+        }
+        it->second.last_heard = now;
+        if (it->second.state == udp_session::META_SENT)
+            ::sendto(ufd, it->second.meta.data(), it->second.meta.size(), 0,
+                     reinterpret_cast<const sockaddr*>(&from), sizeof(from));
+        return;
+    }
+    if (it == sessions.end()) return;
+    udp_session& s = it->second;
+    s.last_heard = now;
+
+    if (type == RUDP_START && s.state == udp_session::META_SENT) {
+        uint64_t window = in.u64();
+        if (!in.ok) return;
+        s.snd.reset(new rudp_sender(ctx.size, rudp_make_cc(cc_name, RUDP_PAYLOAD)));
+        s.snd->set_window(window);
+        s.cache     = std::atomic_load(&g_cache);
+        s.state     = udp_session::SENDING;
+        s.ci.t_body = now;
+    } else if (type == RUDP_ACK && s.snd) {
+        uint64_t delay_us = in.u64();
+        uint64_t max_off  = in.u64();
+        uint8_t  cnt      = in.u8();
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+        for (uint8_t i = 0; i < cnt && in.ok; ++i) {
+            uint64_t lo = in.u64(), hi = in.u64();
+            if (in.ok && lo <= hi) ranges.push_back(std::make_pair(lo, hi));
+        }
+        if (!in.ok) return;
+        s.snd->set_window(max_off);
+        s.snd->on_ack(now, delay_us * 1000, ranges);
+    } else if (type == RUDP_FIN_ACK && s.state == udp_session::FIN_SENT) {
+        udp_finish(s, true);
+        sessions.erase(it);
+    }
+}
+
+static void udp_loop(int ufd, const server_ctx& ctx, std::string cc_name) {
+    std::map<uint64_t, udp_session> sessions;
+    udp_rx_batch rx(UDP_BATCH, 2048);
+    std::vector<uint8_t> out(UDP_BATCH * (RUDP_DATA_HDR + RUDP_PAYLOAD));
+    bool gso = true;
+
+    while (true) {
+        /* sleep until a datagram, a pacing slot or a timer ---------------- */
+        uint64_t now = now_ns(), wake = now + 100000000ull;
+        for (auto& kv : sessions) {
+            udp_session& s = kv.second;
+            if (s.state == udp_session::SENDING) {
+                wake = std::min(wake, s.snd->next_timer());
+                if (s.snd->wants_to_send()) wake = std::min(wake, std::max(s.snd->next_send_ns(), now));
+            } else if (s.state == udp_session::FIN_SENT) {
+                wake = std::min(wake, s.fin_next);
+            }
+        }
+        pollfd pfd = { ufd, POLLIN, 0 };
+        if (wake > now) {
+#if defined(__linux__)
+            timespec ts = { static_cast<time_t>((wake - now) / 1000000000ull),
+                            static_cast<long>((wake - now) % 1000000000ull) };
+            ::ppoll(&pfd, 1, &ts, nullptr);
+#else
+            ::poll(&pfd, 1, static_cast<int>((wake - now + 999999) / 1000000));
+#endif
+        }
+
+        /* everything that has arrived --------------------------------------- */
+        int got;
+        while ((got = udp_recv_batch(ufd, rx)) > 0) {
+            now = now_ns();
+            for (int i = 0; i < got; ++i)
+                for (size_t off = 0; off < rx.len[i]; off += rx.seg[i])
+                    udp_handle(ufd, ctx, sessions, rx.from[i], rx.at(i) + off,
+                               std::min(rx.seg[i], rx.len[i] - off), now, cc_name);
+            if (static_cast<size_t>(got) < rx.size()) break;
+        }
+
+        /* timers, sends, completions ---------------------------------------- */
+        now = now_ns();
+        for (auto it = sessions.begin(); it != sessions.end();) {
+            udp_session& s = it->second;
+            if (now - s.last_heard > RUDP_IDLE_NS) {
+                udp_finish(s, false);
+                it = sessions.erase(it);
+                continue;
+            }
+            if (s.state == udp_session::SENDING) {
+                s.snd->on_timer(now);
+                udp_send_data(ufd, ctx, s, gso, out, now);
+                if (s.snd->done()) { s.state = udp_session::FIN_SENT; s.fin_next = 0; }
+            }
+            if (s.state == udp_session::FIN_SENT && now >= s.fin_next) {
+                if (s.fin_tries == 8) {             // data is all acked; peer just went quiet
+                    udp_finish(s, true);
+                    it = sessions.erase(it);
+                    continue;
+                }
+                pkt_out f;
+                f.u8(RUDP_FIN);
+                f.u32(s.cid);
+                f.u64(ctx.size);
+                ::sendto(ufd, f.b.data(), f.b.size(), 0,
+                         reinterpret_cast<const sockaddr*>(&s.peer), sizeof(s.peer));
+                s.fin_next = now + (std::max<uint64_t>(s.snd->srtt_ns(), 10000000ull) << ++s.fin_tries);
+            }
+            ++it;
+        }
+    }
+}
+
+static int udp_open(int port) {
+    int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    int buf = 4 << 20;                                      // room for a few windows of acks / bursts
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(static_cast<uint16_t>(port));
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) { ::close(fd); return -1; }
+    return fd;
+}
+
+/* ---------------------------------------------------------------------------
+   control socket
+   ---------------------------------------------------------------------------
+   one command per line, one reply line each:
+     stats                 counters, as on SIGUSR1
+     get                   every tunable
+     set frame BYTES       v2 frame payload (new transfers)
+     set rate BYTES/S      per‑connection send limit, 0 = off (live, per frame)
+     set cache BYTES       copy‑mode memory budget; loads or drops the cache
+     set max-conns N       concurrent transfers, 0 = unlimited
+     set backlog N         re‑listen() with a new backlog
+     set log-level L       error | info | debug
+   sizes take an optional k/m/g suffix
+   ------------------------------------------------------------------------- */
+static bool parse_size(const std::string& s, uint64_t& v) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long n = std::strtoull(s.c_str(), &end, 10);
+    if (errno || end == s.c_str()) return false;
+    std::string suf(end);
+    if (suf == "k" || suf == "K")      n <<= 10;
+    else if (suf == "m" || suf == "M") n <<= 20;
+    else if (suf == "g" || suf == "G") n <<= 30;
+    else if (!suf.empty())             return false;
+    v = n;
+    return true;
+}
+
+static const char* log_level_name(int l) {
+    return l <= LOG_ERROR ? "error" : l == LOG_INFO ? "info" : "debug";
+}
+
+static bool parse_log_level(const std::string& s, int& l) {
+    if (s == "error" || s == "0")      l = LOG_ERROR;
+    else if (s == "info" || s == "1")  l = LOG_INFO;
+    else if (s == "debug" || s == "2") l = LOG_DEBUG;
+    else return false;
+    return true;
+}
+
+static std::string config_line() {
+    return "frame=" + std::to_string(relaxed(g_live.frame)) +
+           " rate=" + std::to_string(relaxed(g_live.rate_bps)) +
+           " cache=" + std::to_string(relaxed(g_live.cache_budget)) +
+           (std::atomic_load(&g_cache) ? "(loaded)" : "(off)") +
+           " max-conns=" + std::to_string(relaxed(g_live.max_conns)) +
+           " backlog=" + std::to_string(relaxed(g_live.backlog)) +
+           " log-level=" + log_level_name(g_live.log_level.load());
 }
 
-/* pretty‑print a peer (ip:port) ----------------------------------------- */
-static std::string peer_to_string(int fd) {
-    sockaddr_storage ss{};
-    socklen_t slen = sizeof(ss);
-    if (getpeername(fd, reinterpret_cast<sockaddr*>(&ss), &slen) < 0) return "?";
-    char host[NI_MAXHOST], serv[NI_MAXSERV];
-    if (getnameinfo(reinterpret_cast<sockaddr*>(&ss), slen,
-                    host, sizeof(host), serv, sizeof(serv),
-                    NI_NUMERICHOST | NI_NUMERICSERV) != 0)
-        return "?";
-    return std::string(host) + ":" + serv;
+static std::string control_command(const std::string& line, const server_ctx& ctx,
+                                   const std::vector<int>& lfds) {
+    std::istringstream in(line);
+    std::string cmd, key, val;
+    in >> cmd >> key >> val;
+    if (cmd == "stats") return stats_line().substr(9);          // drop "[server] "
+    if (cmd == "get")   return config_line();
+    if (cmd == "reindex") {
+        if (!ctx.catalog) return "error: the server was not started with --root DIR --index";
+        std::string r = catalog_rebuild(ctx);
+        if (log_on(LOG_INFO)) log_line("[server] control: reindex: " + r);
+        return r.compare(0, 6, "error:") == 0 ? r : "ok " + r;
+    }
+    if (cmd != "set")
+        return "error: commands are stats, get, reindex, set <frame|rate|cache|max-conns|backlog|log-level> <value>";
+
+    uint64_t n = 0;
+    int      lvl = 0;
+    if (key == "log-level") {
+        if (!parse_log_level(val, lvl)) return "error: log-level is error, info or debug";
+        g_live.log_level = lvl;
+    } else if (!parse_size(val, n)) {
+        return "error: bad value '" + val + "'";
+    } else if (key == "frame") {
+        if (n < 1 || n > V2_MAX_FRAME) return "error: frame must be 1.." + std::to_string(V2_MAX_FRAME);
+        g_live.frame = static_cast<uint32_t>(n);
+    } else if (key == "rate") {
+        g_live.rate_bps = n;
+    } else if (key == "cache") {
+        g_live.cache_budget = n;
+        cache_apply(ctx);
+    } else if (key == "max-conns") {
+        g_live.max_conns = static_cast<uint32_t>(std::min<uint64_t>(n, UINT32_MAX));
+    } else if (key == "backlog") {
+        if (n < 1 || n > 65535) return "error: backlog must be 1..65535";
+        for (int lfd : lfds)
+            if (listen(lfd, static_cast<int>(n)) < 0) return std::string("error: listen: ") + std::strerror(errno);
+        g_live.backlog = static_cast<uint32_t>(n);
+    } else {
+        return "error: unknown tunable '" + key + "'";
+    }
+    if (log_on(LOG_INFO)) log_line("[server] control: set " + key + " " + val);
+    return "ok " + config_line();
+}
+
+/* connections are served one at a time; commands are rare and quick ------ */
+static void control_loop(int cfd_listen, const server_ctx& ctx, const std::vector<int>& lfds) {
+    while (true) {
+        int c = accept(cfd_listen, nullptr, nullptr);
+        if (c < 0) { if (errno == EINTR || errno == ECONNABORTED) continue; return; }
+        std::string pending;
+        char buf[512];
+        ssize_t n;
+        while ((n = ::recv(c, buf, sizeof(buf), 0)) > 0) {
+            pending.append(buf, n);
+            size_t nl;
+            while ((nl = pending.find('\n')) != std::string::npos) {
+                std::string line = pending.substr(0, nl);
+                pending.erase(0, nl + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (line.empty()) continue;
+                std::string reply = control_command(line, ctx, lfds) + "\n";
+                if (!send_all(c, reply.data(), reply.size())) break;
+            }
+            if (pending.size() > 4096) break;               // not a command
+        }
+        ::close(c);
+    }
+}
+
+static int control_open(const std::string& path) {
+    sockaddr_un sun{};
+    if (path.size() >= sizeof(sun.sun_path)) { errno = ENAMETOOLONG; return -1; }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sun.sun_family = AF_UNIX;
+    std::memcpy(sun.sun_path, path.c_str(), path.size() + 1);
+    ::unlink(path.c_str());                                  // stale socket from a previous run
+    mode_t old = umask(077);                                 // owner only
+    int rc = bind(fd, reinterpret_cast<sockaddr*>(&sun), sizeof(sun));
+    umask(old);
+    if (rc < 0 || listen(fd, 4) < 0) { ::close(fd); return -1; }
+    return fd;
+}
+
+/* ---------------------------------------------------------------------------
+   connection steering (--steer)
+   ---------------------------------------------------------------------------
+   shared     one listener; every worker accept()s on it (default)
+   reuseport  one SO_REUSEPORT listener per worker, each worker pinned to its
+              own cpu; the kernel spreads connections by 4‑tuple hash
+   cpu        reuseport plus a classic bpf program on the group that picks
+              the listener of the worker pinned to the cpu that took the syn,
+              so accept, handshake and body stay on the cpu the nic queue
+              interrupts – no cache lines bouncing between cores per packet
+   in every mode workers count connections whose SO_INCOMING_CPU matches the
+   cpu they run on (stats: cpu_local=, workers=cpu:local/total,…)
+   ------------------------------------------------------------------------- */
+enum class steer_mode { shared, reuseport, cpu };
+
+/* the cpus we may run on, in order (taskset / bench pinning respected) --- */
+static std::vector<int> allowed_cpus() {
+    std::vector<int> out;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        for (int c = 0; c < CPU_SETSIZE; ++c)
+            if (CPU_ISSET(c, &set)) out.push_back(c);
+#endif
+    if (out.empty()) out.push_back(0);
+    return out;
+}
+
+static int listen_socket(int port, int backlog, bool& mptcp, bool reuseport) {
+    int fd = stream_socket(mptcp);
+    if (fd < 0) die("socket");
+
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) die("SO_REUSEPORT");
+
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(static_cast<uint16_t>(port));
+
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) die("bind");
+    if (listen(fd, backlog) < 0) die("listen");     // joins the reuseport group in this order
+    return fd;
+}
+
+/* cbpf on the reuseport group: A = cpu the packet arrived on; return the
+   index of the worker pinned there, else cpu % workers ------------------ */
+static bool attach_cpu_selector(int fd, int workers) {
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    std::vector<sock_filter> prog;
+    prog.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)));
+    for (int w = 0; w < workers; ++w) {
+        prog.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(g_workers[w].cpu), 0, 1));
+        prog.push_back(BPF_STMT(BPF_RET | BPF_K, static_cast<uint32_t>(w)));
+    }
+    prog.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(workers)));
+    prog.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+    sock_fprog fp;
+    fp.len    = static_cast<unsigned short>(prog.size());
+    fp.filter = prog.data();
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &fp, sizeof(fp)) == 0;
+#else
+    (void)fd; (void)workers;
+    errno = ENOPROTOOPT;
+    return false;
+#endif
 }
 
 /* ----------------------------------------------------------------------- */
@@ -142,90 +2592,325 @@ int main(int argc, char* argv[]) {
     std::cout.setf(std::ios::unitbuf);
     std::cin.tie(nullptr);
 
-    if (argc != 4) {
-        std::cerr << "usage: " << argv[0] << " \"<server name>\" <file> <port>\n";
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0] << " \"<server name>\" <file> <port>"
+                  << " [--workers N] [--backlog N] [--quiet] [--io copy|sendfile]"
+                  << " [--frame BYTES] [--capture PATH] [--access-log PREFIX]"
+                  << " [--access-log-max BYTES] [--log-level L] [--rate BYTES/S]"
+                  << " [--cache-budget BYTES] [--max-conns N] [--control PATH]"
+                  << " [--udp] [--cc bbr|reno] [--mptcp] [--steer shared|reuseport|cpu]"
+                  << " [--cohort MS] [--s3-endpoint URL] [--s3-cache DIR] [--s3-parallel N]"
+                  << " [--s3-part BYTES] [--archive] [--pack DIR] [--root DIR] [--fd-cache N]"
+                  << " [--index] [--index-threads N] [--index-watch auto|inotify|off]"
+                  << " [--snapshot] [--compose MANIFEST] [--uploads] [--upload-max BYTES]\n";
         return 1;
     }
-    std::string server_name = argv[1];
-    std::string file_path   = argv[2];
-    int         port        = std::atoi(argv[3]);
+    server_ctx ctx;
+    ctx.name      = argv[1];
+    ctx.file_path = argv[2];
+    int port      = std::atoi(argv[3]);
+    int workers   = 1;
+    int backlog   = 8;
+    std::string capture_path, access_prefix, control_path, pack_dir;
+    std::string cc_name = "bbr";
+    std::string s3_url  = std::getenv("AWS_ENDPOINT_URL") ? std::getenv("AWS_ENDPOINT_URL") : "";
+    bool        udp     = false;
+    bool        archive = false;
+    size_t      fd_cap  = 1024;
+    bool        index   = false;
+    unsigned    index_threads = 0;
+    std::string index_watch   = "auto";
+    std::string compose_path;
+    steer_mode  steer   = steer_mode::shared;
+    uint64_t    access_max = 64ull << 20;
+    uint64_t    frame      = relaxed(g_live.frame);
+    uint64_t    num        = 0;
+    int         level      = LOG_INFO;
     if (port <= 5000) {
         std::cerr << "error: port must be > 5000\n";
         return 1;
     }
-
-    /* read whole file into memory --------------------------------------- */
-    std::ifstream in(file_path, std::ios::binary);
-    if (!in) {
-        std::cerr << "error: cannot open file " << file_path << '\n';
+    for (int i = 4; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--workers" && i + 1 < argc)      workers = std::atoi(argv[++i]);
+        else if (a == "--backlog" && i + 1 < argc) backlog = std::atoi(argv[++i]);
+        else if (a == "--quiet")                   g_live.log_level = LOG_ERROR;
+        else if (a == "--frame" && i + 1 < argc)   frame = std::strtoul(argv[++i], nullptr, 10);
+        else if (a == "--control" && i + 1 < argc) control_path = argv[++i];
+        else if (a == "--udp")                     udp = true;
+        else if (a == "--archive")                 archive = true;
+        else if (a == "--pack" && i + 1 < argc)    pack_dir = argv[++i];
+        else if (a == "--root" && i + 1 < argc)    ctx.root = argv[++i];
+        else if (a == "--fd-cache" && i + 1 < argc) fd_cap = std::strtoul(argv[++i], nullptr, 10);
+        else if (a == "--snapshot")                ctx.snaps.reset(new snapshotter(1024));
+        else if (a == "--uploads")                 g_uploads = true;
+        else if (a == "--upload-max" && i + 1 < argc && parse_size(argv[i + 1], num)) {
+            g_upload_max = num;
+            ++i;
+        }
+        else if (a == "--compose" && i + 1 < argc) compose_path = argv[++i];
+        else if (a == "--index")                   index = true;
+        else if (a == "--index-watch" && i + 1 < argc) index_watch = argv[++i];
+        else if (a == "--index-threads" && i + 1 < argc) index_threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (a == "--mptcp")                   ctx.mptcp = true;
+        else if (a == "--cohort" && i + 1 < argc)  g_cohort_ms = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (a == "--steer" && i + 1 < argc) {
+            std::string m = argv[++i];
+            if (m == "shared")         steer = steer_mode::shared;
+            else if (m == "reuseport") steer = steer_mode::reuseport;
+            else if (m == "cpu")       steer = steer_mode::cpu;
+            else { std::cerr << "error: unknown steer mode " << m << '\n'; return 1; }
+        }
+        else if (a == "--cc" && i + 1 < argc)      cc_name = argv[++i];
+        else if (a == "--s3-endpoint" && i + 1 < argc) s3_url = argv[++i];
+        else if (a == "--s3-cache" && i + 1 < argc)    ctx.s3_cache = argv[++i];
+        else if (a == "--s3-parallel" && i + 1 < argc) ctx.s3_parallel = std::atoi(argv[++i]);
+        else if (a == "--s3-part" && i + 1 < argc && parse_size(argv[i + 1], num)) {
+            ctx.s3_part = num;
+            ++i;
+        }
+        else if (a == "--log-level" && i + 1 < argc && parse_log_level(argv[i + 1], level)) {
+            g_live.log_level = level;
+            ++i;
+        }
+        else if (a == "--rate" && i + 1 < argc && parse_size(argv[i + 1], num)) {
+            g_live.rate_bps = num;
+            ++i;
+        }
+        else if (a == "--cache-budget" && i + 1 < argc && parse_size(argv[i + 1], num)) {
+            g_live.cache_budget = num;
+            ++i;
+        }
+        else if (a == "--max-conns" && i + 1 < argc) {
+            g_live.max_conns = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (a == "--capture" && i + 1 < argc) capture_path = argv[++i];
+        else if (a == "--access-log" && i + 1 < argc) access_prefix = argv[++i];
+        else if (a == "--access-log-max" && i + 1 < argc)
+            access_max = std::strtoull(argv[++i], nullptr, 10);
+        else if (a == "--io" && i + 1 < argc) {
+            std::string m = argv[++i];
+            if (m == "copy")          ctx.io = io_mode::copy;
+            else if (m == "sendfile") ctx.io = io_mode::sendfile;
+            else { std::cerr << "error: unknown io mode " << m << '\n'; return 1; }
+        }
+        else { std::cerr << "error: unknown option " << a << '\n'; return 1; }
+    }
+    if (int(archive) + !pack_dir.empty() + !ctx.root.empty() > 1) {
+        std::cerr << "error: --archive, --pack and --root all claim \"get\"; pick one\n";
+        return 1;
+    }
+    if (index && ctx.root.empty()) {
+        std::cerr << "error: --index needs --root DIR\n";
+        return 1;
+    }
+    if (g_uploads && ctx.root.empty()) {
+        std::cerr << "error: --uploads needs --root DIR to put them in\n";
+        return 1;
+    }
+    if (index_watch != "auto" && index_watch != "inotify" && index_watch != "off") {
+        std::cerr << "error: --index-watch is auto, inotify or off\n";
+        return 1;
+    }
+    if (ctx.snaps && g_cohort_ms) {
+        std::cerr << "error: --cohort tees the live file; it cannot send snapshots\n";
+        return 1;
+    }
+    g_snaps = ctx.snaps.get();
+    if (!compose_path.empty()) {
+        std::string err;
+        if (!compose_load(compose_path, ctx.composed, err)) {
+            std::cerr << "error: " << err << '\n';
+            return 1;
+        }
+        std::cout << "[server] compose " << compose_path << ": " << ctx.composed.size() << " virtual files\n";
+    }
+    if (workers < 1 || backlog < 1) {
+        std::cerr << "error: --workers and --backlog must be >= 1\n";
         return 1;
     }
-    std::vector<char> file((std::istreambuf_iterator<char>(in)),
-                            std::istreambuf_iterator<char>());
-    uint64_t file_size = file.size();
+#if !defined(__linux__)
+    if (steer != steer_mode::shared) {
+        std::cerr << "error: --steer needs linux (SO_REUSEPORT groups, SO_INCOMING_CPU)\n";
+        return 1;
+    }
+    if (g_cohort_ms) {
+        std::cerr << "error: --cohort needs linux (splice, tee)\n";
+        return 1;
+    }
+#endif
+    if (std::unique_ptr<rudp_cc>(rudp_make_cc(cc_name, RUDP_PAYLOAD)) == nullptr) {
+        std::cerr << "error: unknown congestion controller " << cc_name << '\n';
+        return 1;
+    }
+    if (frame < 1 || frame > V2_MAX_FRAME) {
+        std::cerr << "error: --frame must be 1.." << V2_MAX_FRAME << '\n';
+        return 1;
+    }
+    g_live.frame   = static_cast<uint32_t>(frame);
+    g_live.backlog = static_cast<uint32_t>(backlog);
 
-    std::signal(SIGPIPE, SIG_IGN);       // don’t die if client goes away
+    if (s3_url_parse(ctx.file_path, ctx.s3_bucket, ctx.s3_key)) {
+        /* object store source: check the object is there, nothing to open */
+        if (s3_url.empty() || !s3_endpoint_parse(s3_url, ctx.s3)) {
+            std::cerr << "error: an s3:// file needs --s3-endpoint http://host:port\n";
+            return 1;
+        }
+        if (udp || g_cohort_ms || archive || !pack_dir.empty() || !ctx.root.empty()) {
+            std::cerr << "error: --udp, --cohort, --archive, --pack and --root need a local file\n";
+            return 1;
+        }
+        if (::mkdir(ctx.s3_cache.c_str(), 0755) < 0 && errno != EEXIST) {
+            std::cerr << "error: cannot create cache directory " << ctx.s3_cache << '\n';
+            return 1;
+        }
+        s3_conn     conn(ctx.s3);
+        s3_response r;
+        if (!conn.head(ctx.s3_bucket, ctx.s3_key, r) || r.status != 200) {
+            std::cerr << "error: cannot HEAD " << ctx.file_path << " at " << s3_url
+                      << (r.status ? " (status " + std::to_string(r.status) + ")" : std::string()) << '\n';
+            return 1;
+        }
+        ctx.size    = r.length;
+        g_s3_source = true;
+    } else {
+        /* open the file; copy mode also reads it into memory if it fits -- */
+        ctx.fd = ::open(ctx.file_path.c_str(), O_RDONLY);
+        struct stat st{};
+        if (ctx.fd < 0 || fstat(ctx.fd, &st) < 0) {
+            std::cerr << "error: cannot open file " << ctx.file_path << '\n';
+            return 1;
+        }
+        ctx.size = static_cast<uint64_t>(st.st_size);
+        cache_apply(ctx);
+        if (archive) {
+            /* member index: <file>.idx if it matches, else scan and save - */
+            uint64_t    mtime = uint64_t(st.st_mtim.tv_sec) * 1000000000ull + st.st_mtim.tv_nsec;
+            std::string idx   = ctx.file_path + ".idx", err;
+            uint64_t    t0    = now_ns();
+            ctx.archive.reset(new archive_index);
+            bool loaded = ctx.archive->load(idx, ctx.size, mtime);
+            if (!loaded && !ctx.archive->build(ctx.fd, ctx.size, err)) {
+                std::cerr << "error: " << ctx.file_path << ": " << err << '\n';
+                return 1;
+            }
+            if (!loaded && !ctx.archive->save(idx, ctx.size, mtime))
+                std::cout << "[server] cannot write " << idx << "; index kept in memory only\n";
+            std::cout << "[server] " << ctx.archive->kind << " index: " << ctx.archive->size()
+                      << " members, " << (loaded ? "loaded" : "built") << " in "
+                      << (now_ns() - t0) / 1000000 << " ms\n";
+        }
+    }
 
-    /* set up listening socket ------------------------------------------ */
-    int lfd = ::socket(AF_INET, SOCK_STREAM, 0);
-    if (lfd < 0) die("socket");
+    /* block our signals before any thread exists (log writers included)
+       so only signal_loop sees them ----------------------------------- */
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGUSR1);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigs, nullptr);
 
-    int opt = 1;
-    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (!ctx.root.empty()) {
+        struct stat rst{};
+        if (::stat(ctx.root.c_str(), &rst) < 0 || !S_ISDIR(rst.st_mode)) {
+            std::cerr << "error: --root " << ctx.root << " is not a directory\n";
+            return 1;
+        }
+        while (ctx.root.size() > 1 && ctx.root.back() == '/') ctx.root.pop_back();
+        ctx.fds.reset(new fd_cache(fd_cap));      // its watcher thread needs the mask above
+        g_fd_cache = ctx.fds.get();
+        bool watched = fd_cap && ctx.fds->watch();
+        std::cout << "[server] root " << ctx.root << ": fd cache " << fd_cap << " files"
+                  << (!fd_cap ? "" : watched ? ", inotify invalidation" : ", statx revalidation") << '\n';
+        if (index) {
+            /* stat latency, not cpu, bounds the walk: oversubscribe */
+            ctx.catalog.reset(new live_catalog(ctx.root, index_threads ? index_threads
+                                                         : std::max(4u, 2 * std::thread::hardware_concurrency())));
+            g_catalog = ctx.catalog.get();
+            const char* how = index_watch == "off" ? "off" : ctx.catalog->watch(index_watch == "auto");
+            std::string r   = catalog_rebuild(ctx);
+            if (r.compare(0, 6, "error:") == 0) { std::cerr << r << '\n'; return 1; }
+            std::cout << "[server] " << r << ", updates: " << how << '\n';
+            if (ctx.catalog->unwatched.load())
+                std::cout << "[server] warning: " << ctx.catalog->unwatched.load()
+                          << " directories have no inotify watch (raise fs.inotify.max_user_watches)\n";
+        }
+    }
+    if (!pack_dir.empty()) {
+        std::string err;
+        ctx.pack.reset(new pack_store);
+        if (!ctx.pack->open(pack_dir, err)) {
+            std::cerr << "error: " << err << '\n';
+            return 1;
+        }
+        std::cout << "[server] pack store " << pack_dir << ": " << ctx.pack->entries() << " keys in "
+                  << ctx.pack->packs() << " packs\n";
+    }
 
-    sockaddr_in addr{};
-    addr.sin_family      = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port        = htons(static_cast<uint16_t>(port));
+    if (!capture_path.empty() && !capture_open(capture_path)) {
+        std::cerr << "error: cannot create capture " << capture_path << '\n';
+        return 1;
+    }
+    if (!access_prefix.empty() && !access_open(access_prefix, std::max<uint64_t>(access_max, 4096))) {
+        std::cerr << "error: cannot create access log " << access_prefix << '\n';
+        return 1;
+    }
 
-    if (bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) die("bind");
-    if (listen(lfd, 8) < 0) die("listen");
+    std::signal(SIGPIPE, SIG_IGN);       // don’t die if client goes away
 
-    std::string ip = find_local_ip();
-    std::cout << "[server] listening on " << ip << ':' << port
-              << "  file=\"" << file_path << "\"  size=" << file_size << " bytes\n";
+    std::thread(signal_loop, sigs).detach();
 
-    /* accept exactly one client at a time ------------------------------- */
-    while (true) {
-        sockaddr_in cli{};
-        socklen_t   clen = sizeof(cli);
-        int cfd = accept(lfd, reinterpret_cast<sockaddr*>(&cli), &clen);
-        if (cfd < 0) { if (errno == EINTR) continue; die("accept"); }
-
-        std::cout << "[server] accepted from " << peer_to_string(cfd) << '\n';
-
-        /* handshake 1: get client name & query -------------------------- */
-        std::string client_name = recv_str(cfd);
-        std::string query       = recv_str(cfd); (void)query;
-        std::cout << "[server] client says: " << client_name << '\n';
-
-        /* handshake 2: send metadata ----------------------------------- */
-        send_str(cfd, server_name);
-        send_str(cfd, file_path);
-        uint64_t netsize = host_to_be64(file_size);
-        send_exact(cfd, &netsize, 8);
-
-        /* wait for “start” from client --------------------------------- */
-        std::string start = recv_str(cfd); (void)start;
-
-        /* stream file in 100‑byte chunks, each with a ‘1’ flag ---------- */
-        constexpr size_t CHUNK = 100;
-        uint64_t sent = 0;
-        while (sent < file_size) {
-            char flag = '1';
-            send_exact(cfd, &flag, 1);
-            size_t n = std::min<uint64_t>(CHUNK, file_size - sent);
-            send_exact(cfd, &file[sent], n);
-            sent += n;
+    /* set up the listening socket(s) ----------------------------------- */
+    g_nworkers = workers;
+    g_workers.reset(new worker_slot[workers]);
+    std::vector<int> lfds;
+    bool want_mptcp = ctx.mptcp;
+    if (steer == steer_mode::shared) {
+        lfds.push_back(listen_socket(port, backlog, ctx.mptcp, false));
+    } else {
+        std::vector<int> cpus = allowed_cpus();
+        for (int w = 0; w < workers; ++w) {
+            g_workers[w].cpu = cpus[w % cpus.size()];
+            lfds.push_back(listen_socket(port, backlog, ctx.mptcp, true));
         }
-        /* send termination pair ‘0’ ‘0’ -------------------------------- */
-        char zero = '0';
-        send_exact(cfd, &zero, 1);
-        send_exact(cfd, &zero, 1);
+        if (steer == steer_mode::cpu && !attach_cpu_selector(lfds[0], workers)) die("SO_ATTACH_REUSEPORT_CBPF");
+    }
+    if (want_mptcp && !ctx.mptcp)
+        std::cout << "[server] mptcp not available in this kernel; using tcp\n";
 
-        std::cout << "[server] done; closing connection\n";
-        ::close(cfd);
+    if (udp) {
+        int ufd = udp_open(port);
+        if (ufd < 0) die("udp socket");
+        std::thread(udp_loop, ufd, std::cref(ctx), cc_name).detach();
     }
-}
 
+    if (!control_path.empty()) {
+        int cfd = control_open(control_path);
+        if (cfd < 0) die("control socket");
+        std::thread(control_loop, cfd, std::cref(ctx), std::cref(lfds)).detach();
+    }
 
+    /* with mptcp every local address is a path a client can add --------- */
+    std::string ip = find_local_ip();
+    if (ctx.mptcp) {
+        std::vector<std::string> ips = local_ips();
+        for (size_t i = 1; i < ips.size(); ++i) ip += ':' + std::to_string(port) + ", " + ips[i];
+    }
+    std::cout << "[server] listening on " << ip << ':' << port
+              << "  file=\"" << ctx.file_path << "\"  size=" << ctx.size
+              << " bytes  workers=" << workers
+              << "  io=" << (ctx.io == io_mode::copy ? "copy" : "sendfile")
+              << (udp ? "  udp=" + cc_name : std::string())
+              << (ctx.mptcp ? "  mptcp" : "")
+              << (steer == steer_mode::shared ? "" : steer == steer_mode::cpu ? "  steer=cpu" : "  steer=reuseport")
+              << '\n';
+
+    /* every worker blocks in accept(); the kernel hands each connection
+       to exactly one of them ------------------------------------------- */
+    std::vector<std::thread> pool;
+    for (int w = 1; w < workers; ++w)
+        pool.emplace_back(worker_loop, lfds[w % lfds.size()], std::cref(ctx), w);
+    worker_loop(lfds[0], ctx, 0);
+    for (auto& t : pool) t.join();
+}
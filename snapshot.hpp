@@ -0,0 +1,183 @@
+// snapshot.hpp – a frozen version of a file for each transfer (server --snapshot)
+//
+// take(path, fd) returns an unnamed file (O_TMPFILE in the file's own
+// directory) holding the file's bytes as they were. FICLONE makes it share
+// the source's extents: the cost is per extent, not per byte, and a later
+// rewrite of the source is copy‑on‑write, so it never reaches the clone.
+// where the filesystem cannot clone (ext4, tmpfs, …) it falls back to
+// copy_file_range, which costs a full copy – so snapshots are shared:
+// every transfer that starts while the file is unchanged (same dev, ino,
+// size and mtime) gets the one already taken, and concurrent first takers
+// wait for a single clone instead of making their own. a file that
+// changes while it is being cloned is taken again.
+//
+// the table holds a snapshot weakly once it is made: the last transfer
+// using it frees it (and its copy, or its old extents), and the next one
+// takes a fresh one. when the table is full, entries whose snapshot is
+// gone go first, then the least recently used.
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fdcache.hpp"
+
+#ifndef FICLONE
+    #define FICLONE _IOW(0x94, 9, int)
+#endif
+
+/* unnamed copy of src (size bytes) next to path; -1 on failure ---------- */
+static inline int snapshot_clone(const std::string& path, int src, uint64_t size, bool& cloned) {
+    size_t      slash = path.rfind('/');
+    std::string dir   = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int         fd    = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    cloned = ::ioctl(fd, FICLONE, src) == 0;
+    if (cloned) return fd;
+
+    loff_t in = 0, out = 0;
+    while (static_cast<uint64_t>(in) < size) {
+        ssize_t n = ::copy_file_range(src, &in, fd, &out, static_cast<size_t>(size - in), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n > 0) continue;
+        if (n == 0) break;                          // the source shrank under us
+        if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) { ::close(fd); return -1; }
+        std::vector<char> buf(1 << 20);             // no copy_file_range here
+        while (static_cast<uint64_t>(in) < size) {
+            ssize_t r = ::pread(src, buf.data(), buf.size(), in);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) break;
+            if (::pwrite(fd, buf.data(), static_cast<size_t>(r), out) != r) { ::close(fd); return -1; }
+            in += r;
+            out += r;
+        }
+        break;
+    }
+    return fd;
+}
+
+class snapshotter {
+public:
+    std::atomic<uint64_t> clones{0}, copies{0}, reused{0}, failed{0};
+
+    explicit snapshotter(size_t keep) : keep_(keep ? keep : 1) {}
+    snapshotter(const snapshotter&) = delete;
+    snapshotter& operator=(const snapshotter&) = delete;
+
+    /* the current version of the file open as fd; nullptr if it cannot
+       be taken (the caller serves the live file) ----------------------- */
+    std::shared_ptr<open_file> take(const std::string& path, int fd) {
+        open_file id;
+        if (!file_identity("", fd, id)) { ++failed; return nullptr; }
+        key k(id.dev, id.ino);
+        std::shared_ptr<std::promise<std::shared_ptr<open_file>>> mine;
+        std::shared_future<std::shared_ptr<open_file>>             theirs;
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            auto it = latest_.find(k);
+            if (it != latest_.end() && it->second.size == id.size && it->second.mtime_ns == id.mtime_ns) {
+                it->second.used = ++clock_;
+                if (it->second.pending.valid()) {
+                    theirs = it->second.pending;
+                } else if (std::shared_ptr<open_file> s = it->second.snap.lock()) {
+                    ++reused;
+                    return s;
+                }
+            }
+            if (!theirs.valid()) {
+                if (it == latest_.end()) evict();
+                mine = std::make_shared<std::promise<std::shared_ptr<open_file>>>();
+                version& v = latest_[k];
+                v.size     = id.size;
+                v.mtime_ns = id.mtime_ns;
+                v.used     = ++clock_;
+                v.pending  = mine->get_future().share();
+                v.snap.reset();
+            }
+        }
+        if (!mine) {
+            std::shared_ptr<open_file> s = theirs.get();
+            if (s) ++reused;
+            else   ++failed;
+            return s;
+        }
+        std::shared_ptr<open_file> s = make(path, fd, id);
+        mine->set_value(s);
+        {
+            /* from here on only the transfers hold it; a failure lets the
+               next taker try again */
+            std::lock_guard<std::mutex> lk(mu_);
+            auto it = latest_.find(k);
+            if (it != latest_.end() && it->second.size == id.size && it->second.mtime_ns == id.mtime_ns) {
+                if (s) {
+                    it->second.snap = s;
+                    it->second.pending = std::shared_future<std::shared_ptr<open_file>>();
+                } else {
+                    latest_.erase(it);
+                }
+            }
+        }
+        return s;
+    }
+
+private:
+    typedef std::pair<uint64_t, uint64_t> key;       // dev, ino
+    struct version {
+        uint64_t                                       size = 0, mtime_ns = 0;
+        uint64_t                                       used = 0;    // clock_ at the last take
+        std::shared_future<std::shared_ptr<open_file>> pending;     // while it is being made
+        std::weak_ptr<open_file>                       snap;        // once it is
+    };
+
+    /* room for one more entry (mu_ held) -------------------------------- */
+    void evict() {
+        if (latest_.size() < keep_) return;
+        for (auto it = latest_.begin(); it != latest_.end();) {
+            if (!it->second.pending.valid() && it->second.snap.expired()) it = latest_.erase(it);
+            else ++it;
+        }
+        while (latest_.size() >= keep_) {
+            auto lru = latest_.begin();
+            for (auto it = latest_.begin(); it != latest_.end(); ++it)
+                if (it->second.used < lru->second.used) lru = it;
+            latest_.erase(lru);
+        }
+    }
+
+    /* clone; if the source moved on meanwhile, the clone may be torn ---- */
+    std::shared_ptr<open_file> make(const std::string& path, int fd, const open_file& id) {
+        for (int attempt = 0; attempt < 3; ++attempt) {
+            bool                       cloned = false;
+            std::shared_ptr<open_file> s      = std::make_shared<open_file>();
+            s->fd = snapshot_clone(path, fd, id.size, cloned);
+            if (s->fd < 0) break;
+            open_file now;
+            if (!file_identity("", fd, now) || now.size != id.size || now.mtime_ns != id.mtime_ns) continue;
+            if (!file_identity("", s->fd, *s)) break;
+            ++(cloned ? clones : copies);
+            return s;
+        }
+        ++failed;
+        return nullptr;
+    }
+
+    size_t                   keep_;
+    std::mutex               mu_;
+    std::map<key, version>   latest_;
+    uint64_t                 clock_ = 0;             // orders takes, for eviction
+};
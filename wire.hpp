@@ -0,0 +1,302 @@
+// wire.hpp – bits shared by server, client and bench
+// byte order, exact socket i/o, length‑prefixed strings, peer names
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+    #include <sys/sendfile.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/* ---------------------------------------------------------------------------
+   portable 64‑bit host/network conversion
+   ---------------------------------------------------------------------------
+   – macos: OSSwap… in <libkern/OSByteOrder.h>
+   – linux: htobe64 / be64toh in <endian.h>
+   – fallback: build them by hand with htonl/ntohl
+   ------------------------------------------------------------------------- */
+#if defined(__APPLE__)
+    #include <libkern/OSByteOrder.h>
+    static inline uint64_t host_to_be64(uint64_t x) { return OSSwapHostToBigInt64(x); }
+    static inline uint64_t be64_to_host(uint64_t x) { return OSSwapBigToHostInt64(x); }
+
+#elif defined(__linux__)
+    #include <endian.h>                 // glibc ≥2.9
+    static inline uint64_t host_to_be64(uint64_t x) { return htobe64(x); }
+    static inline uint64_t be64_to_host(uint64_t x) { return be64toh(x); }
+
+#else   // generic / unknown – manual swap if needed
+    static inline uint64_t host_to_be64(uint64_t x) {
+    #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return (uint64_t)htonl(uint32_t(x >> 32)) |
+               ((uint64_t)htonl(uint32_t(x & 0xffffffff)) << 32);
+    #else
+        return x;
+    #endif
+    }
+    static inline uint64_t be64_to_host(uint64_t x) { return host_to_be64(x); }
+#endif
+/* ------------------------------------------------------------------------ */
+
+#if !defined(MSG_NOSIGNAL)          // macos: SIGPIPE is ignored by the callers
+    #define MSG_NOSIGNAL 0
+#endif
+#if !defined(MSG_MORE)
+    #define MSG_MORE 0
+#endif
+
+/* ---------------------------------------------------------------------------
+   body framing, picked by the client in its start message
+   ---------------------------------------------------------------------------
+   "Start"     legacy: '1' + min(100, left) bytes per chunk
+   "Start v2"  v2:     '2' + u32 be length + that many bytes per frame
+   both end with the termination pair '0' '0'
+   ------------------------------------------------------------------------- */
+static const size_t   LEGACY_CHUNK  = 100;
+static const char     FLAG_LEGACY   = '1';
+static const char     FLAG_V2       = '2';
+static const char     FLAG_END      = '0';
+static const uint32_t V2_MAX_FRAME  = 16u << 20;
+static const char* const START_LEGACY = "Start";
+static const char* const START_V2     = "Start v2";
+
+/* ---------------------------------------------------------------------------
+   subscriptions: "Start sub" / "Start v2 sub" instead of the start above
+   ---------------------------------------------------------------------------
+   the file goes out as usual, then the connection stays open and every
+   later version of it follows as one update:
+     'U'  kind  u64 be from  u64 be size  body  '0' '0'
+   the body is bytes [from, size) of the new version, in the framing asked
+   for. kind 'F': the whole file (from = 0), replacing what the client has;
+   'A': bytes appended to it (from = the size the client has). the server
+   hangs up if it cannot follow what was asked for.
+   ------------------------------------------------------------------------- */
+static const char* const START_LEGACY_SUB = "Start sub";
+static const char* const START_V2_SUB     = "Start v2 sub";
+static const char        FLAG_UPDATE      = 'U';
+static const char        UPDATE_FULL      = 'F';
+static const char        UPDATE_APPEND    = 'A';
+
+/* monotonic clock in nanoseconds (latency stamps, rate math) ------------- */
+static inline uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/* send_all / recv_all: move the whole buffer or report failure -----------
+   recv_all leaves errno == 0 when the peer closed cleanly                  */
+static inline bool send_all(int fd, const void* buf, size_t len, int flags = 0) {
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    while (len) {
+        ssize_t n = ::send(fd, p, len, flags | MSG_NOSIGNAL);
+        if (n < 0) { if (errno == EINTR) continue; return false; }
+        p += n; len -= n;
+    }
+    return true;
+}
+
+static inline bool recv_all(int fd, void* buf, size_t len) {
+    uint8_t* p = static_cast<uint8_t*>(buf);
+    while (len) {
+        ssize_t n = ::recv(fd, p, len, 0);
+        if (n == 0) { errno = 0; return false; }
+        if (n < 0) { if (errno == EINTR) continue; return false; }
+        p += n; len -= n;
+    }
+    return true;
+}
+
+/* sendv_all: gather‑send an iovec list, resuming after short writes ----- */
+static inline bool sendv_all(int fd, iovec* iov, int cnt, int flags = 0) {
+    while (cnt > 0) {
+        msghdr mh{};
+        mh.msg_iov    = iov;
+        mh.msg_iovlen = cnt;
+        ssize_t n = ::sendmsg(fd, &mh, flags | MSG_NOSIGNAL);
+        if (n < 0) { if (errno == EINTR) continue; return false; }
+        size_t left = static_cast<size_t>(n);
+        while (cnt > 0 && left >= iov->iov_len) { left -= iov->iov_len; ++iov; --cnt; }
+        if (cnt > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+/* sendfile_all: file range → socket without a user‑space copy;
+   plain pread + send where the kernel has no linux‑style sendfile         */
+static inline bool sendfile_all(int sock, int fd, uint64_t off, uint64_t len) {
+#if defined(__linux__)
+    off_t o = static_cast<off_t>(off);
+    while (len) {
+        ssize_t n = ::sendfile(sock, fd, &o, std::min<uint64_t>(len, 1u << 30));
+        if (n < 0) { if (errno == EINTR) continue; return false; }
+        if (n == 0) { errno = EIO; return false; }     // file shrank under us
+        len -= n;
+    }
+    return true;
+#else
+    char buf[1 << 16];
+    while (len) {
+        ssize_t n = ::pread(fd, buf, std::min<uint64_t>(len, sizeof(buf)), off);
+        if (n < 0) { if (errno == EINTR) continue; return false; }
+        if (n == 0) { errno = EIO; return false; }
+        if (!send_all(sock, buf, n)) return false;
+        off += n; len -= n;
+    }
+    return true;
+#endif
+}
+
+/* length‑prefixed strings; max guards against a bogus 4 GB length ------- */
+static inline bool send_str(int fd, const std::string& s) {
+    uint32_t n = htonl(static_cast<uint32_t>(s.size()));
+    if (!send_all(fd, &n, 4)) return false;
+    return s.empty() || send_all(fd, s.data(), s.size());
+}
+
+static inline bool recv_str(int fd, std::string& s, uint32_t max = 1u << 20) {
+    uint32_t n = 0;
+    if (!recv_all(fd, &n, 4)) return false;
+    n = ntohl(n);
+    if (n > max) { errno = EMSGSIZE; return false; }
+    s.assign(n, '\0');
+    return n == 0 || recv_all(fd, &s[0], n);
+}
+
+/* pretty‑print a peer (ip:port) ----------------------------------------- */
+static inline std::string peer_to_string(int fd) {
+    sockaddr_storage ss{};
+    socklen_t slen = sizeof(ss);
+    if (getpeername(fd, reinterpret_cast<sockaddr*>(&ss), &slen) < 0) return "?";
+    char host[NI_MAXHOST], serv[NI_MAXSERV];
+    if (getnameinfo(reinterpret_cast<sockaddr*>(&ss), slen,
+                    host, sizeof(host), serv, sizeof(serv),
+                    NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+        return "?";
+    return std::string(host) + ":" + serv;
+}
+
+/* ---------------------------------------------------------------------------
+   multipath tcp (opt‑in, --mptcp on server and client)
+   ---------------------------------------------------------------------------
+   an IPPROTO_MPTCP socket behaves like a tcp one to the code using it; the
+   kernel adds subflows over the other local addresses (ip mptcp endpoint)
+   and falls back to plain tcp per connection if the peer doesn't speak it.
+   a kernel without mptcp refuses the socket, and we open plain tcp instead.
+   ------------------------------------------------------------------------- */
+#if defined(__linux__)
+    #include <linux/mptcp.h>
+    #if !defined(IPPROTO_MPTCP)
+        #define IPPROTO_MPTCP 262
+    #endif
+    #if !defined(SOL_MPTCP)
+        #define SOL_MPTCP 284
+    #endif
+#endif
+
+/* stream socket, mptcp when asked and available; `mptcp` says which ------ */
+static inline int stream_socket(bool& mptcp) {
+#if defined(__linux__)
+    if (mptcp) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_MPTCP);
+        if (fd >= 0) return fd;
+        if (errno != EPROTONOSUPPORT && errno != EINVAL && errno != ENOPROTOOPT) return -1;
+    }
+#endif
+    mptcp = false;
+    return ::socket(AF_INET, SOCK_STREAM, 0);
+}
+
+/* subflows carrying a connection: ≥ 1 for mptcp, 0 if it fell back to tcp,
+   -1 for a plain tcp socket or a kernel without MPTCP_INFO               */
+static inline int mptcp_subflows(int fd) {
+#if defined(__linux__) && defined(MPTCP_INFO) && defined(SO_PROTOCOL)
+    int       proto = 0;
+    socklen_t plen  = sizeof(proto);
+    if (getsockopt(fd, SOL_SOCKET, SO_PROTOCOL, &proto, &plen) < 0 || proto != IPPROTO_MPTCP)
+        return -1;
+    mptcp_info mi{};
+    socklen_t  len = sizeof(mi);
+    if (getsockopt(fd, SOL_MPTCP, MPTCP_INFO, &mi, &len) < 0) return 0;     // fallback refuses it
+    #if defined(MPTCP_INFO_FLAG_FALLBACK)
+        if (mi.mptcpi_flags & MPTCP_INFO_FLAG_FALLBACK) return 0;
+    #endif
+    return 1 + mi.mptcpi_subflows;      // the count excludes the initial subflow
+#else
+    (void)fd;
+    return -1;
+#endif
+}
+
+/* ---------------------------------------------------------------------------
+   TCP_INFO as one log‑friendly line (probe queries, client --probe)
+   ---------------------------------------------------------------------------
+   glibc's struct tcp_info stops at tcpi_total_retrans; newer kernels fill
+   in more (min rtt, delivery rate) when asked with a bigger buffer, so the
+   tail is declared here and used only if the kernel wrote it.
+   ------------------------------------------------------------------------- */
+#if defined(__linux__) && defined(TCP_INFO)
+struct tcp_info_tail {
+    struct tcp_info base;
+    uint64_t        pacing_rate, max_pacing_rate, bytes_acked, bytes_received;
+    uint32_t        segs_out, segs_in, notsent_bytes, min_rtt, data_segs_in, data_segs_out;
+    uint64_t        delivery_rate;
+};
+#endif
+
+/* sender: "rtt=… min_rtt=… cwnd=… retrans=… delivery_rate=…";
+   receiver: "rcv_rtt=… rcv_space=… rcv_mss=…"; empty where there is no TCP_INFO */
+static inline std::string tcp_info_line(int fd, bool sender) {
+#if defined(__linux__) && defined(TCP_INFO)
+    tcp_info_tail t{};
+    socklen_t     len = sizeof(t);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &t, &len) < 0) return std::string();
+    char min_rtt[32] = "?", rate[32] = "?", buf[256];
+    if (len >= sizeof(t)) {
+        std::snprintf(min_rtt, sizeof(min_rtt), "%.3fms", t.min_rtt / 1e3);
+        std::snprintf(rate, sizeof(rate), "%.1fMbit/s", t.delivery_rate * 8 / 1e6);
+    }
+    if (sender)
+        std::snprintf(buf, sizeof(buf), "rtt=%.3fms rttvar=%.3fms min_rtt=%s cwnd=%u mss=%u retrans=%u delivery_rate=%s",
+                      t.base.tcpi_rtt / 1e3, t.base.tcpi_rttvar / 1e3, min_rtt,
+                      t.base.tcpi_snd_cwnd, t.base.tcpi_snd_mss, t.base.tcpi_total_retrans, rate);
+    else
+        std::snprintf(buf, sizeof(buf), "rcv_rtt=%.3fms rcv_space=%u rcv_mss=%u",
+                      t.base.tcpi_rcv_rtt / 1e3, t.base.tcpi_rcv_space, t.base.tcpi_rcv_mss);
+    return buf;
+#else
+    (void)fd; (void)sender;
+    return std::string();
+#endif
+}
+
+/* smoothed rtt of a connection in microseconds, as the kernel sees it
+   (receiver side: its rtt estimate from the data it gets); 0 if unknown */
+static inline uint32_t tcp_rtt_us(int fd, bool sender) {
+#if defined(__linux__) && defined(TCP_INFO)
+    struct tcp_info t{};
+    socklen_t       len = sizeof(t);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &t, &len) < 0) return 0;
+    return sender ? t.tcpi_rtt : t.tcpi_rcv_rtt;
+#else
+    (void)fd; (void)sender;
+    return 0;
+#endif
+}